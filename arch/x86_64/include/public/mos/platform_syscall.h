@@ -12,49 +12,49 @@ enum
     X86_SYSCALL_SET_GS_BASE = 3,  // set the GS base address
 };
 
-should_inline reg_t platform_syscall0(reg_t number)
+must_inline reg_t platform_syscall0(reg_t number)
 {
     reg_t result = 0;
     __asm__ volatile("int $0x88" : "=a"(result) : "a"(number) : "memory");
     return result;
 }
 
-should_inline reg_t platform_syscall1(reg_t number, reg_t arg1)
+must_inline reg_t platform_syscall1(reg_t number, reg_t arg1)
 {
     reg_t result = 0;
     __asm__ volatile("int $0x88" : "=a"(result) : "a"(number), "b"(arg1) : "memory");
     return result;
 }
 
-should_inline reg_t platform_syscall2(reg_t number, reg_t arg1, reg_t arg2)
+must_inline reg_t platform_syscall2(reg_t number, reg_t arg1, reg_t arg2)
 {
     reg_t result = 0;
     __asm__ volatile("int $0x88" : "=a"(result) : "a"(number), "b"(arg1), "c"(arg2) : "memory");
     return result;
 }
 
-should_inline reg_t platform_syscall3(reg_t number, reg_t arg1, reg_t arg2, reg_t arg3)
+must_inline reg_t platform_syscall3(reg_t number, reg_t arg1, reg_t arg2, reg_t arg3)
 {
     reg_t result = 0;
     __asm__ volatile("int $0x88" : "=a"(result) : "a"(number), "b"(arg1), "c"(arg2), "d"(arg3) : "memory");
     return result;
 }
 
-should_inline reg_t platform_syscall4(reg_t number, reg_t arg1, reg_t arg2, reg_t arg3, reg_t arg4)
+must_inline reg_t platform_syscall4(reg_t number, reg_t arg1, reg_t arg2, reg_t arg3, reg_t arg4)
 {
     reg_t result = 0;
     __asm__ volatile("int $0x88" : "=a"(result) : "a"(number), "b"(arg1), "c"(arg2), "d"(arg3), "S"(arg4) : "memory");
     return result;
 }
 
-should_inline reg_t platform_syscall5(reg_t number, reg_t arg1, reg_t arg2, reg_t arg3, reg_t arg4, reg_t arg5)
+must_inline reg_t platform_syscall5(reg_t number, reg_t arg1, reg_t arg2, reg_t arg3, reg_t arg4, reg_t arg5)
 {
     reg_t result = 0;
     __asm__ volatile("int $0x88" : "=a"(result) : "a"(number), "b"(arg1), "c"(arg2), "d"(arg3), "S"(arg4), "D"(arg5) : "memory");
     return result;
 }
 
-should_inline reg_t platform_syscall6(reg_t number, reg_t arg1, reg_t arg2, reg_t arg3, reg_t arg4, reg_t arg5, reg_t arg6)
+must_inline reg_t platform_syscall6(reg_t number, reg_t arg1, reg_t arg2, reg_t arg3, reg_t arg4, reg_t arg5, reg_t arg6)
 {
     reg_t result = 0;
     __asm__ volatile("int $0x88" : "=a"(result) : "a"(number), "b"(arg1), "c"(arg2), "d"(arg3), "S"(arg4), "D"(arg5), "r"(arg6) : "memory");
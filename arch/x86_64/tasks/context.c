@@ -8,6 +8,7 @@
 #include "mos/x86/tasks/fpu_context.h"
 
 #include <mos/lib/structures/stack.h>
+#include <mos/lib/sync/spinlock.h>
 #include <mos/mos_global.h>
 #include <mos/platform/platform.h>
 #include <mos/printk.h>
@@ -42,9 +43,51 @@ static void x86_start_user_thread()
     x86_interrupt_return_impl(regs);
 }
 
+// xsave areas of destroyed threads are kept for new ones, as many as there are cached kernel stacks
+typedef struct
+{
+    spinlock_t lock;
+    size_t count;
+    void *areas[MOS_KSTACK_CACHE_SIZE + 1]; // +1 so that a cache size of 0 compiles
+} xsave_cache_t;
+
+static PER_CPU_DECLARE(xsave_cache_t, xsave_cache);
+
+static void *x86_xsave_area_alloc(void)
+{
+    xsave_cache_t *cache = per_cpu(xsave_cache);
+    spinlock_acquire(&cache->lock);
+    void *area = cache->count ? cache->areas[--cache->count] : NULL;
+    spinlock_release(&cache->lock);
+
+    if (!area)
+        return kmalloc(xsave_area_slab); // zeroed by the slab
+
+    memzero(area, platform_info->arch_info.xsave_size);
+    return area;
+}
+
+static void x86_xsave_area_free(void *area)
+{
+    xsave_cache_t *cache = per_cpu(xsave_cache);
+    spinlock_acquire(&cache->lock);
+    if (cache->count < MOS_KSTACK_CACHE_SIZE)
+    {
+        cache->areas[cache->count++] = area;
+        spinlock_release(&cache->lock);
+        return;
+    }
+    spinlock_release(&cache->lock);
+    kfree(area);
+}
+
 static platform_regs_t *x86_setup_thread_common(thread_t *thread)
 {
-    thread->platform_options.xsaveptr = kmalloc(xsave_area_slab);
+    // a thread that execs is set up again, reuse its xsave area
+    if (thread->platform_options.xsaveptr)
+        memzero(thread->platform_options.xsaveptr, platform_info->arch_info.xsave_size);
+    else
+        thread->platform_options.xsaveptr = x86_xsave_area_alloc();
     thread->k_stack.head -= sizeof(platform_regs_t);
     platform_regs_t *regs = platform_thread_regs(thread);
     *regs = (platform_regs_t){ 0 };
@@ -101,7 +144,7 @@ static void x86_clone_forked_context(const thread_t *from, thread_t *to)
     if (to->mode == THREAD_MODE_USER)
     {
         to->u_stack.head = to_regs->sp;
-        to->platform_options.xsaveptr = kmalloc(xsave_area_slab);
+        to->platform_options.xsaveptr = x86_xsave_area_alloc();
         memcpy(to->platform_options.xsaveptr, from->platform_options.xsaveptr, platform_info->arch_info.xsave_size);
     }
 
@@ -111,6 +154,14 @@ static void x86_clone_forked_context(const thread_t *from, thread_t *to)
 }
 __alias(x86_clone_forked_context, platform_context_clone);
 
+static void x86_cleanup_context(thread_t *thread)
+{
+    if (thread->platform_options.xsaveptr)
+        x86_xsave_area_free(thread->platform_options.xsaveptr);
+    thread->platform_options.xsaveptr = NULL;
+}
+__alias(x86_cleanup_context, platform_context_cleanup);
+
 static void x86_switch_to_thread(ptr_t *scheduler_stack, thread_t *new_thread, switch_flags_t switch_flags)
 {
     thread_t *const old_thread = current_thread;
@@ -19,7 +19,7 @@ static size_t console_io_read(io_t *io, void *data, size_t size)
     console_t *con = container_of(io, console_t, io);
 
     spinlock_acquire(&con->read.lock);
-    if (ring_buffer_pos_is_empty(&con->read.pos))
+    if (ring_buffer_spsc_is_empty(&con->read.pos))
     {
         spinlock_release(&con->read.lock);
         bool ok = reschedule_for_waitlist(&con->waitlist);
@@ -37,7 +37,7 @@ static size_t console_io_read(io_t *io, void *data, size_t size)
         }
     }
 
-    const size_t rd = ring_buffer_pos_pop_front(con->read.buf, &con->read.pos, data, size);
+    const size_t rd = ring_buffer_spsc_pop(con->read.buf, &con->read.pos, data, size);
     spinlock_release(&con->read.lock);
 
     return rd;
@@ -78,7 +78,7 @@ void console_register(console_t *con)
     {
         MOS_ASSERT_X(con->read.buf, "console: '%s' has no read buffer", con->name);
         con->read.lock = (spinlock_t) SPINLOCK_INIT;
-        ring_buffer_pos_init(&con->read.pos, con->read.size);
+        ring_buffer_spsc_init(&con->read.pos, con->read.size);
         flags |= IO_READABLE;
     }
 
@@ -133,6 +133,7 @@ size_t console_write_color(console_t *con, const char *data, size_t size, standa
 
 void console_putc(console_t *con, u8 c)
 {
-    ring_buffer_pos_push_back_byte(con->read.buf, &con->read.pos, c);
+    // called from the interrupt handler, the only producer, so it doesn't need the lock
+    ring_buffer_spsc_push_byte(con->read.buf, &con->read.pos, c);
     waitlist_wake(&con->waitlist, INT_MAX);
 }
@@ -1,7 +1,10 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include "mos/filesystem/sysfs/sysfs.h"
+#include "mos/filesystem/sysfs/sysfs_autoinit.h"
 #include "mos/filesystem/vfs_types.h"
 #include "mos/filesystem/vfs_utils.h"
+#include "mos/misc/profiling.h"
 #include "mos/mm/mm.h"
 #include "mos/mm/physical/pmm.h"
 #include "mos/mm/slab.h"
@@ -11,11 +14,14 @@
 #include <mos/filesystem/dentry.h>
 #include <mos/filesystem/fs_types.h>
 #include <mos/filesystem/vfs.h>
+#include <mos/lib/structures/hashmap.h>
+#include <mos/lib/structures/hashmap_common.h>
 #include <mos/lib/structures/list.h>
 #include <mos/lib/structures/tree.h>
 #include <mos/mos_global.h>
 #include <mos/printk.h>
 #include <mos/setup.h>
+#include <mos_stdio.h>
 #include <mos_stdlib.h>
 #include <mos_string.h>
 
@@ -53,15 +59,33 @@ typedef struct
 
 MOS_STATIC_ASSERT(sizeof(cpio_newc_header_t) == 110, "cpio_newc_header has wrong size");
 
+#define CPIO_FIELD(header, field) strntoll((header)->field, NULL, 16, sizeof((header)->field) / sizeof(char))
+
 static filesystem_t fs_cpiofs;
 
+// The archive is indexed once, on the first mount. Every file gets an entry, which is found by
+// its path in a hash table, and every directory has an array of its children in archive order.
+typedef struct _cpio_entry cpio_entry_t;
+struct _cpio_entry
+{
+    const cpio_newc_header_t *header; // in the archive
+    const char *path;                 // in the archive, e.g. "." for the root, "bin/init" for others
+    size_t path_len;
+    const char *name; // the last segment of the path
+    size_t name_len;
+    u64 ino;
+    u32 mode;
+    size_t data_offset, data_length;
+
+    cpio_entry_t *parent;
+    cpio_entry_t **children; // directories only
+    size_t n_children;
+};
+
 typedef struct
 {
     inode_t inode;
-    size_t header_offset;
-    size_t name_offset, name_length;
-    size_t data_offset;
-    cpio_newc_header_t header;
+    const cpio_entry_t *entry;
 } cpio_inode_t;
 
 static const inode_ops_t cpio_dir_inode_ops;
@@ -98,62 +122,150 @@ static file_type_t cpio_modebits_to_filetype(u32 modebits)
     return type;
 }
 
-static bool cpio_read_metadata(const char *target, cpio_newc_header_t *header, size_t *header_offset, size_t *name_offset, size_t *name_length, size_t *data_offset,
-                               size_t *data_length)
+static hashmap_t cpio_index = { 0 }; // path -> cpio_entry_t *
+static cpio_entry_t *cpio_entries = NULL;
+
+static struct
 {
-    if (unlikely(strcmp(target, "TRAILER!!!") == 0))
-        mos_panic("what the heck are you doing?");
+    size_t shared_pages; // file pages put into the page cache by reference to the initrd
+    size_t copied_pages;
+} cpio_stat = { 0 };
 
+should_inline const void *initrd_ptr(size_t offset)
+{
+    return (const void *) (pfn_va(platform_info->initrd_pfn) + offset);
+}
+
+// walk the archive headers, returns the number of entries, filling them in if entries is not NULL
+static size_t cpio_index_scan(cpio_entry_t *entries)
+{
+    const size_t archive_size = platform_info->initrd_npages * MOS_PAGE_SIZE;
     size_t offset = 0;
+    size_t n = 0;
 
     while (true)
     {
-        initrd_read(header, sizeof(cpio_newc_header_t), offset);
+        if (offset + sizeof(cpio_newc_header_t) > archive_size)
+        {
+            mos_warn("cpio: archive truncated, no trailer found");
+            return n;
+        }
 
+        const cpio_newc_header_t *header = initrd_ptr(offset);
         if (strncmp(header->magic, "07070", 5) != 0 || (header->magic[5] != '1' && header->magic[5] != '2'))
         {
             mos_warn("invalid cpio header magic, possibly corrupt archive");
-            return false;
+            return n;
         }
 
-        offset += sizeof(cpio_newc_header_t);
-
-        const size_t filename_len = strntoll(header->namesize, NULL, 16, sizeof(header->namesize) / sizeof(char));
-
-        char filename[filename_len + 1]; // +1 for null terminator
-        initrd_read(filename, filename_len, offset);
-        filename[filename_len] = '\0';
+        const size_t name_offset = offset + sizeof(cpio_newc_header_t);
+        const size_t namesize = CPIO_FIELD(header, namesize); // including the null terminator
+        const size_t data_offset = ALIGN_UP(name_offset + namesize, 4);
+        const size_t data_length = CPIO_FIELD(header, filesize);
+        if (namesize == 0 || data_offset + data_length > archive_size)
+        {
+            mos_warn("cpio: archive truncated");
+            return n;
+        }
 
-        bool found = strncmp(filename, target, filename_len) == 0;
+        const char *path = initrd_ptr(name_offset);
+        if (strcmp(path, "TRAILER!!!") == 0)
+            return n;
 
-        if (found)
+        if (entries)
         {
-            *header_offset = offset - sizeof(cpio_newc_header_t);
-            *name_offset = offset;
-            *name_length = filename_len;
+            cpio_entry_t *entry = &entries[n];
+            entry->header = header;
+            entry->path = path;
+            entry->path_len = strlen(path); // the name may be padded with extra NULs, see scripts/mkinitrd.py
+            entry->ino = CPIO_FIELD(header, ino);
+            entry->mode = CPIO_FIELD(header, mode);
+            entry->data_offset = data_offset;
+            entry->data_length = data_length;
+
+            const char *slash = strrchr(path, '/');
+            entry->name = slash ? slash + 1 : path;
+            entry->name_len = entry->path_len - (entry->name - path);
         }
 
-        if (unlikely(strcmp(filename, "TRAILER!!!") == 0))
-            return false;
+        n++;
+        offset = ALIGN_UP(data_offset + data_length, 4);
+    }
+}
 
-        offset += filename_len;
-        offset = ((offset + 3) & ~0x03); // align to 4 bytes
+static cpio_entry_t *cpio_index_find_parent(const cpio_entry_t *entry)
+{
+    if (entry->name == entry->path)
+        return hashmap_get(&cpio_index, (ptr_t) "."); // a top-level entry
+
+    const size_t parent_len = entry->name - entry->path - 1; // -1 for the slash
+    char parent_path[parent_len + 1];
+    memcpy(parent_path, entry->path, parent_len);
+    parent_path[parent_len] = '\0';
+    return hashmap_get(&cpio_index, (ptr_t) parent_path);
+}
 
-        size_t data_len = strntoll(header->filesize, NULL, 16, sizeof(header->filesize) / sizeof(char));
-        if (found)
-        {
-            *data_offset = offset;
-            *data_length = data_len;
-        }
+static bool cpio_index_build(void)
+{
+    const pf_point_t ev = profile_enter();
+
+    const size_t n = cpio_index_scan(NULL);
+    cpio_entry_t *entries = kcalloc(MAX(n, 1u), sizeof(cpio_entry_t));
+    if (!entries)
+        return false;
+
+    cpio_index_scan(entries);
+    hashmap_init(&cpio_index, MAX(n, 1u), hashmap_hash_string, hashmap_compare_string);
+    for (size_t i = 0; i < n; i++)
+        hashmap_put(&cpio_index, (ptr_t) entries[i].path, &entries[i]);
 
-        offset += data_len;
-        offset = ((offset + 3) & ~0x03); // align to 4 bytes (again)
+    // count the children of each directory, then collect them
+    for (size_t i = 0; i < n; i++)
+    {
+        cpio_entry_t *entry = &entries[i];
+        if (strcmp(entry->path, ".") == 0)
+            continue; // the root
+
+        entry->parent = cpio_index_find_parent(entry);
+        if (entry->parent)
+            entry->parent->n_children++;
+        else
+            pr_warn("cpio: '%s' has no parent directory in the archive", entry->path);
+    }
 
-        if (found)
-            return true;
+    for (size_t i = 0; i < n; i++)
+    {
+        cpio_entry_t *entry = &entries[i];
+        if (entry->n_children)
+            entry->children = kcalloc(entry->n_children, sizeof(cpio_entry_t *)), entry->n_children = 0;
     }
 
-    MOS_UNREACHABLE();
+    for (size_t i = 0; i < n; i++)
+    {
+        cpio_entry_t *entry = &entries[i];
+        if (entry->parent && entry->parent->children)
+            entry->parent->children[entry->parent->n_children++] = entry;
+    }
+
+    // the archive's own reference, so that the page cache never frees an initrd frame it was given
+    pmm_ref(platform_info->initrd_pfn, platform_info->initrd_npages);
+
+    cpio_entries = entries;
+    profile_leave(ev, "cpio.index");
+    pr_dinfo2(cpio, "indexed %zu entries", n);
+    return true;
+}
+
+static const cpio_entry_t *cpio_index_lookup_child(const cpio_entry_t *dir, const char *name)
+{
+    char path[MOS_PATH_MAX_LENGTH];
+    const bool is_root = strcmp(dir->path, ".") == 0;
+    const int len = is_root ? snprintf(path, sizeof(path), "%s", name) : snprintf(path, sizeof(path), "%s/%s", dir->path, name);
+    if (len < 0 || (size_t) len >= sizeof(path))
+        return NULL;
+
+    const cpio_entry_t *entry = hashmap_get(&cpio_index, (ptr_t) path);
+    return entry && entry->parent == dir ? entry : NULL;
 }
 
 should_inline cpio_inode_t *CPIO_INODE(inode_t *inode)
@@ -163,39 +275,26 @@ should_inline cpio_inode_t *CPIO_INODE(inode_t *inode)
 
 // ============================================================================================================
 
-static cpio_inode_t *cpio_inode_trycreate(const char *path, superblock_t *sb)
+static cpio_inode_t *cpio_inode_create(const cpio_entry_t *entry, superblock_t *sb)
 {
-    cpio_newc_header_t header = { 0 };
-    size_t header_offset = 0;
-    size_t name_offset = 0, name_length = 0;
-    size_t data_offset = 0, data_length = 0;
-    const bool found = cpio_read_metadata(path, &header, &header_offset, &name_offset, &name_length, &data_offset, &data_length);
-    if (!found)
-        return NULL;
-
     cpio_inode_t *cpio_inode = kmalloc(cpio_inode_cache);
-    cpio_inode->header = header;
-    cpio_inode->header_offset = header_offset;
-    cpio_inode->name_offset = name_offset;
-    cpio_inode->name_length = name_length;
-    cpio_inode->data_offset = data_offset;
-
-    const u32 modebits = strntoll(cpio_inode->header.mode, NULL, 16, sizeof(cpio_inode->header.mode) / sizeof(char));
-    const u64 ino = strntoll(cpio_inode->header.ino, NULL, 16, sizeof(cpio_inode->header.ino) / sizeof(char));
+    cpio_inode->entry = entry;
+
+    const u32 modebits = entry->mode;
     const file_type_t file_type = cpio_modebits_to_filetype(modebits & CPIO_MODE_FILE_TYPE);
 
     inode_t *const inode = &cpio_inode->inode;
-    inode_init(inode, sb, ino, file_type);
+    inode_init(inode, sb, entry->ino, file_type);
 
     // 0000777 - The lower 9 bits specify read/write/execute permissions for world, group, and user following standard POSIX conventions.
     inode->perm = modebits & PERM_MASK;
-    inode->size = data_length;
-    inode->uid = strntoll(cpio_inode->header.uid, NULL, 16, sizeof(cpio_inode->header.uid) / sizeof(char));
-    inode->gid = strntoll(cpio_inode->header.gid, NULL, 16, sizeof(cpio_inode->header.gid) / sizeof(char));
+    inode->size = entry->data_length;
+    inode->uid = CPIO_FIELD(entry->header, uid);
+    inode->gid = CPIO_FIELD(entry->header, gid);
     inode->sticky = modebits & CPIO_MODE_STICKY;
     inode->suid = modebits & CPIO_MODE_SUID;
     inode->sgid = modebits & CPIO_MODE_SGID;
-    inode->nlinks = strntoll(cpio_inode->header.nlink, NULL, 16, sizeof(cpio_inode->header.nlink) / sizeof(char));
+    inode->nlinks = CPIO_FIELD(entry->header, nlink);
     inode->ops = file_type == FILE_TYPE_DIRECTORY ? &cpio_dir_inode_ops : &cpio_file_inode_ops;
     inode->file_ops = file_type == FILE_TYPE_DIRECTORY ? NULL : &cpio_file_ops;
     inode->cache.ops = &cpio_icache_ops;
@@ -215,16 +314,20 @@ static dentry_t *cpio_mount(filesystem_t *fs, const char *dev_name, const char *
     if (dev_name && strcmp(dev_name, "none") != 0)
         pr_warn("cpio: mount: dev_name is not supported");
 
-    superblock_t *sb = kmalloc(superblock_cache);
-    cpio_inode_t *i = cpio_inode_trycreate(".", sb);
-    if (!i)
-    {
-        kfree(sb);
+    if (!cpio_entries && !cpio_index_build())
+        return NULL;
+
+    const cpio_entry_t *root = hashmap_get(&cpio_index, (ptr_t) ".");
+    if (!root)
         return NULL; // not found
-    }
 
-    pr_dinfo2(cpio, "cpio header: %.6s", i->header.magic);
+    superblock_t *sb = kmalloc(superblock_cache);
+    cpio_inode_t *i = cpio_inode_create(root, sb);
+
+    pr_dinfo2(cpio, "cpio header: %.6s", root->header->magic);
     sb->fs = fs;
+    sb->dentries_reclaimable = true; // any file can be found again in the archive
+    sb->negative_dentries = true;    // and the archive never changes
     sb->root = dentry_create(sb, NULL, NULL);
     sb->root->inode = &i->inode;
     sb->root->superblock = i->inode.superblock = sb;
@@ -233,105 +336,69 @@ static dentry_t *cpio_mount(filesystem_t *fs, const char *dev_name, const char *
 
 static bool cpio_i_lookup(inode_t *parent_dir, dentry_t *dentry)
 {
-    // keep prepending the path with the parent path, until we reach the root
-    char pathbuf[MOS_PATH_MAX_LENGTH] = { 0 };
-    dentry_path(dentry, parent_dir->superblock->root, pathbuf, sizeof(pathbuf));
-    const char *path = pathbuf + 1; // skip the first slash
-
-    cpio_inode_t *inode = cpio_inode_trycreate(path, parent_dir->superblock);
-    if (!inode)
+    const cpio_entry_t *entry = cpio_index_lookup_child(CPIO_INODE(parent_dir)->entry, dentry->name);
+    if (!entry)
         return false; // not found
 
-    dentry->inode = &inode->inode;
+    dentry->inode = &cpio_inode_create(entry, parent_dir->superblock)->inode;
     return true;
 }
 
-static void cpio_i_iterate_dir(dentry_t *dentry, vfs_listdir_state_t *state, dentry_iterator_op add_record)
+// a position in the listing is the index of a child of the directory
+static bool cpio_i_readdir(dentry_t *dentry, vfs_listdir_state_t *state, dentry_readdir_op emit)
 {
-    cpio_inode_t *inode = CPIO_INODE(dentry->inode);
-
-    char path_prefix[inode->name_length + 1]; // +1 for null terminator
-    initrd_read(path_prefix, inode->name_length, inode->name_offset);
-    path_prefix[inode->name_length] = '\0';
-    size_t prefix_len = strlen(path_prefix); // +1 for the slash
-
-    if (strcmp(path_prefix, ".") == 0)
-        path_prefix[0] = '\0', prefix_len = 0; // root directory
-
-    // find all children of this directory, that starts with 'path' and doesn't have any more slashes
-    cpio_newc_header_t header;
-    size_t offset = 0;
+    const cpio_entry_t *dir = CPIO_INODE(dentry->inode)->entry;
 
-    while (true)
+    for (size_t i = state->pos; i < dir->n_children; i++)
     {
-        initrd_read(&header, sizeof(cpio_newc_header_t), offset);
-        offset += sizeof(cpio_newc_header_t);
-
-        if (strncmp(header.magic, "07070", 5) != 0 || (header.magic[5] != '1' && header.magic[5] != '2'))
-            mos_panic("invalid cpio header magic, possibly corrupt archive");
-
-        const size_t filename_len = strntoll(header.namesize, NULL, 16, sizeof(header.namesize) / sizeof(char));
-
-        char filename[filename_len + 1]; // +1 for null terminator
-        initrd_read(filename, filename_len, offset);
-        filename[filename_len] = '\0';
-
-        const bool found = strncmp(path_prefix, filename, prefix_len) == 0     // make sure the path starts with the parent path
-                           && (prefix_len == 0 || filename[prefix_len] == '/') // make sure it's a child, not a sibling (/path/to vs /path/toooo)
-                           && strchr(filename + prefix_len + 1, '/') == NULL;  // make sure it's only one level deep
-
-        const bool is_TRAILER = strcmp(filename, "TRAILER!!!") == 0;
-        const bool is_root_dot = strcmp(filename, ".") == 0;
-
-        if (found && !is_TRAILER && !is_root_dot)
-        {
-            pr_dinfo2(cpio, "prefix '%s' filename '%s'", path_prefix, filename);
-
-            const u32 modebits = strntoll(header.mode, NULL, 16, sizeof(header.mode) / sizeof(char));
-            const file_type_t type = cpio_modebits_to_filetype(modebits & CPIO_MODE_FILE_TYPE);
-            const s64 ino = strntoll(header.ino, NULL, 16, sizeof(header.ino) / sizeof(char));
-
-            const char *name = filename + prefix_len + (prefix_len == 0 ? 0 : 1);          // +1 for the slash if it's not the root
-            const size_t name_len = filename_len - prefix_len - (prefix_len == 0 ? 0 : 1); // -1 for the slash if it's not the root
-
-            add_record(state, ino, name, name_len, type);
-        }
-
-        if (unlikely(is_TRAILER))
-            break;
-
-        offset += filename_len;
-        offset = ((offset + 3) & ~0x03); // align to 4 bytes
-
-        const size_t data_len = strntoll(header.filesize, NULL, 16, sizeof(header.filesize) / sizeof(char));
-        offset += data_len;
-        offset = ((offset + 3) & ~0x03); // align to 4 bytes (again)
+        const cpio_entry_t *child = dir->children[i];
+        const file_type_t type = cpio_modebits_to_filetype(child->mode & CPIO_MODE_FILE_TYPE);
+        if (!emit(state, child->ino, child->name, child->name_len, type, i + 1))
+            return true; // continue from this entry next time
     }
+
+    return true;
 }
 
 static size_t cpio_i_readlink(dentry_t *dentry, char *buffer, size_t buflen)
 {
     cpio_inode_t *inode = CPIO_INODE(dentry->inode);
-    return initrd_read(buffer, MIN(buflen, inode->inode.size), inode->data_offset);
+    return initrd_read(buffer, MIN(buflen, inode->inode.size), inode->entry->data_offset);
 }
 
 static const inode_ops_t cpio_dir_inode_ops = {
     .lookup = cpio_i_lookup,
-    .iterate_dir = cpio_i_iterate_dir,
+    .readdir = cpio_i_readdir,
 };
 
 static const inode_ops_t cpio_file_inode_ops = {
     .readlink = cpio_i_readlink,
 };
 
+static bool cpio_f_open(inode_t *inode, file_t *file, bool created)
+{
+    MOS_UNUSED(inode);
+    MOS_UNUSED(created);
+    return !(file->io.flags & IO_WRITABLE); // the page cache may hold the initrd's own pages, which must not be written to
+}
+
 static const file_ops_t cpio_file_ops = {
+    .open = cpio_f_open,
     .read = vfs_generic_read,
 };
 
 static phyframe_t *cpio_fill_cache(inode_cache_t *cache, off_t pgoff)
 {
     inode_t *i = cache->owner;
-    cpio_inode_t *cpio_i = CPIO_INODE(i);
+    const cpio_entry_t *entry = CPIO_INODE(i)->entry;
+
+    // a whole page of page-aligned file data is taken from the initrd as it is, a partial one
+    // is copied so that the bytes after EOF read as zeroes
+    if (entry->data_offset % MOS_PAGE_SIZE == 0 && (size_t) (pgoff + 1) * MOS_PAGE_SIZE <= i->size)
+    {
+        cpio_stat.shared_pages++;
+        return pmm_ref_one(pfn_phyframe(platform_info->initrd_pfn + entry->data_offset / MOS_PAGE_SIZE + pgoff));
+    }
 
     phyframe_t *page = mm_get_free_page();
     if (!page)
@@ -342,8 +409,9 @@ static phyframe_t *cpio_fill_cache(inode_cache_t *cache, off_t pgoff)
         return page; // EOF, no need to read anything
 
     const size_t bytes_to_read = MIN((size_t) MOS_PAGE_SIZE, i->size - pgoff * MOS_PAGE_SIZE);
-    const size_t read = initrd_read((char *) phyframe_va(page), bytes_to_read, cpio_i->data_offset + pgoff * MOS_PAGE_SIZE);
+    const size_t read = initrd_read((char *) phyframe_va(page), bytes_to_read, entry->data_offset + pgoff * MOS_PAGE_SIZE);
     MOS_ASSERT(read == bytes_to_read);
+    cpio_stat.copied_pages++;
     return page;
 }
 
@@ -351,6 +419,20 @@ static const inode_cache_ops_t cpio_icache_ops = {
     .fill_cache = cpio_fill_cache,
 };
 
+static bool cpio_sysfs_stat(sysfs_file_t *f)
+{
+    sysfs_printf(f, "%-20s: %zu\n", "SharedPages", cpio_stat.shared_pages);
+    sysfs_printf(f, "%-20s: %zu\n", "CopiedPages", cpio_stat.copied_pages);
+    sysfs_printf(f, "%-20s: %zu KB\n", "Saved", cpio_stat.shared_pages * MOS_PAGE_SIZE / 1024);
+    return true;
+}
+
+static sysfs_item_t cpio_sysfs_items[] = {
+    SYSFS_RO_ITEM("stat", cpio_sysfs_stat),
+};
+
+SYSFS_AUTOREGISTER(cpio, cpio_sysfs_items);
+
 static filesystem_t fs_cpiofs = {
     .list_node = LIST_HEAD_INIT(fs_cpiofs.list_node),
     .superblocks = LIST_HEAD_INIT(fs_cpiofs.superblocks),
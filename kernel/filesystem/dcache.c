@@ -0,0 +1,331 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mos/filesystem/dentry.h"
+#include "mos/filesystem/inode.h"
+#include "mos/filesystem/page_cache.h"
+#include "mos/filesystem/sysfs/sysfs.h"
+#include "mos/filesystem/sysfs/sysfs_autoinit.h"
+#include "mos/filesystem/vfs_types.h"
+#include "mos/filesystem/vfs_utils.h"
+#include "mos/lib/sync/spinlock.h"
+#include "mos/printk.h"
+
+#include <mos/lib/structures/list.h>
+#include <mos_stdlib.h>
+#include <mos_string.h>
+
+// The dentry cache indexes every named dentry by (parent, name) in a hash table, so that looking
+// up a child doesn't walk the parent's list of children.
+//
+// A failed lookup leaves a negative dentry (one without an inode) behind. On filesystems that
+// allow it, these are kept in an LRU list of bounded length, so that repeating the lookup (e.g.
+// searching $PATH) doesn't go to the filesystem again.
+//
+// The reclaimer unlinks and frees unused dentries at any time, so dcache_lock also protects the
+// children list of every dentry, and a lookup pins the dentry it works on, negative or not.
+
+#define DCACHE_HASH_BITS    10
+#define DCACHE_HASH_BUCKETS (1 << DCACHE_HASH_BITS)
+
+static spinlock_t dcache_lock = SPINLOCK_INIT;                              // protects the hash table, the LRU and the tree
+static list_head dcache_buckets[DCACHE_HASH_BUCKETS];                       // initialised on first use
+static list_head dcache_negative_lru = LIST_HEAD_INIT(dcache_negative_lru); // least recently used first
+static size_t dcache_negative_count = 0;
+static size_t dcache_negative_max = MOS_VFS_DCACHE_NEGATIVE_MAX;
+static size_t dcache_shrink_hand = 0; // the bucket where the next scan for unused dentries starts
+
+dcache_stat_t dcache_stat = { 0 };
+
+static list_head *dcache_bucket(const dentry_t *parent, u32 name_hash)
+{
+    const u32 hash = (name_hash ^ (u32) ((ptr_t) parent >> 4)) * 0x9e3779b1u;
+    list_head *bucket = &dcache_buckets[hash >> (32 - DCACHE_HASH_BITS)];
+    if (unlikely(bucket->next == NULL))
+        linked_list_init(bucket);
+    return bucket;
+}
+
+void dcache_insert(dentry_t *parent, dentry_t *dentry)
+{
+    MOS_ASSERT(parent);
+    if (dentry->name)
+        dentry->name_hash = dcache_hash_name(dentry->name, strlen(dentry->name));
+
+    spinlock_acquire(&dcache_lock);
+    tree_add_child(tree_node(parent), tree_node(dentry));
+    if (dentry->name)
+        list_node_append(dcache_bucket(parent, dentry->name_hash), &dentry->hash_node);
+    spinlock_release(&dcache_lock);
+}
+
+void dcache_tree_lock(void)
+{
+    spinlock_acquire(&dcache_lock);
+}
+
+void dcache_tree_unlock(void)
+{
+    spinlock_release(&dcache_lock);
+}
+
+// take a dentry out of the hash table and the LRU, it stays in the tree
+static void dcache_remove_locked(dentry_t *dentry)
+{
+    if (!list_is_empty(&dentry->hash_node))
+        list_node_remove(&dentry->hash_node);
+
+    if (!list_is_empty(&dentry->lru_node))
+    {
+        list_node_remove(&dentry->lru_node);
+        dcache_negative_count--;
+    }
+}
+
+void dcache_remove(dentry_t *dentry)
+{
+    spinlock_acquire(&dcache_lock);
+    dcache_remove_locked(dentry);
+    list_node_remove(&tree_node(dentry)->list_node);
+    spinlock_release(&dcache_lock);
+}
+
+static dentry_t *dcache_find_locked(const dentry_t *parent, const char *name, size_t len, u32 hash)
+{
+    list_head *bucket = dcache_bucket(parent, hash);
+    list_node_foreach(node, bucket)
+    {
+        dentry_t *dentry = container_of(node, dentry_t, hash_node);
+        if (dentry->name_hash == hash && dentry_parent(dentry) == parent && strncmp(dentry->name, name, len) == 0 && dentry->name[len] == '\0')
+        {
+            if (dentry_is_cached_negative(dentry))
+            {
+                // keep the recently used ones
+                list_node_remove(&dentry->lru_node);
+                list_node_append(&dcache_negative_lru, &dentry->lru_node);
+            }
+            return dentry;
+        }
+    }
+
+    return NULL;
+}
+
+dentry_t *dcache_lookup(const dentry_t *parent, const char *name)
+{
+    const size_t len = strlen(name);
+    spinlock_acquire(&dcache_lock);
+    dentry_t *dentry = dcache_find_locked(parent, name, len, dcache_hash_name(name, len));
+    spinlock_release(&dcache_lock);
+    return dentry;
+}
+
+dentry_t *dcache_get(const dentry_t *parent, const char *name, size_t len, u32 hash)
+{
+    spinlock_acquire(&dcache_lock);
+    dentry_t *dentry = dcache_find_locked(parent, name, len, hash);
+    if (dentry && dentry->inode)
+        dentry_ref(dentry); // before the shrinker can see it unused
+    else if (dentry)
+        dentry->refcount++; // pinned, dentry_ref() only takes positive dentries
+    spinlock_release(&dcache_lock);
+    return dentry;
+}
+
+void dcache_pin(dentry_t *dentry)
+{
+    spinlock_acquire(&dcache_lock);
+    dentry->refcount++;
+    spinlock_release(&dcache_lock);
+}
+
+// an unused negative dentry, or an unused leaf that the filesystem can look up again
+static bool dcache_can_evict(const dentry_t *dentry)
+{
+    if (dentry->refcount != 0 || dentry->is_mountpoint || !list_is_empty(&tree_node(dentry)->children))
+        return false;
+
+    if (dentry->inode == NULL)
+        return true;
+
+    const inode_t *inode = dentry->inode;
+    if (!dentry->superblock->dentries_reclaimable || inode->refcount != 1)
+        return false; // the inode is also used elsewhere, or the dentry is the only copy of it
+
+    return !radix_tree_tagged(&inode->cache.pages, PAGECACHE_TAG_DIRTY) && !radix_tree_tagged(&inode->cache.pages, PAGECACHE_TAG_WRITEBACK);
+}
+
+// take an evictable dentry out of the cache and the tree, it is freed by dcache_free_evicted
+static void dcache_evict_locked(dentry_t *dentry, list_head *evicted)
+{
+    dcache_remove_locked(dentry);
+    list_node_remove(&tree_node(dentry)->list_node);
+    list_node_append(evicted, &dentry->lru_node);
+}
+
+static size_t dcache_free_evicted(list_head *evicted)
+{
+    size_t n = 0;
+    while (!list_is_empty(evicted))
+    {
+        dentry_t *dentry = container_of(list_node_pop(evicted), dentry_t, lru_node);
+        if (dentry->inode)
+            inode_unref(dentry->inode);
+        dentry->inode = NULL;
+        dentry_destroy(dentry);
+        n++;
+    }
+
+    dcache_stat.reclaimed += n;
+    return n;
+}
+
+static bool dcache_keep_negative_locked(dentry_t *dentry, list_head *evicted)
+{
+    if (!dentry->superblock || !dentry->superblock->negative_dentries || dcache_negative_max == 0)
+        return false;
+
+    if (list_is_empty(&dentry->hash_node))
+        return false; // not in the cache, no one would find it again
+
+    if (list_is_empty(&dentry->lru_node))
+    {
+        list_node_append(&dcache_negative_lru, &dentry->lru_node);
+        dcache_negative_count++;
+    }
+
+    // make room by dropping the least recently used ones
+    while (dcache_negative_count > dcache_negative_max)
+    {
+        dentry_t *victim = container_of(list_node_pop(&dcache_negative_lru), dentry_t, lru_node);
+        dcache_negative_count--;
+        if (victim->inode == NULL && dcache_can_evict(victim))
+            dcache_evict_locked(victim, evicted);
+        // otherwise it has been created or is in use, it comes back if it becomes negative again
+    }
+
+    return true;
+}
+
+bool dcache_keep_negative(dentry_t *dentry)
+{
+    list_head evicted = LIST_HEAD_INIT(evicted);
+    spinlock_acquire(&dcache_lock);
+    const bool kept = dcache_keep_negative_locked(dentry, &evicted);
+    spinlock_release(&dcache_lock);
+    dcache_free_evicted(&evicted);
+    return kept;
+}
+
+void dcache_put_negative(dentry_t *dentry)
+{
+    list_head evicted = LIST_HEAD_INIT(evicted);
+
+    spinlock_acquire(&dcache_lock);
+    MOS_ASSERT(dentry->refcount > 0);
+    dentry->refcount--;
+    if (dentry->refcount != 0 || dentry->inode != NULL || !list_is_empty(&tree_node(dentry)->children))
+    {
+        spinlock_release(&dcache_lock);
+        return; // still in use, or it has been created in the meantime
+    }
+
+    // decided under the lock, so that a concurrent lookup either finds and pins it, or doesn't find it at all
+    const bool kept = dcache_keep_negative_locked(dentry, &evicted);
+    if (!kept)
+    {
+        dcache_remove_locked(dentry);
+        list_node_remove(&tree_node(dentry)->list_node);
+    }
+    spinlock_release(&dcache_lock);
+
+    dcache_free_evicted(&evicted);
+    if (!kept)
+        dentry_destroy(dentry);
+}
+
+size_t dcache_shrink(size_t max)
+{
+    list_head evicted = LIST_HEAD_INIT(evicted);
+    size_t n = 0;
+
+    spinlock_acquire(&dcache_lock);
+
+    // negative dentries are the cheapest to recreate, drop them first
+    while (n < max && !list_is_empty(&dcache_negative_lru))
+    {
+        dentry_t *dentry = container_of(list_node_pop(&dcache_negative_lru), dentry_t, lru_node);
+        dcache_negative_count--;
+        if (dentry->inode == NULL && dcache_can_evict(dentry))
+            dcache_evict_locked(dentry, &evicted), n++;
+    }
+
+    // then unused leaves, a parent can only be dropped after its children in a later pass
+    for (size_t i = 0; i < DCACHE_HASH_BUCKETS && n < max; i++)
+    {
+        list_head *bucket = &dcache_buckets[dcache_shrink_hand];
+        dcache_shrink_hand = (dcache_shrink_hand + 1) % DCACHE_HASH_BUCKETS;
+        if (bucket->next == NULL)
+            continue;
+
+        list_node_foreach(node, bucket)
+        {
+            // a negative dentry that isn't in the LRU is still being looked up or filled in
+            dentry_t *dentry = container_of(node, dentry_t, hash_node);
+            if ((dentry->inode || dentry_is_cached_negative(dentry)) && dcache_can_evict(dentry))
+                dcache_evict_locked(dentry, &evicted), n++;
+            if (n >= max)
+                break;
+        }
+    }
+
+    spinlock_release(&dcache_lock);
+    return dcache_free_evicted(&evicted);
+}
+
+// ! sysfs support
+
+static bool dcache_sysfs_stat(sysfs_file_t *f)
+{
+    const size_t hits = dcache_stat.hits, negative_hits = dcache_stat.negative_hits, misses = dcache_stat.misses;
+    const size_t total = hits + negative_hits + misses;
+    sysfs_printf(f, "%-20s: %zu\n", "Hits", hits);
+    sysfs_printf(f, "%-20s: %zu\n", "NegativeHits", negative_hits);
+    sysfs_printf(f, "%-20s: %zu\n", "Misses", misses);
+    sysfs_printf(f, "%-20s: %zu%%\n", "HitRate", total ? (hits + negative_hits) * 100 / total : 0);
+    sysfs_printf(f, "%-20s: %zu / %zu\n", "Negative", dcache_negative_count, dcache_negative_max);
+    sysfs_printf(f, "%-20s: %zu\n", "Reclaimed", (size_t) dcache_stat.reclaimed);
+    return true;
+}
+
+static bool dcache_sysfs_negative_max_show(sysfs_file_t *f)
+{
+    sysfs_printf(f, "%zu\n", dcache_negative_max);
+    return true;
+}
+
+static bool dcache_sysfs_negative_max_store(sysfs_file_t *f, const char *buf, size_t count, off_t offset)
+{
+    MOS_UNUSED(f);
+    MOS_UNUSED(offset);
+    dcache_negative_max = strntoll(buf, NULL, 10, count); // 0 disables caching negative dentries
+    return true;
+}
+
+static bool dcache_sysfs_shrink(sysfs_file_t *f, const char *buf, size_t count, off_t offset)
+{
+    MOS_UNUSED(f);
+    MOS_UNUSED(buf);
+    MOS_UNUSED(count);
+    MOS_UNUSED(offset);
+    const size_t dropped = dcache_shrink((size_t) -1);
+    pr_info("dcache: dropped %zu dentries", dropped);
+    return true;
+}
+
+static sysfs_item_t dcache_sysfs_items[] = {
+    SYSFS_RO_ITEM("stat", dcache_sysfs_stat),
+    SYSFS_RW_ITEM("negative_max", dcache_sysfs_negative_max_show, dcache_sysfs_negative_max_store),
+    SYSFS_WO_ITEM("shrink", dcache_sysfs_shrink),
+};
+
+SYSFS_AUTOREGISTER(dcache, dcache_sysfs_items);
@@ -12,6 +12,7 @@
 #include "mos/tasks/process.h"
 #include "mos/tasks/task_types.h"
 
+#include <dirent.h>
 #include <mos/lib/structures/hashmap_common.h>
 #include <mos_stdio.h>
 #include <mos_stdlib.h>
@@ -27,9 +28,55 @@
 // A path may end with a slash, indicating that the caller expects
 // the path to be a directory
 
+/**
+ * @brief A segment of a path, pointing into the path string itself
+ */
+typedef struct
+{
+    const char *name; // not null-terminated
+    size_t len;       // 0 if there is no segment
+    u32 hash;         // see dcache_hash_name()
+} path_segment_t;
+
+/**
+ * @brief Find the next segment of a path, hashing it on the way
+ *
+ * @param cursor Where to start, advanced to the end of the segment
+ * @param seg Receives the segment
+ * @return true if there is a segment, false if only slashes are left
+ */
+static bool path_next_segment(const char **cursor, path_segment_t *seg)
+{
+    const char *p = *cursor;
+    while (*p == PATH_DELIM)
+        p++;
+
+    seg->name = p;
+    seg->hash = DCACHE_HASH_INIT;
+    for (; *p != '\0' && *p != PATH_DELIM; p++)
+        seg->hash = dcache_hash_step(seg->hash, *p);
+
+    seg->len = p - seg->name;
+    *cursor = p;
+    return seg->len != 0;
+}
+
+should_inline bool path_segment_is_dot(const path_segment_t *seg)
+{
+    return seg->len == 1 && seg->name[0] == '.';
+}
+
+should_inline bool path_segment_is_dotdot(const path_segment_t *seg)
+{
+    return seg->len == 2 && seg->name[0] == '.' && seg->name[1] == '.';
+}
+
+static dentry_t *dentry_get_child_segment(dentry_t *parent, const path_segment_t *seg);
+
 // The two functions below have circular dependencies, so we need to forward declare them
 // Both of them return a referenced dentry, no need to refcount them again
-static dentry_t *dentry_resolve_handle_last_segment(dentry_t *parent, char *leaf, lastseg_resolve_flags_t flags, bool *symlink_resolved);
+static dentry_t *dentry_resolve_handle_last_segment(dentry_t *parent, const path_segment_t *leaf, bool ends_with_slash, lastseg_resolve_flags_t flags,
+                                                    bool *symlink_resolved);
 static dentry_t *dentry_resolve_follow_symlink(dentry_t *dentry, lastseg_resolve_flags_t flags);
 
 /**
@@ -38,15 +85,16 @@ static dentry_t *dentry_resolve_follow_symlink(dentry_t *dentry, lastseg_resolve
  * @param base_dir A directory to start the lookup from
  * @param root_dir The root directory of the filesystem, the lookup will not go above this directory
  * @param original_path The path to lookup
- * @param last_seg_out The last segment of the path will be returned in this parameter, the caller is responsible for freeing it
+ * @param last_seg_out The last segment of the path, pointing into original_path, its length is 0 if the path has no segments
+ * @param ends_with_slash Set if the path ends with a slash, i.e. the caller expects a directory
  * @return dentry_t* The parent directory of the path, or NULL if the path is invalid, the dentry will be referenced
  */
-static dentry_t *dentry_lookup_parent(dentry_t *base_dir, dentry_t *root_dir, const char *original_path, char **last_seg_out)
+static dentry_t *dentry_lookup_parent(dentry_t *base_dir, dentry_t *root_dir, const char *original_path, path_segment_t *last_seg_out, bool *ends_with_slash)
 {
     pr_dinfo2(dcache, "lookup parent of '%s'", original_path);
-    MOS_ASSERT_X(base_dir && root_dir && original_path, "Invalid VFS lookup parameters");
-    if (last_seg_out != NULL)
-        *last_seg_out = NULL;
+    MOS_ASSERT_X(base_dir && root_dir && original_path && last_seg_out, "Invalid VFS lookup parameters");
+    last_seg_out->len = 0;
+    *ends_with_slash = false;
 
     dentry_t *parent_ref = statement_expr(dentry_t *, {
         dentry_t *__parent = path_is_absolute(original_path) ? root_dir : base_dir;
@@ -56,24 +104,19 @@ static dentry_t *dentry_lookup_parent(dentry_t *base_dir, dentry_t *root_dir, co
         retval = __parent;
     });
 
-    char *saveptr = NULL;
-    char *path = strdup(original_path);
-    const char *current_seg = strtok_r(path, PATH_DELIM_STR, &saveptr);
-    if (unlikely(current_seg == NULL))
+    const char *cursor = original_path;
+    path_segment_t current_seg, next_seg;
+    if (unlikely(!path_next_segment(&cursor, &current_seg)))
     {
         // this only happens if the path is empty, or contains only slashes
         // in which case we return the base directory
-        kfree(path);
-        if (last_seg_out != NULL)
-            *last_seg_out = NULL;
         return parent_ref;
     }
 
     while (true)
     {
-        pr_dinfo2(dcache, "lookup parent: current segment '%s'", current_seg);
-        const char *const next = strtok_r(NULL, PATH_DELIM_STR, &saveptr);
-        if (next == NULL)
+        pr_dinfo2(dcache, "lookup parent: current segment '%.*s'", (int) current_seg.len, current_seg.name);
+        if (!path_next_segment(&cursor, &next_seg))
         {
             if (parent_ref->inode->type == FILE_TYPE_SYMLINK)
             {
@@ -86,32 +129,23 @@ static dentry_t *dentry_lookup_parent(dentry_t *base_dir, dentry_t *root_dir, co
             }
 
             // "current_seg" is the last segment of the path
-            if (last_seg_out != NULL)
-            {
-                const bool ends_with_slash = original_path[strlen(original_path) - 1] == PATH_DELIM;
-                char *tmp = kmalloc(strlen(current_seg) + 2); // +2 for the null terminator and the slash
-                strcpy(tmp, current_seg);
-                if (ends_with_slash)
-                    strcat(tmp, PATH_DELIM_STR);
-                *last_seg_out = tmp;
-            }
-
-            kfree(path);
+            *last_seg_out = current_seg;
+            *ends_with_slash = cursor != original_path && cursor[-1] == PATH_DELIM;
             return parent_ref;
         }
 
-        if (strncmp(current_seg, ".", 2) == 0 || strcmp(current_seg, "./") == 0)
+        if (path_segment_is_dot(&current_seg))
         {
-            current_seg = next;
+            current_seg = next_seg;
             continue;
         }
 
-        if (strncmp(current_seg, "..", 3) == 0 || strcmp(current_seg, "../") == 0)
+        if (path_segment_is_dotdot(&current_seg))
         {
             if (parent_ref == root_dir)
             {
                 // we can't go above the root directory
-                current_seg = next;
+                current_seg = next_seg;
                 continue;
             }
 
@@ -127,16 +161,14 @@ static dentry_t *dentry_lookup_parent(dentry_t *base_dir, dentry_t *root_dir, co
             if (parent_ref->is_mountpoint)
                 parent_ref = dentry_root_get_mountpoint(parent);
 
-            current_seg = next;
+            current_seg = next_seg;
             continue;
         }
 
-        dentry_t *const child_ref = dentry_get_child(parent_ref, current_seg);
+        dentry_t *const child_ref = dentry_get_child_segment(parent_ref, &current_seg);
         if (child_ref->inode == NULL)
         {
-            *last_seg_out = NULL;
-            kfree(path);
-            dentry_try_release(child_ref);
+            dcache_put_negative(child_ref);
             dentry_unref(parent_ref);
             return ERR_PTR(-ENOENT);
         }
@@ -154,7 +186,7 @@ static dentry_t *dentry_lookup_parent(dentry_t *base_dir, dentry_t *root_dir, co
             parent_ref = child_ref;
         }
 
-        current_seg = next;
+        current_seg = next_seg;
     }
 
     MOS_UNREACHABLE();
@@ -168,7 +200,7 @@ static dentry_t *dentry_resolve_follow_symlink(dentry_t *symlink_dentry, lastseg
     if (!symlink_dentry->inode->ops || !symlink_dentry->inode->ops->readlink)
         mos_panic("inode does not support readlink (symlink) operation, but it's a symlink!");
 
-    char *const target = kmalloc(MOS_PATH_MAX_LENGTH);
+    char target[MOS_PATH_MAX_LENGTH];
     const size_t read = symlink_dentry->inode->ops->readlink(symlink_dentry, target, MOS_PATH_MAX_LENGTH);
     if (read == 0)
     {
@@ -186,16 +218,15 @@ static dentry_t *dentry_resolve_follow_symlink(dentry_t *symlink_dentry, lastseg
 
     pr_dinfo2(dcache, "symlink target: %s", target);
 
-    char *last_segment = NULL;
-    dentry_t *parent_ref = dentry_lookup_parent(dentry_parent(symlink_dentry), root_dentry, target, &last_segment);
-    kfree(target);
+    path_segment_t last_segment;
+    bool ends_with_slash;
+    dentry_t *parent_ref = dentry_lookup_parent(dentry_parent(symlink_dentry), root_dentry, target, &last_segment, &ends_with_slash);
     if (IS_ERR(parent_ref))
         return parent_ref; // the symlink target does not exist
 
     // it's possibly that the symlink target is also a symlink, this will be handled recursively
     bool symlink = false;
-    dentry_t *child_ref = dentry_resolve_handle_last_segment(parent_ref, last_segment, flags, &symlink);
-    kfree(last_segment);
+    dentry_t *child_ref = dentry_resolve_handle_last_segment(parent_ref, &last_segment, ends_with_slash, flags, &symlink);
 
     // if symlink is true, we need to unref the parent_ref dentry as it's irrelevant now
     if (IS_ERR(child_ref) || symlink)
@@ -204,15 +235,13 @@ static dentry_t *dentry_resolve_follow_symlink(dentry_t *symlink_dentry, lastseg
     return child_ref; // the real dentry, or an error code
 }
 
-static dentry_t *dentry_resolve_handle_last_segment(dentry_t *parent, char *leaf, lastseg_resolve_flags_t flags, bool *is_symlink)
+static dentry_t *dentry_resolve_handle_last_segment(dentry_t *parent, const path_segment_t *leaf, bool ends_with_slash, lastseg_resolve_flags_t flags,
+                                                    bool *is_symlink)
 {
-    MOS_ASSERT(parent != NULL && leaf != NULL);
+    MOS_ASSERT(parent != NULL && leaf != NULL && leaf->len != 0);
     *is_symlink = false;
 
-    pr_dinfo2(dcache, "resolving last segment: '%s'", leaf);
-    const bool ends_with_slash = leaf[strlen(leaf) - 1] == PATH_DELIM;
-    if (ends_with_slash)
-        leaf[strlen(leaf) - 1] = '\0'; // remove the trailing slash
+    pr_dinfo2(dcache, "resolving last segment: '%.*s'", (int) leaf->len, leaf->name);
 
     if (unlikely(ends_with_slash && !(flags & RESOLVE_EXPECT_DIR)))
     {
@@ -220,10 +249,10 @@ static dentry_t *dentry_resolve_handle_last_segment(dentry_t *parent, char *leaf
         return ERR_PTR(-EINVAL);
     }
 
-    if (strncmp(leaf, ".", 2) == 0 || strcmp(leaf, "./") == 0)
+    if (path_segment_is_dot(leaf))
         return parent;
 
-    if (strncmp(leaf, "..", 3) == 0 || strcmp(leaf, "../") == 0)
+    if (path_segment_is_dotdot(leaf))
     {
         if (parent == root_dentry)
             return parent;
@@ -236,23 +265,19 @@ static dentry_t *dentry_resolve_handle_last_segment(dentry_t *parent, char *leaf
         return parent_parent;
     }
 
-    dentry_t *child_ref = dentry_get_child(parent, leaf); // now we have a reference to the child
+    dentry_t *child_ref = dentry_get_child_segment(parent, leaf); // now we have a reference to the child
 
     if (unlikely(child_ref->inode == NULL))
     {
         if (flags & RESOLVE_EXPECT_NONEXIST)
-        {
-            // do not use dentry_ref, because it checks for an inode
-            child_ref->refcount++;
-            return child_ref;
-        }
+            return child_ref; // the lookup's reference becomes the caller's
 
         pr_dinfo2(dcache, "file does not exist");
-        dentry_try_release(child_ref); // child has no ref, we should release it directly
+        dcache_put_negative(child_ref);
         return ERR_PTR(-ENOENT);
     }
 
-    MOS_ASSERT(child_ref->refcount > 0); // dentry_get_child may return a negative dentry, which is handled above, otherwise we should have a reference on it
+    MOS_ASSERT(child_ref->refcount > 0);
 
     if (flags & RESOLVE_EXPECT_NONEXIST && !(flags & RESOLVE_EXPECT_EXIST))
     {
@@ -269,7 +294,7 @@ static dentry_t *dentry_resolve_handle_last_segment(dentry_t *parent, char *leaf
             return child_ref;
         }
 
-        pr_dinfo2(dcache, "resolving symlink: %s", leaf);
+        pr_dinfo2(dcache, "resolving symlink: %.*s", (int) leaf->len, leaf->name);
         dentry_t *const symlink_target_ref = dentry_resolve_follow_symlink(child_ref, flags);
         // we don't need the symlink node anymore
         MOS_ASSERT(dentry_unref_one_norelease(child_ref));
@@ -332,39 +357,40 @@ dentry_t *dentry_from_fd(fd_t fd)
     return file->dentry;
 }
 
-dentry_t *dentry_get_child(dentry_t *parent, const char *name)
+static dentry_t *dentry_get_child_segment(dentry_t *parent, const path_segment_t *seg)
 {
     if (unlikely(parent == NULL))
         return NULL;
 
-    pr_dinfo2(dcache, "looking for dentry '%s' in '%s'", name, dentry_name(parent));
+    pr_dinfo2(dcache, "looking for dentry '%.*s' in '%s'", (int) seg->len, seg->name, dentry_name(parent));
 
-    dentry_t *dentry = NULL;
+    // firstly check if it's in the cache, a negative dentry is pinned as well
+    dentry_t *dentry = dcache_get(parent, seg->name, seg->len, seg->hash);
+    if (dentry && dentry->inode)
+    {
+        pr_dinfo2(dcache, "found dentry '%s' in cache", dentry->name);
+        dcache_stat.hits++;
+        return dentry; // referenced by dcache_get
+    }
 
-    // firstly check if it's in the cache
-    tree_foreach_child(dentry_t, c, parent)
+    if (dentry && dentry_is_cached_negative(dentry))
     {
-        if (strcmp(c->name, name) == 0)
-        {
-            if (c->inode != NULL)
-            {
-                pr_dinfo2(dcache, "found dentry '%s' in cache", name);
-                return dentry_ref(c);
-            }
-            else
-            {
-                pr_dinfo2(dcache, "found dentry '%s' in cache, but it's not backed by an inode, try looking up", name);
-                dentry = c;
-                break;
-            }
-        }
+        pr_dinfo2(dcache, "found negative dentry '%s' in cache", dentry->name);
+        dcache_stat.negative_hits++;
+        return dentry;
     }
 
+    dcache_stat.misses++;
     if (dentry == NULL)
-        dentry = dentry_create(parent->superblock, parent, name);
-
-    if (dentry->inode)
-        return dentry_ref(dentry);
+    {
+        // the shrinker skips negative dentries outside the LRU, the pin keeps it once the lookup fills it in
+        dentry = dentry_create_n(parent->superblock, parent, seg->name, seg->len);
+        dcache_pin(dentry);
+    }
+    else
+    {
+        pr_dinfo2(dcache, "found dentry '%s' in cache, but it's not backed by an inode, try looking up", dentry->name);
+    }
 
     // not in the cache, try to find it in the filesystem
     if (parent->inode == NULL || parent->inode->ops == NULL || parent->inode->ops->lookup == NULL)
@@ -374,15 +400,18 @@ dentry_t *dentry_get_child(dentry_t *parent, const char *name)
     }
 
     if (parent->inode->ops->lookup(parent->inode, dentry))
-    {
-        pr_dinfo2(dcache, "dentry '%s' found in the filesystem", name);
-        return dentry_ref(dentry);
-    }
+        pr_dinfo2(dcache, "dentry '%s' found in the filesystem", dentry->name);
     else
-    {
-        pr_dinfo2(dcache, "dentry '%s' not found in the filesystem", name);
-        return dentry; // do not reference a negative dentry
-    }
+        pr_dinfo2(dcache, "dentry '%s' not found in the filesystem", dentry->name);
+
+    return dentry; // the pin is the reference, whether the lookup succeeded or not
+}
+
+dentry_t *dentry_get_child(dentry_t *parent, const char *name)
+{
+    const size_t len = strlen(name);
+    const path_segment_t seg = { .name = name, .len = len, .hash = dcache_hash_name(name, len) };
+    return dentry_get_child_segment(parent, &seg);
 }
 
 dentry_t *dentry_get(dentry_t *starting_dir, dentry_t *root_dir, const char *path, lastseg_resolve_flags_t flags)
@@ -390,16 +419,17 @@ dentry_t *dentry_get(dentry_t *starting_dir, dentry_t *root_dir, const char *pat
     if (!root_dir)
         return ERR_PTR(-ENOENT); // no root directory
 
-    char *last_segment;
+    path_segment_t last_segment;
+    bool ends_with_slash;
     pr_dinfo2(dcache, "resolving path '%s'", path);
-    dentry_t *const parent_ref = dentry_lookup_parent(starting_dir, root_dir, path, &last_segment);
+    dentry_t *const parent_ref = dentry_lookup_parent(starting_dir, root_dir, path, &last_segment, &ends_with_slash);
     if (IS_ERR(parent_ref))
     {
         pr_dinfo2(dcache, "failed to resolve parent of '%s', file not found", path);
         return parent_ref;
     }
 
-    if (last_segment == NULL)
+    if (last_segment.len == 0)
     {
         // path is a single "/"
         pr_dinfo2(dcache, "path '%s' is a single '/' or is empty", path);
@@ -414,29 +444,92 @@ dentry_t *dentry_get(dentry_t *starting_dir, dentry_t *root_dir, const char *pat
     }
 
     bool symlink = false;
-    dentry_t *child_ref = dentry_resolve_handle_last_segment(parent_ref, last_segment, flags, &symlink);
-    kfree(last_segment);
+    dentry_t *child_ref = dentry_resolve_handle_last_segment(parent_ref, &last_segment, ends_with_slash, flags, &symlink);
     if (IS_ERR(child_ref) || symlink)
         dentry_unref(parent_ref); // the lookup failed, or child_ref is irrelevant with the parent_ref
 
     return child_ref;
 }
 
+#define LISTDIR_ARENA_INITIAL_SIZE 4 KB
+
+should_inline size_t listdir_dirent_size(size_t name_len)
+{
+    return sizeof(ino_t) + sizeof(off_t) + sizeof(short) + sizeof(char) + name_len + 1; // +1 for the null terminator
+}
+
+static void listdir_put_dirent(char *buf, u64 ino, const char *name, size_t name_len, file_type_t type, off_t next)
+{
+    struct dirent *dirent = (struct dirent *) buf;
+    dirent->d_ino = ino;
+    dirent->d_type = type;
+    dirent->d_reclen = listdir_dirent_size(name_len);
+    dirent->d_off = next;
+    memcpy(dirent->d_name, name, name_len);
+    dirent->d_name[name_len] = '\0';
+}
+
+// write an entry to the caller's buffer, used by filesystems that can continue from a position
+static bool dentry_emit_dir(vfs_listdir_state_t *state, u64 ino, const char *name, size_t name_len, file_type_t type, off_t next)
+{
+    const size_t entry_size = listdir_dirent_size(name_len);
+    if (state->buf_used + entry_size > state->buf_size)
+    {
+        state->buf_full = true;
+        return false;
+    }
+
+    listdir_put_dirent(state->buf + state->buf_used, ino, name, name_len, type, next);
+    state->buf_used += entry_size;
+    state->pos = next;
+    return true;
+}
+
+// append an entry to the arena, used by filesystems that list everything at once
 static void dentry_add_dir(vfs_listdir_state_t *state, u64 ino, const char *name, size_t name_len, file_type_t type)
 {
-    vfs_listdir_entry_t *entry = kmalloc(sizeof(vfs_listdir_entry_t));
-    linked_list_init(list_node(entry));
-    entry->ino = ino;
-    entry->name = strndup(name, name_len);
-    entry->name_len = name_len;
-    entry->type = type;
-    list_node_append(&state->entries, list_node(entry));
-    state->n_count++;
+    const size_t entry_size = listdir_dirent_size(name_len);
+    if (state->arena_used + entry_size > state->arena_size)
+    {
+        size_t new_size = state->arena_size ? state->arena_size : LISTDIR_ARENA_INITIAL_SIZE;
+        while (new_size < state->arena_used + entry_size)
+            new_size *= 2;
+
+        char *arena = krealloc(state->arena, new_size);
+        if (unlikely(!arena))
+        {
+            pr_warn("listdir: out of memory, entry '%.*s' skipped", (int) name_len, name);
+            return;
+        }
+
+        state->arena = arena;
+        state->arena_size = new_size;
+    }
+
+    listdir_put_dirent(state->arena + state->arena_used, ino, name, name_len, type, state->arena_used + entry_size);
+    state->arena_used += entry_size;
+}
+
+static void vfs_listdir_populate_arena(dentry_t *dir, vfs_listdir_state_t *state, dentry_t *d_parent)
+{
+    // the dots may have already been listed before the filesystem turned out not to support readdir
+    if (state->n_dots == 0)
+        dentry_add_dir(state, dir->inode->ino, ".", 1, FILE_TYPE_DIRECTORY);
+    if (state->n_dots <= 1)
+        dentry_add_dir(state, d_parent->inode->ino, "..", 2, FILE_TYPE_DIRECTORY);
+    state->n_dots = 2;
+
+    if (dir->inode->ops && dir->inode->ops->iterate_dir)
+        dir->inode->ops->iterate_dir(dir, state, dentry_add_dir);
+    else
+        vfs_generic_iterate_dir(dir, state, dentry_add_dir);
+
+    state->buffered = true;
 }
 
-void vfs_populate_listdir_buf(dentry_t *dir, vfs_listdir_state_t *state)
+size_t vfs_listdir_read(dentry_t *dir, vfs_listdir_state_t *state, void *buf, size_t size)
 {
-    inode_t *d_inode = dir->inode;
+    MOS_ASSERT(dir->inode);
 
     dentry_t *d_parent = dentry_parent(dir);
     if (d_parent == NULL)
@@ -444,14 +537,66 @@ void vfs_populate_listdir_buf(dentry_t *dir, vfs_listdir_state_t *state)
 
     MOS_ASSERT(d_parent->inode != NULL);
 
-    dentry_add_dir(state, d_inode->ino, ".", 1, FILE_TYPE_DIRECTORY);
-    dentry_add_dir(state, d_parent->inode->ino, "..", 2, FILE_TYPE_DIRECTORY);
+    state->buf = buf;
+    state->buf_size = size;
+    state->buf_used = 0;
+    state->buf_full = false;
 
-    MOS_ASSERT(dir->inode);
+    const inode_ops_t *ops = dir->inode->ops;
+    if (!state->buffered && !state->eof && ops && ops->readdir)
+    {
+        if (state->n_dots == 0)
+        {
+            if (!dentry_emit_dir(state, dir->inode->ino, ".", 1, FILE_TYPE_DIRECTORY, 0))
+                return state->buf_used;
+            state->n_dots = 1;
+        }
 
-    // this call may not write all the entries, because the buffer may not be big enough
-    if (dir->inode->ops && dir->inode->ops->iterate_dir)
-        dir->inode->ops->iterate_dir(dir, state, dentry_add_dir);
-    else
-        vfs_generic_iterate_dir(dir, state, dentry_add_dir);
+        if (state->n_dots == 1)
+        {
+            if (!dentry_emit_dir(state, d_parent->inode->ino, "..", 2, FILE_TYPE_DIRECTORY, 0))
+                return state->buf_used;
+            state->n_dots = 2;
+        }
+
+        const off_t start = state->pos;
+        if (ops->readdir(dir, state, dentry_emit_dir))
+        {
+            state->eof = !state->buf_full;
+            return state->buf_used;
+        }
+
+        if (start != 0 || state->pos != 0)
+        {
+            pr_warn("listdir: failed to continue listing '%s'", dentry_name(dir));
+            state->eof = true;
+            return state->buf_used;
+        }
+
+        // the filesystem can't list this directory incrementally, buffer it instead
+    }
+
+    if (!state->buffered && !state->eof)
+        vfs_listdir_populate_arena(dir, state, d_parent);
+
+    // copy as many whole records as fit
+    while (state->read_offset < state->arena_used)
+    {
+        const struct dirent *dirent = (const struct dirent *) (state->arena + state->read_offset);
+        if (state->buf_used + dirent->d_reclen > state->buf_size)
+            break;
+
+        memcpy(state->buf + state->buf_used, dirent, dirent->d_reclen);
+        state->buf_used += dirent->d_reclen;
+        state->read_offset += dirent->d_reclen;
+    }
+
+    return state->buf_used;
+}
+
+void vfs_listdir_release(vfs_listdir_state_t *state)
+{
+    if (state->arena)
+        kfree(state->arena);
+    kfree(state);
 }
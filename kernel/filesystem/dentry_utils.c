@@ -4,6 +4,7 @@
 #include "mos/filesystem/mount.h"
 #include "mos/filesystem/vfs.h"
 #include "mos/filesystem/vfs_types.h"
+#include "mos/filesystem/vfs_utils.h"
 #include "mos/printk.h"
 
 #include <mos_stdio.h>
@@ -109,6 +110,7 @@ void dentry_check_refstat(const dentry_t *dentry)
         expected_refcount++; // the root dentry should only has one reference
     }
 
+    dcache_tree_lock();
     tree_foreach_child(dentry_t, child, dentry)
     {
         expected_refcount += child->refcount;
@@ -123,7 +125,9 @@ void dentry_check_refstat(const dentry_t *dentry)
         }
         mos_panic("don't know how to handle this");
     }
-    else if (dentry->refcount - expected_refcount)
+    dcache_tree_unlock();
+
+    if (dentry->refcount > expected_refcount)
     {
         pr_dinfo2(dcache_ref, "  dentry %p '%s' has %zu direct references", (void *) dentry, dentry_name(dentry), dentry->refcount - expected_refcount);
     }
@@ -134,13 +138,14 @@ void dentry_try_release(dentry_t *dentry)
     MOS_ASSERT(dentry->refcount == 0);
 
     const bool can_release = dentry->inode == NULL && list_is_empty(&tree_node(dentry)->children);
-    if (can_release)
-    {
-        list_remove(&dentry->tree_node);
-        if (dentry->name)
-            kfree(dentry->name);
-        kfree(dentry);
-    }
+    if (!can_release)
+        return;
+
+    // a failed lookup is remembered, so that the filesystem is not asked again
+    if (dcache_keep_negative(dentry))
+        return;
+
+    dentry_destroy(dentry);
 }
 
 void dentry_unref(dentry_t *dentry)
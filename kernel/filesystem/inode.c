@@ -2,27 +2,16 @@
 
 #include "mos/filesystem/inode.h"
 
+#include "mos/filesystem/page_cache.h"
 #include "mos/filesystem/vfs_types.h"
 #include "mos/mm/slab_autoinit.h"
 #include "mos/printk.h"
 
-#include <mos/lib/structures/hashmap_common.h>
 #include <mos_stdlib.h>
 
 slab_t *inode_cache;
 SLAB_AUTOINIT("inode", inode_cache, inode_t);
 
-static bool do_flush_and_drop_cache_page(const uintn key, void *value, void *data)
-{
-    MOS_UNUSED(key);
-    MOS_UNUSED(value);
-    MOS_UNUSED(data);
-    return true;
-    // phyframe_t *page = value;
-    // mmstat_dec1(MEM_PAGECACHE);
-    // pmm_free(page);
-}
-
 static bool vfs_generic_inode_drop(inode_t *inode)
 {
     MOS_UNUSED(inode);
@@ -41,7 +30,9 @@ void inode_init(inode_t *inode, superblock_t *sb, u64 ino, file_type_t type)
     inode->private = NULL;
     inode->refcount = 1;
 
-    hashmap_init(&inode->cache.pages, MOS_INODE_CACHE_HASHMAP_SIZE, hashmap_identity_hash, hashmap_simple_key_compare);
+    radix_tree_init(&inode->cache.pages);
+    linked_list_init(&inode->cache.dirty_node);
+    waitlist_init(&inode->cache.writeback_waiters);
     inode->cache.owner = inode;
 }
 
@@ -70,7 +61,7 @@ void inode_unref(inode_t *inode)
     {
         // drop the inode
         inode_cache_t *icache = &inode->cache;
-        hashmap_foreach(&icache->pages, do_flush_and_drop_cache_page, NULL);
+        pagecache_drop_all(icache);
 
         bool dropped = false;
         if (inode->superblock->ops && inode->superblock->ops->drop_inode)
@@ -36,17 +36,19 @@ dentry_t *dentry_root_get_mountpoint(dentry_t *dentry)
     dentry_t *parent = dentry_parent(dentry);
     MOS_ASSERT(parent);
 
+    dentry_t *mountpoint = NULL;
+    dcache_tree_lock();
     tree_foreach_child(dentry_t, child, parent)
     {
-        if (child->is_mountpoint)
+        if (child->is_mountpoint && dentry_get_mount(child)->root == dentry)
         {
-            mount_t *mount = dentry_get_mount(child);
-            if (mount->root == dentry)
-                return child;
+            mountpoint = child;
+            break;
         }
     }
+    dcache_tree_unlock();
 
-    return NULL; // not found, possibly just have been unmounted
+    return mountpoint; // NULL if not found, possibly just have been unmounted
 }
 
 mount_t *dentry_get_mount(const dentry_t *dentry)
@@ -2,36 +2,723 @@
 
 #include "mos/filesystem/page_cache.h"
 
+#include "mos/device/clocksource.h"
+#include "mos/filesystem/dentry.h"
+#include "mos/filesystem/inode.h"
 #include "mos/mm/mm.h"
 #include "mos/mm/mmstat.h"
 #include "mos/mm/physical/pmm.h"
+#include "mos/mm/slab_autoinit.h"
 #include "mos/printk.h"
+#include "mos/tasks/kthread.h"
+#include "mos/tasks/schedule.h"
+#include "mos/tasks/wait.h"
 
 #include <mos_stdlib.h>
 #include <mos_string.h>
 
-phyframe_t *pagecache_get_page_for_read(inode_cache_t *cache, off_t pgoff)
+/**
+ * @brief A page in the page cache, it holds one reference to the page.
+ *
+ * @details All entries are linked into a single CLOCK list, the head of the list being the
+ * clock hand. An entry that has been looked up since the hand last passed gets a second chance,
+ * dirty pages and pages that are referenced elsewhere (mapped, or being copied) are never evicted.
+ *
+ * Entries are indexed by their page offset in the inode's radix tree, where the dirty and writeback
+ * state is kept as tags, so that such pages can be found in file order.
+ */
+typedef struct
+{
+    as_linked_list;       ///< node in pagecache_clock
+    inode_cache_t *cache; ///< the cache this page belongs to
+    off_t pgoff;          ///< the page offset in the file
+    phyframe_t *page;     ///< the cached page
+    bool referenced;      ///< looked up since the clock hand last passed
+} pagecache_entry_t;
+
+typedef struct
+{
+    as_linked_list;
+    inode_t *inode;
+    off_t pgoff;
+    size_t npages;
+} pagecache_readahead_t;
+
+pagecache_stat_t pagecache_stat = { 0 };
+
+static slab_t *pagecache_entry_slab = NULL;
+SLAB_AUTOINIT("pagecache_entry", pagecache_entry_slab, pagecache_entry_t);
+
+static slab_t *readahead_slab = NULL;
+SLAB_AUTOINIT("pagecache_readahead", readahead_slab, pagecache_readahead_t);
+
+static list_head readahead_queue = LIST_HEAD_INIT(readahead_queue); // pagecache_readahead_t
+static spinlock_t readahead_lock = SPINLOCK_INIT;                   // protects readahead_queue
+static waitlist_t readahead_waitlist;
+static thread_t *readahead_thread = NULL;
+
+// lock order: pagecache_clock_lock -> inode_cache_t::lock
+static list_head pagecache_clock = LIST_HEAD_INIT(pagecache_clock); // pagecache_entry_t, the head is the clock hand
+static spinlock_t pagecache_clock_lock = SPINLOCK_INIT;             // protects pagecache_clock
+static size_t pagecache_nentries = 0;                               // number of entries in pagecache_clock
+static size_t pagecache_ninserted = 0;                              // number of entries ever inserted
+
+#define PAGECACHE_FILL_BATCH      32
+#define PAGECACHE_WRITEBACK_BATCH 16
+
+#define PAGECACHE_RECLAIM_BATCH 64
+
+static phyframe_t *pagecache_entry_get(pagecache_entry_t *entry)
 {
-    void *p = hashmap_get(&cache->pages, pgoff);
-    if (p)
-        return p;
+    entry->referenced = true;
+    return pmm_ref_one(entry->page); // the caller's reference, it keeps the page from being reclaimed
+}
+
+static phyframe_t *pagecache_lookup_locked(inode_cache_t *cache, off_t pgoff)
+{
+    pagecache_entry_t *entry = radix_tree_lookup(&cache->pages, pgoff);
+    return entry ? pagecache_entry_get(entry) : NULL;
+}
+
+// the caller must hold pagecache_clock_lock and the cache's lock, and the entry must be removed from the index
+static void pagecache_entry_destroy(pagecache_entry_t *entry)
+{
+    list_remove(entry);
+    pagecache_nentries--;
+    pmm_unref_one(entry->page);
+    mmstat_dec1(MEM_PAGECACHE);
+    kfree(entry);
+}
+
+phyframe_t *pagecache_get_page_cached(inode_cache_t *cache, off_t pgoff)
+{
+    spinlock_acquire(&cache->lock);
+    phyframe_t *page = pagecache_lookup_locked(cache, pgoff);
+    spinlock_release(&cache->lock);
+    return page;
+}
+
+// insert a freshly filled page, whose only reference is taken over by the cache
+static phyframe_t *pagecache_insert(inode_cache_t *cache, off_t pgoff, phyframe_t *page)
+{
+    pagecache_entry_t *entry = kmalloc(pagecache_entry_slab);
+    linked_list_init(list_node(entry));
+    entry->cache = cache;
+    entry->pgoff = pgoff;
+    entry->page = page;
+    entry->referenced = true;
+
+    // the cache is filled without holding the lock, someone else (e.g. readahead) may have won the race
+    spinlock_acquire(&pagecache_clock_lock);
+    spinlock_acquire(&cache->lock);
+    phyframe_t *existing = pagecache_lookup_locked(cache, pgoff);
+    if (existing)
+    {
+        spinlock_release(&cache->lock);
+        spinlock_release(&pagecache_clock_lock);
+        pmm_unref_one(page);
+        kfree(entry);
+        return existing;
+    }
+
+    if (!radix_tree_insert(&cache->pages, pgoff, entry))
+    {
+        spinlock_release(&cache->lock);
+        spinlock_release(&pagecache_clock_lock);
+        pmm_unref_one(page);
+        kfree(entry);
+        return ERR_PTR(-ENOMEM);
+    }
 
+    mmstat_inc1(MEM_PAGECACHE);
+    list_node_append(&pagecache_clock, list_node(entry));
+    pagecache_nentries++;
+    pagecache_ninserted++;
+    pmm_ref_one(page); // the caller's reference
+    spinlock_release(&cache->lock);
+    spinlock_release(&pagecache_clock_lock);
+    return page;
+}
+
+static phyframe_t *pagecache_fill_one(inode_cache_t *cache, off_t pgoff)
+{
     MOS_ASSERT_X(cache->ops && cache->ops->fill_cache, "no page cache ops for inode %p", (void *) cache->owner);
     phyframe_t *page = cache->ops->fill_cache(cache, pgoff);
     if (IS_ERR(page))
         return page;
-    mmstat_inc1(MEM_PAGECACHE);
-    MOS_ASSERT(hashmap_put(&cache->pages, pgoff, page) == NULL);
-    return page;
+    if (!page)
+        return ERR_PTR(-ENOMEM);
+
+    return pagecache_insert(cache, pgoff, page);
+}
+
+// the first cached page at or after pgoff, or (u64) -1 if there is none
+static u64 pagecache_next_cached(inode_cache_t *cache, off_t pgoff)
+{
+    void *entry;
+    u64 index;
+    spinlock_acquire(&cache->lock);
+    const size_t n = radix_tree_gang_lookup(&cache->pages, &entry, &index, pgoff, 1);
+    spinlock_release(&cache->lock);
+    return n ? index : (u64) -1;
+}
+
+// read the missing pages of a range into the cache, in batches if the filesystem supports it
+static size_t pagecache_fill_range(inode_cache_t *cache, off_t pgoff, size_t npages)
+{
+    const u64 end = pgoff + npages;
+    size_t filled = 0;
+    while ((u64) pgoff < end)
+    {
+        const u64 hole_end = MIN(pagecache_next_cached(cache, pgoff), end);
+        if ((u64) pgoff == hole_end)
+        {
+            pgoff++;
+            continue;
+        }
+
+        if (cache->ops->fill_cache_pages)
+        {
+            phyframe_t *pages[PAGECACHE_FILL_BATCH];
+            const size_t n = cache->ops->fill_cache_pages(cache, pgoff, MIN(hole_end - pgoff, (u64) PAGECACHE_FILL_BATCH), pages);
+            if (n == 0)
+                break;
+
+            for (size_t i = 0; i < n; i++)
+            {
+                phyframe_t *page = pagecache_insert(cache, pgoff + i, pages[i]);
+                if (!IS_ERR(page))
+                    pagecache_put_page(page);
+            }
+            pgoff += n;
+            filled += n;
+            continue;
+        }
+
+        for (; (u64) pgoff < hole_end; pgoff++, filled++)
+        {
+            phyframe_t *page = pagecache_fill_one(cache, pgoff);
+            if (IS_ERR(page))
+                return filled;
+            pagecache_put_page(page);
+        }
+    }
+
+    return filled;
+}
+
+phyframe_t *pagecache_get_page_for_read(inode_cache_t *cache, off_t pgoff)
+{
+    phyframe_t *page = pagecache_get_page_cached(cache, pgoff);
+    if (page)
+    {
+        pagecache_stat.hits++;
+        return page;
+    }
+
+    pagecache_stat.misses++;
+    return pagecache_fill_one(cache, pgoff);
+}
+
+size_t pagecache_get_pages_cached(inode_cache_t *cache, off_t pgoff, size_t npages, phyframe_t **pages, off_t *pgoffs)
+{
+    const u64 end = pgoff + npages;
+    u64 next = pgoff;
+    size_t nfound = 0;
+
+    spinlock_acquire(&cache->lock);
+    while (nfound < npages && next < end)
+    {
+        pagecache_entry_t *entries[16];
+        u64 indices[16];
+        const size_t n = radix_tree_gang_lookup(&cache->pages, (void **) entries, indices, next, MIN(MOS_ARRAY_SIZE(entries), npages - nfound));
+        if (n == 0)
+            break;
+
+        for (size_t i = 0; i < n && indices[i] < end; i++)
+        {
+            pages[nfound] = pagecache_entry_get(entries[i]);
+            pgoffs[nfound++] = indices[i];
+        }
+        next = indices[n - 1] + 1;
+    }
+    spinlock_release(&cache->lock);
+    return nfound;
+}
+
+void pagecache_put_page(phyframe_t *page)
+{
+    pmm_unref_one(page);
+}
+
+static bool pagecache_can_writeback(const inode_cache_t *cache)
+{
+    return cache->ops && (cache->ops->flush_page || cache->ops->flush_pages);
+}
+
+static bool pagecache_writeback_pending(wait_condition_t *condition)
+{
+    superblock_t *sb = condition->arg;
+    return !list_is_empty(&sb->dirty_inodes) || __atomic_load_n(&sb->writeback_stop, __ATOMIC_ACQUIRE);
+}
+
+static bool pagecache_writeback_exited(wait_condition_t *condition)
+{
+    superblock_t *sb = condition->arg;
+    return __atomic_load_n(&sb->writeback_exited, __ATOMIC_ACQUIRE);
+}
+
+static void pagecache_writeback_superblock(superblock_t *sb)
+{
+    // take the inodes queued so far, those that are dirtied again meanwhile are left for the next round
+    list_head inodes = LIST_HEAD_INIT(inodes);
+    spinlock_acquire(&sb->writeback_lock);
+    while (!list_is_empty(&sb->dirty_inodes))
+        list_node_append(&inodes, list_node_pop(&sb->dirty_inodes));
+    spinlock_release(&sb->writeback_lock);
+
+    while (!list_is_empty(&inodes))
+    {
+        inode_cache_t *cache = container_of(list_node_pop(&inodes), inode_cache_t, dirty_node);
+        const long ret = pagecache_flush(cache, false);
+        if (ret)
+            pr_dwarn(vfs, "writeback of inode %llu failed: %ld", cache->owner->ino, ret);
+        inode_unref(cache->owner); // the reference taken when it was queued
+    }
+}
+
+static void pagecache_writeback_worker(void *arg)
+{
+    superblock_t *sb = arg;
+    while (true)
+    {
+        reschedule_for_wait_condition(wc_wait_for(sb, pagecache_writeback_pending, NULL));
+        if (current_thread->waiting)
+        {
+            wc_condition_cleanup(current_thread->waiting);
+            current_thread->waiting = NULL;
+        }
+
+        const bool stop = __atomic_load_n(&sb->writeback_stop, __ATOMIC_ACQUIRE);
+        if (!stop)
+            clocksource_msleep(MOS_VFS_WRITEBACK_DELAY_MS); // let more writes to the same pages accumulate
+        pagecache_writeback_superblock(sb);
+        if (stop)
+            break;
+    }
+
+    // the superblock may be freed from now on
+    __atomic_store_n(&sb->writeback_exited, true, __ATOMIC_RELEASE);
+}
+
+void pagecache_writeback_stop(superblock_t *sb)
+{
+    spinlock_acquire(&sb->writeback_lock);
+    const bool started = sb->dirty_inodes.next != NULL; // the thread is started along with the list
+    __atomic_store_n(&sb->writeback_stop, true, __ATOMIC_RELEASE);
+    spinlock_release(&sb->writeback_lock);
+
+    if (!started)
+        return;
+
+    reschedule_for_wait_condition(wc_wait_for(sb, pagecache_writeback_exited, NULL));
+    if (current_thread->waiting)
+    {
+        wc_condition_cleanup(current_thread->waiting);
+        current_thread->waiting = NULL;
+    }
+}
+
+static bool pagecache_writeback_queue(inode_cache_t *cache)
+{
+    superblock_t *sb = cache->owner->superblock;
+    bool start_thread = false;
+
+    spinlock_acquire(&sb->writeback_lock);
+    if (sb->writeback_stop)
+    {
+        // the superblock is being unmounted, its writeback thread is gone or about to exit
+        spinlock_release(&sb->writeback_lock);
+        return false;
+    }
+
+    if (!sb->dirty_inodes.next)
+    {
+        // the first dirty page of this superblock
+        linked_list_init(&sb->dirty_inodes);
+        start_thread = true;
+    }
+
+    if (list_is_empty(&cache->dirty_node))
+    {
+        inode_ref(cache->owner);
+        list_node_append(&sb->dirty_inodes, &cache->dirty_node);
+    }
+    spinlock_release(&sb->writeback_lock);
+
+    if (start_thread)
+        sb->writeback_thread = kthread_create(pagecache_writeback_worker, sb, "writeback");
+    return true;
 }
 
+static bool pagecache_tag_dirty(inode_cache_t *cache, off_t pgoff)
+{
+    spinlock_acquire(&cache->lock);
+    if (!radix_tree_lookup(&cache->pages, pgoff) || radix_tree_tag_get(&cache->pages, pgoff, PAGECACHE_TAG_DIRTY))
+    {
+        spinlock_release(&cache->lock);
+        return false;
+    }
+    radix_tree_tag_set(&cache->pages, pgoff, PAGECACHE_TAG_DIRTY);
+    spinlock_release(&cache->lock);
+
+    if (!pagecache_can_writeback(cache))
+        return false; // there is no backing storage, the page just stays in memory
+
+    pagecache_stat.dirty++;
+    return true;
+}
+
+void pagecache_mark_dirty(inode_cache_t *cache, off_t pgoff)
+{
+    if (!pagecache_tag_dirty(cache, pgoff))
+        return;
+
+    if (!pagecache_writeback_queue(cache))
+        pagecache_flush(cache, false); // nobody else will write it back
+}
+
+long pagecache_flush(inode_cache_t *cache, bool wait)
+{
+    if (!pagecache_can_writeback(cache))
+        return 0;
+
+    long ret = 0;
+    u64 next = 0;
+    while (true)
+    {
+        // the pages are written back in offset order, a batch at a time
+        pagecache_entry_t *entries[PAGECACHE_WRITEBACK_BATCH];
+        phyframe_t *pages[PAGECACHE_WRITEBACK_BATCH];
+        u64 indices[PAGECACHE_WRITEBACK_BATCH];
+
+        spinlock_acquire(&cache->lock);
+        const size_t n = radix_tree_gang_lookup_tag(&cache->pages, (void **) entries, indices, next, PAGECACHE_WRITEBACK_BATCH, PAGECACHE_TAG_DIRTY);
+        for (size_t i = 0; i < n; i++)
+        {
+            // a write from now on dirties the page again, and it will be written back once more
+            radix_tree_tag_clear(&cache->pages, indices[i], PAGECACHE_TAG_DIRTY);
+            radix_tree_tag_set(&cache->pages, indices[i], PAGECACHE_TAG_WRITEBACK);
+            pages[i] = pmm_ref_one(entries[i]->page);
+        }
+        spinlock_release(&cache->lock);
+
+        if (n == 0)
+            break;
+
+        pagecache_stat.dirty -= n;
+        pagecache_stat.writeback += n;
+        for (size_t i = 0; i < n;)
+        {
+            // consecutive pages are written back together, if the filesystem can do so
+            size_t run = 1;
+            if (cache->ops->flush_pages)
+                while (i + run < n && indices[i + run] == indices[i] + run)
+                    run++;
+
+            long err;
+            if (cache->ops->flush_pages)
+                err = cache->ops->flush_pages(cache, indices[i], run, &pages[i]);
+            else
+                err = cache->ops->flush_page(cache, indices[i], pages[i]);
+
+            spinlock_acquire(&cache->lock);
+            for (size_t j = i; j < i + run; j++)
+                radix_tree_tag_clear(&cache->pages, indices[j], PAGECACHE_TAG_WRITEBACK);
+            spinlock_release(&cache->lock);
+            pagecache_stat.writeback -= run;
+            waitlist_wake_all(&cache->writeback_waiters);
+
+            for (size_t j = i; j < i + run; j++)
+            {
+                if (err && pagecache_tag_dirty(cache, indices[j]))
+                    pagecache_writeback_queue(cache); // retry later, not right away if the superblock is going away
+                else
+                    pagecache_stat.written++;
+                pagecache_put_page(pages[j]);
+            }
+
+            if (err)
+                ret = err;
+            i += run;
+        }
+
+        next = indices[n - 1] + 1;
+    }
+
+    // pages that were already being written back by someone else, who wakes us after clearing the tag
+    while (wait)
+    {
+        spinlock_acquire(&cache->lock);
+        if (!radix_tree_tagged(&cache->pages, PAGECACHE_TAG_WRITEBACK))
+        {
+            spinlock_release(&cache->lock);
+            break;
+        }
+
+        MOS_ASSERT(waitlist_append(&cache->writeback_waiters));
+        spinlock_release(&cache->lock);
+        blocked_reschedule();
+    }
+
+    return ret;
+}
+
+static bool pagecache_dirty_exceeded(void)
+{
+    const size_t usable = pmm_total_frames - MIN(pmm_reserved_frames, pmm_total_frames);
+    return pagecache_stat.dirty > usable * MOS_VFS_DIRTY_RATIO / 100;
+}
+
+void pagecache_drop_all(inode_cache_t *cache)
+{
+    // the inode is going away, so nobody can be looking up (or filling) its pages anymore
+    spinlock_acquire(&pagecache_clock_lock);
+    spinlock_acquire(&cache->lock);
+
+    pagecache_entry_t *entries[16];
+    size_t n;
+    while ((n = radix_tree_gang_lookup(&cache->pages, (void **) entries, NULL, 0, MOS_ARRAY_SIZE(entries))) > 0)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            if (radix_tree_tag_get(&cache->pages, entries[i]->pgoff, PAGECACHE_TAG_DIRTY) && pagecache_can_writeback(cache))
+                pagecache_stat.dirty--;
+            radix_tree_delete(&cache->pages, entries[i]->pgoff);
+            pagecache_entry_destroy(entries[i]);
+        }
+    }
+
+    radix_tree_destroy(&cache->pages);
+    spinlock_release(&cache->lock);
+    spinlock_release(&pagecache_clock_lock);
+}
+
+void pagecache_truncate(inode_cache_t *cache, size_t size)
+{
+    spinlock_acquire(&pagecache_clock_lock);
+    spinlock_acquire(&cache->lock);
+
+    // the data after the new end of file must read as zeros if the file is extended again
+    if (size % MOS_PAGE_SIZE)
+    {
+        pagecache_entry_t *entry = radix_tree_lookup(&cache->pages, size / MOS_PAGE_SIZE);
+        if (entry)
+            memzero((char *) phyframe_va(entry->page) + size % MOS_PAGE_SIZE, MOS_PAGE_SIZE - size % MOS_PAGE_SIZE);
+    }
+
+    pagecache_entry_t *entries[16];
+    u64 indices[16];
+    u64 next = ALIGN_UP_TO_PAGE(size) / MOS_PAGE_SIZE;
+    size_t n;
+    while ((n = radix_tree_gang_lookup(&cache->pages, (void **) entries, indices, next, MOS_ARRAY_SIZE(entries))) > 0)
+    {
+        next = indices[n - 1] + 1;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (radix_tree_tag_get(&cache->pages, indices[i], PAGECACHE_TAG_DIRTY))
+            {
+                radix_tree_tag_clear(&cache->pages, indices[i], PAGECACHE_TAG_DIRTY);
+                if (pagecache_can_writeback(cache))
+                    pagecache_stat.dirty--;
+            }
+
+            if (radix_tree_tag_get(&cache->pages, indices[i], PAGECACHE_TAG_WRITEBACK) || entries[i]->page->allocated_refcount > 1)
+            {
+                // still mapped or in use, keep it around but forget its contents
+                memzero_page((void *) phyframe_va(entries[i]->page));
+                continue;
+            }
+
+            radix_tree_delete(&cache->pages, indices[i]);
+            pagecache_entry_destroy(entries[i]);
+        }
+    }
+
+    spinlock_release(&cache->lock);
+    spinlock_release(&pagecache_clock_lock);
+}
+
+size_t pagecache_reclaim(size_t npages)
+{
+    size_t reclaimed = 0;
+    spinlock_acquire(&pagecache_clock_lock);
+
+    // every entry is visited at most twice: once to clear its referenced bit, once more to evict it
+    size_t budget = pagecache_nentries * 2;
+    while (reclaimed < npages && budget-- > 0 && !list_is_empty(&pagecache_clock))
+    {
+        pagecache_entry_t *entry = list_entry(pagecache_clock.next, pagecache_entry_t);
+        inode_cache_t *cache = entry->cache;
+
+        spinlock_acquire(&cache->lock);
+        // the cache's own reference is the only one if the page is neither mapped nor being used
+        const bool busy = radix_tree_tag_get(&cache->pages, entry->pgoff, PAGECACHE_TAG_DIRTY) || //
+                          radix_tree_tag_get(&cache->pages, entry->pgoff, PAGECACHE_TAG_WRITEBACK);
+        if (entry->referenced || busy || entry->page->allocated_refcount > 1)
+        {
+            entry->referenced = false;
+            list_remove(entry);
+            list_node_append(&pagecache_clock, list_node(entry)); // move behind the hand
+            spinlock_release(&cache->lock);
+            continue;
+        }
+
+        radix_tree_delete(&cache->pages, entry->pgoff);
+        pagecache_entry_destroy(entry);
+        spinlock_release(&cache->lock);
+        reclaimed++;
+    }
+
+    spinlock_release(&pagecache_clock_lock);
+    pagecache_stat.reclaimed += reclaimed;
+    return reclaimed;
+}
+
+static bool pagecache_should_reclaim(wait_condition_t *condition)
+{
+    // after a pass that freed nothing, wait for new pages to be cached before trying again
+    const size_t *stalled_at = condition->arg;
+    return pmm_below_watermark(PMM_WATERMARK_LOW) && pagecache_ninserted != *stalled_at;
+}
+
+static void pagecache_reclaim_worker(void *arg)
+{
+    MOS_UNUSED(arg);
+    size_t stalled_at = (size_t) -1;
+    while (true)
+    {
+        reschedule_for_wait_condition(wc_wait_for(&stalled_at, pagecache_should_reclaim, NULL));
+        if (current_thread->waiting)
+        {
+            wc_condition_cleanup(current_thread->waiting);
+            current_thread->waiting = NULL;
+        }
+
+        while (pmm_below_watermark(PMM_WATERMARK_HIGH))
+        {
+            // unused dentries hold their inodes, and the inodes hold their cached pages
+            if (pagecache_reclaim(PAGECACHE_RECLAIM_BATCH) == 0 && dcache_shrink(PAGECACHE_RECLAIM_BATCH) == 0)
+            {
+                stalled_at = pagecache_ninserted;
+                break;
+            }
+        }
+    }
+}
+
+void pagecache_readahead_async(inode_t *inode, off_t pgoff, size_t npages)
+{
+    if (!readahead_thread || npages == 0)
+        return;
+
+    pagecache_readahead_t *ra = kmalloc(readahead_slab);
+    linked_list_init(list_node(ra));
+    inode_ref(inode);
+    ra->inode = inode;
+    ra->pgoff = pgoff;
+    ra->npages = npages;
+    pagecache_stat.readahead_queued += npages;
+
+    spinlock_acquire(&readahead_lock);
+    list_node_append(&readahead_queue, list_node(ra));
+    spinlock_release(&readahead_lock);
+    waitlist_wake(&readahead_waitlist, 1);
+}
+
+static void pagecache_readahead_worker(void *arg)
+{
+    MOS_UNUSED(arg);
+    while (true)
+    {
+        spinlock_acquire(&readahead_lock);
+        if (list_is_empty(&readahead_queue))
+        {
+            spinlock_release(&readahead_lock);
+            MOS_ASSERT(reschedule_for_waitlist(&readahead_waitlist)); // wait for more requests
+            continue;
+        }
+
+        pagecache_readahead_t *ra = list_entry(list_node_pop(&readahead_queue), pagecache_readahead_t);
+        spinlock_release(&readahead_lock);
+
+        pagecache_stat.readahead_filled += pagecache_fill_range(&ra->inode->cache, ra->pgoff, ra->npages);
+        inode_unref(ra->inode);
+        kfree(ra);
+    }
+}
+
+static void pagecache_kthreads_init(void)
+{
+    waitlist_init(&readahead_waitlist);
+    readahead_thread = kthread_create(pagecache_readahead_worker, NULL, "pagecache_readahead");
+    kthread_create(pagecache_reclaim_worker, NULL, "pagecache_reclaim");
+}
+
+MOS_INIT(KTHREAD, pagecache_kthreads_init);
+
 phyframe_t *pagecache_get_page_for_write(inode_cache_t *cache, off_t pgoff)
 {
     return pagecache_get_page_for_read(cache, pgoff);
 }
 
-ssize_t vfs_read_pagecache(inode_cache_t *icache, void *buf, size_t size, off_t offset)
+static void pagecache_readahead(inode_cache_t *icache, file_ra_state_t *ra, off_t pgoff, size_t npages)
+{
+    const size_t file_end = ALIGN_UP_TO_PAGE(icache->owner->size) / MOS_PAGE_SIZE;
+    size_t sync_fill = 0;                  // pages to read now, starting at pgoff
+    off_t async_start = 0, async_size = 0; // the window to read in the background
+
+    // concurrent reads of the same file update the window under the lock, the I/O is done after releasing it
+    spinlock_acquire(&ra->lock);
+    const bool sequential = pgoff == ra->prev_pgoff || pgoff == ra->prev_pgoff + 1 || (pgoff == 0 && ra->size == 0);
+    ra->prev_pgoff = pgoff + npages - 1;
+
+    if (!sequential || MOS_VFS_READAHEAD_MAX_PAGES == 0)
+    {
+        ra->start = ra->size = ra->async_size = 0;
+    }
+    else if (ra->size == 0 || (size_t) pgoff >= ra->start + ra->size)
+    {
+        // start (or catch up with) a window at the current position, read together with the requested pages
+        const size_t initial = MAX(npages * 2, 4ul);
+        ra->start = pgoff;
+        ra->size = MIN(ra->size ? ra->size * 2 : initial, (size_t) MOS_VFS_READAHEAD_MAX_PAGES);
+        ra->async_size = ra->size / 2;
+        sync_fill = MIN(MAX(ra->size, npages), file_end - MIN(file_end, (size_t) pgoff));
+    }
+    else if ((size_t) pgoff + npages > ra->start + ra->size - ra->async_size)
+    {
+        // the reader has reached the marker, start the next (larger) window in the background,
+        // with its marker at its first page, so that there is always one window in flight
+        ra->start += ra->size;
+        ra->size = MIN(ra->size * 2, (size_t) MOS_VFS_READAHEAD_MAX_PAGES);
+        ra->async_size = ra->size;
+        if ((size_t) ra->start < file_end)
+            async_start = ra->start, async_size = MIN(ra->size, file_end - ra->start);
+    }
+    spinlock_release(&ra->lock);
+
+    if (sync_fill)
+        pagecache_stat.readahead_sync += pagecache_fill_range(icache, pgoff, sync_fill);
+    if (async_size)
+        pagecache_readahead_async(icache->owner, async_start, async_size);
+}
+
+ssize_t vfs_read_pagecache(inode_cache_t *icache, void *buf, size_t size, off_t offset, file_ra_state_t *ra)
 {
+    if (ra && size > 0)
+        pagecache_readahead(icache, ra, offset / MOS_PAGE_SIZE, (offset % MOS_PAGE_SIZE + size + MOS_PAGE_SIZE - 1) / MOS_PAGE_SIZE);
+
     size_t bytes_read = 0;
     size_t bytes_left = size;
     while (bytes_left > 0)
@@ -45,6 +732,7 @@ ssize_t vfs_read_pagecache(inode_cache_t *icache, void *buf, size_t size, off_t
             return PTR_ERR(page);
 
         memcpy((char *) buf + bytes_read, (void *) (phyframe_va(page) + inpage_offset), inpage_size);
+        pagecache_put_page(page);
 
         bytes_read += inpage_size;
         bytes_left -= inpage_size;
@@ -79,6 +767,13 @@ ssize_t vfs_write_pagecache(inode_cache_t *icache, const void *buf, size_t total
         memcpy((char *) (phyframe_va(page) + inpage_offset), (char *) buf + bytes_written, inpage_size);
         ops->page_write_end(icache, offset, inpage_size, page, private);
 
+        // once too much memory is dirty, writers are throttled by writing back their own pages
+        if (pagecache_dirty_exceeded())
+        {
+            pagecache_stat.throttled++;
+            pagecache_flush(icache, false);
+        }
+
         bytes_written += inpage_size;
         bytes_left -= inpage_size;
         offset += inpage_size;
@@ -3,8 +3,15 @@
 
 #include "mos/filesystem/userfs/userfs.h"
 
+#include "mos/filesystem/dentry.h"
+#include "mos/filesystem/inode.h"
+#include "mos/filesystem/page_cache.h"
+#include "mos/filesystem/sysfs/sysfs.h"
+#include "mos/filesystem/sysfs/sysfs_autoinit.h"
 #include "mos/filesystem/vfs_types.h"
 #include "mos/filesystem/vfs_utils.h"
+#include "mos/ipc/ipc.h"
+#include "mos/mm/page_grant.h"
 #include "mos/misc/profiling.h"
 #include "mos/printk.h"
 #include "proto/filesystem.pb.h"
@@ -27,6 +34,11 @@ RPC_CLIENT_DEFINE_SIMPLECALL(fs_client, USERFS_IMPL_X)
 static const inode_ops_t userfs_iops;
 static const file_ops_t userfs_fops;
 static const inode_cache_ops_t userfs_inode_cache_ops;
+static superblock_ops_t userfs_sb_ops;
+
+static size_t userfs_getpages_max = MOS_USERFS_GETPAGES_MAX;
+
+#define USERFS_READDIRPLUS_BATCH 64 // entries per readdirplus request
 
 inode_t *i_from_pbfull(const pb_inode_info *stat, superblock_t *sb, void *private)
 {
@@ -46,6 +58,7 @@ inode_t *i_from_pbfull(const pb_inode_info *stat, superblock_t *sb, void *privat
     i->private = private;
     i->ops = &userfs_iops;
     i->file_ops = &userfs_fops;
+    i->cache.ops = &userfs_inode_cache_ops;
     return i;
 }
 
@@ -85,6 +98,8 @@ void userfs_ensure_connected(userfs_t *userfs)
         pr_warn("userfs_ensure_connected: failed to connect to %s", userfs->rpc_server_name);
         return;
     }
+
+    userfs->server_pid = ipc_get_server_owner(userfs->rpc_server_name);
 }
 
 static bool userfs_iop_hardlink(dentry_t *d, inode_t *i, dentry_t *new_d)
@@ -95,14 +110,14 @@ static bool userfs_iop_hardlink(dentry_t *d, inode_t *i, dentry_t *new_d)
     return false;
 }
 
-static void userfs_iop_iterate_dir(dentry_t *dentry, vfs_listdir_state_t *state, dentry_iterator_op add_record)
+// the old readdir RPC, for servers that don't implement readdirplus
+static void userfs_iop_readdir(dentry_t *dentry, vfs_listdir_state_t *state, dentry_iterator_op add_record)
 {
     userfs_t *userfs = container_of(dentry->superblock->fs, userfs_t, fs);
     mos_rpc_fs_readdir_request req = { 0 };
     i_to_pb_ref(dentry->inode, &req.i_ref);
 
     mos_rpc_fs_readdir_response resp = { 0 };
-    userfs_ensure_connected(userfs);
 
     const pf_point_t ev = profile_enter();
     const int result = fs_client_readdir(userfs->rpc_server, &req, &resp);
@@ -110,13 +125,13 @@ static void userfs_iop_iterate_dir(dentry_t *dentry, vfs_listdir_state_t *state,
 
     if (result != RPC_RESULT_OK)
     {
-        pr_warn("userfs_iop_iterate_dir: failed to readdir %s: %d", dentry_name(dentry), result);
+        pr_warn("userfs_iop_readdir: failed to readdir %s: %d", dentry_name(dentry), result);
         goto bail_out;
     }
 
     if (!resp.entries_count)
     {
-        pr_dwarn(userfs, "userfs_iop_iterate_dir: failed to readdir %s: %s", dentry_name(dentry), resp.result.error);
+        pr_dwarn(userfs, "userfs_iop_readdir: failed to readdir %s: %s", dentry_name(dentry), resp.result.error);
         goto bail_out;
     }
 
@@ -131,6 +146,81 @@ bail_out:
     pb_release(mos_rpc_fs_readdir_response_fields, &resp);
 }
 
+// instantiate the dentry and inode of a directory entry, so that looking it up later doesn't need another RPC
+static void userfs_prime_dentry(dentry_t *parent, const pb_dirent_plus *pbde)
+{
+    const size_t len = strlen(pbde->name);
+    dentry_t *child = dcache_get(parent, pbde->name, len, dcache_hash_name(pbde->name, len));
+    if (child && child->inode)
+    {
+        // already cached, possibly with local changes that the server doesn't know about yet
+        MOS_ASSERT(dentry_unref_one_norelease(child));
+        return;
+    }
+
+    if (!child)
+    {
+        child = dentry_create(parent->superblock, parent, pbde->name);
+        dcache_pin(child);
+    }
+
+    inode_t *i = i_from_pbfull(&pbde->i_info, parent->superblock, (void *) pbde->i_ref.data);
+    child->superblock = i->superblock = parent->superblock;
+    child->inode = i;
+    MOS_ASSERT(dentry_unref_one_norelease(child)); // the dentry cache keeps it, unused
+}
+
+static bool userfs_iop_readdirplus(dentry_t *dentry, vfs_listdir_state_t *state, dentry_readdir_op emit)
+{
+    userfs_t *userfs = container_of(dentry->superblock->fs, userfs_t, fs);
+    userfs_ensure_connected(userfs);
+
+    mos_rpc_fs_readdirplus_request req = { 0 };
+    i_to_pb_ref(dentry->inode, &req.i_ref);
+    req.cursor = state->pos;
+    req.max_entries = USERFS_READDIRPLUS_BATCH;
+
+    // large directories are read in batches, each response tells where the next one starts
+    while (true)
+    {
+        mos_rpc_fs_readdirplus_response resp = { 0 };
+
+        const pf_point_t ev = profile_enter();
+        const int result = fs_client_readdirplus(userfs->rpc_server, &req, &resp);
+        profile_leave(ev, "userfs.'%s'.readdirplus", userfs->rpc_server_name);
+
+        if (result != RPC_RESULT_OK)
+        {
+            // the server may not implement readdirplus, the VFS falls back to readdir
+            pr_dwarn(userfs, "userfs_iop_readdirplus: failed to readdirplus %s: %d", dentry_name(dentry), result);
+            pb_release(mos_rpc_fs_readdirplus_response_fields, &resp);
+            return false;
+        }
+
+        if (!resp.result.success)
+        {
+            pr_dwarn(userfs, "userfs_iop_readdirplus: failed to readdirplus %s: %s", dentry_name(dentry), resp.result.error);
+            pb_release(mos_rpc_fs_readdirplus_response_fields, &resp);
+            return false;
+        }
+
+        bool buffer_full = false;
+        for (size_t i = 0; i < resp.entries_count && !buffer_full; i++)
+        {
+            const pb_dirent_plus *pbde = &resp.entries[i];
+            MOS_ASSERT(pbde->name);
+            userfs_prime_dentry(dentry, pbde);
+            buffer_full = !emit(state, pbde->i_info.ino, pbde->name, strlen(pbde->name), (file_type_t) pbde->i_info.type, pbde->next_cursor);
+        }
+
+        const bool done = buffer_full || resp.eof || resp.entries_count == 0 || resp.next_cursor == req.cursor;
+        req.cursor = resp.next_cursor;
+        pb_release(mos_rpc_fs_readdirplus_response_fields, &resp);
+        if (done)
+            return true;
+    }
+}
+
 static bool userfs_iop_lookup(inode_t *dir, dentry_t *dentry)
 {
     bool ret = false;
@@ -171,31 +261,97 @@ leave:
     return ret;
 }
 
+static bool userfs_do_create(inode_t *dir, dentry_t *dentry, file_type_t type, file_perm_t perm)
+{
+    bool ret = false;
+    userfs_t *userfs = container_of(dir->superblock->fs, userfs_t, fs);
+    mos_rpc_fs_create_request req = { 0 };
+    i_to_pb_ref(dir, &req.i_ref);
+    req.name = (char *) dentry_name(dentry);
+    req.type = type;
+    req.perm = perm;
+
+    mos_rpc_fs_create_response resp = { 0 };
+    userfs_ensure_connected(userfs);
+
+    const pf_point_t pp = profile_enter();
+    const int result = fs_client_create(userfs->rpc_server, &req, &resp);
+    profile_leave(pp, "userfs.'%s'.create", userfs->rpc_server_name);
+
+    if (result != RPC_RESULT_OK)
+    {
+        pr_warn("userfs_do_create: failed to create %s: %d", dentry_name(dentry), result);
+        goto leave;
+    }
+
+    if (!resp.result.success)
+    {
+        pr_dwarn(userfs, "userfs_do_create: failed to create %s: %s", dentry_name(dentry), resp.result.error);
+        goto leave;
+    }
+
+    dentry->inode = i_from_pbfull(&resp.i_info, dir->superblock, (void *) resp.i_ref.data);
+    ret = true;
+
+leave:
+    pb_release(mos_rpc_fs_create_response_fields, &resp);
+    return ret;
+}
+
+static bool userfs_do_unlink(inode_t *dir, dentry_t *dentry)
+{
+    bool ret = false;
+    userfs_t *userfs = container_of(dir->superblock->fs, userfs_t, fs);
+    mos_rpc_fs_unlink_request req = { 0 };
+    i_to_pb_ref(dir, &req.i_ref);
+    req.name = (char *) dentry_name(dentry);
+
+    mos_rpc_fs_unlink_response resp = { 0 };
+    userfs_ensure_connected(userfs);
+
+    const pf_point_t pp = profile_enter();
+    const int result = fs_client_unlink(userfs->rpc_server, &req, &resp);
+    profile_leave(pp, "userfs.'%s'.unlink", userfs->rpc_server_name);
+
+    if (result != RPC_RESULT_OK)
+    {
+        pr_warn("userfs_do_unlink: failed to unlink %s: %d", dentry_name(dentry), result);
+        goto leave;
+    }
+
+    if (!resp.result.success)
+    {
+        pr_dwarn(userfs, "userfs_do_unlink: failed to unlink %s: %s", dentry_name(dentry), resp.result.error);
+        goto leave;
+    }
+
+    // the file is gone on the server, its dirty pages must not be written back anymore
+    inode_t *inode = dentry->inode;
+    pagecache_truncate(&inode->cache, 0);
+    inode->nlinks--;
+    dentry->inode = NULL;
+    inode_unref(inode);
+    ret = true;
+
+leave:
+    pb_release(mos_rpc_fs_unlink_response_fields, &resp);
+    return ret;
+}
+
 static bool userfs_iop_mkdir(inode_t *dir, dentry_t *dentry, file_perm_t perm)
 {
-    MOS_UNUSED(dir);
-    MOS_UNUSED(dentry);
-    MOS_UNUSED(perm);
-    return false;
+    return userfs_do_create(dir, dentry, FILE_TYPE_DIRECTORY, perm);
 }
 
 static bool userfs_iop_mknode(inode_t *dir, dentry_t *dentry, file_type_t type, file_perm_t perm, dev_t dev)
 {
-    MOS_UNUSED(dir);
-    MOS_UNUSED(dentry);
-    MOS_UNUSED(type);
-    MOS_UNUSED(perm);
-    MOS_UNUSED(dev);
-    return false;
+    MOS_UNUSED(dev); // device numbers are not passed to the server
+    return userfs_do_create(dir, dentry, type, perm);
 }
 
 static bool userfs_iop_newfile(inode_t *dir, dentry_t *dentry, file_type_t type, file_perm_t perm)
 {
-    MOS_UNUSED(dir);
-    MOS_UNUSED(dentry);
-    MOS_UNUSED(type);
-    MOS_UNUSED(perm);
-    return false;
+    return userfs_do_create(dir, dentry, type, perm);
 }
 
 static size_t userfs_iop_readlink(dentry_t *dentry, char *buffer, size_t buflen)
@@ -246,9 +402,8 @@ static bool userfs_iop_rename(inode_t *old_dir, dentry_t *old_dentry, inode_t *n
 
 static bool userfs_iop_rmdir(inode_t *dir, dentry_t *dentry)
 {
-    MOS_UNUSED(dir);
-    MOS_UNUSED(dentry);
-    return false;
+    // the server checks that the directory is empty
+    return userfs_do_unlink(dir, dentry);
 }
 
 static bool userfs_iop_symlink(inode_t *dir, dentry_t *dentry, const char *symname)
@@ -261,14 +416,13 @@ static bool userfs_iop_symlink(inode_t *dir, dentry_t *dentry, const char *symna
 
 static bool userfs_iop_unlink(inode_t *dir, dentry_t *dentry)
 {
-    MOS_UNUSED(dir);
-    MOS_UNUSED(dentry);
-    return false;
+    return userfs_do_unlink(dir, dentry);
 }
 
 static const inode_ops_t userfs_iops = {
     .hardlink = userfs_iop_hardlink,
-    .iterate_dir = userfs_iop_iterate_dir,
+    .iterate_dir = userfs_iop_readdir,
+    .readdir = userfs_iop_readdirplus,
     .lookup = userfs_iop_lookup,
     .mkdir = userfs_iop_mkdir,
     .mknode = userfs_iop_mknode,
@@ -326,27 +480,207 @@ static phyframe_t *userfs_inode_cache_fill_cache(inode_cache_t *cache, off_t pgo
         goto bail_out;
     }
 
-    // allocate a page
-    phyframe_t *page = pmm_ref_one(mm_get_free_page());
-    if (!page)
+    phyframe_t *page = NULL;
+    if (resp.page_grant)
     {
-        pr_warn("userfs_inode_cache_fill_cache: failed to allocate page");
-        goto bail_out;
+        // the server has handed its page over, it goes into the page cache as it is
+        page = page_grant_take(resp.page_grant, userfs->server_pid);
+        if (!page)
+            pr_warn("userfs_inode_cache_fill_cache: invalid page grant %llu", (u64) resp.page_grant);
+    }
+    else
+    {
+        page = pmm_ref_one(mm_get_free_page());
+        if (!page)
+            pr_warn("userfs_inode_cache_fill_cache: failed to allocate page");
+        else if (resp.data)
+            memcpy((void *) phyframe_va(page), resp.data->bytes, MIN(resp.data->size, (size_t) MOS_PAGE_SIZE));
     }
 
-    // copy the data from the server
-    memcpy((void *) phyframe_va(page), resp.data->bytes, MIN(resp.data->size, MOS_PAGE_SIZE));
-    return page;
+    pb_release(mos_rpc_fs_getpage_response_fields, &resp);
+    return page ? page : ERR_PTR(-EIO);
 
 bail_out:
     pb_release(mos_rpc_fs_getpage_response_fields, &resp);
     return ERR_PTR(-EIO);
 }
 
+static size_t userfs_inode_cache_fill_cache_pages(inode_cache_t *cache, off_t pgoff, size_t npages, phyframe_t **pages)
+{
+    userfs_t *userfs = container_of(cache->owner->superblock->fs, userfs_t, fs);
+    mos_rpc_fs_getpages_request req = { 0 };
+    i_to_pb_ref(cache->owner, &req.i_ref);
+    req.pgoff = pgoff;
+    req.npages = MIN(npages, userfs_getpages_max);
+
+    mos_rpc_fs_getpages_response resp = { 0 };
+    userfs_ensure_connected(userfs);
+
+    const pf_point_t pp = profile_enter();
+    const int result = fs_client_getpages(userfs->rpc_server, &req, &resp);
+    profile_leave(pp, "userfs.'%s'.getpages", userfs->rpc_server_name);
+
+    size_t n = 0;
+    if (result != RPC_RESULT_OK)
+    {
+        pr_warn("userfs_inode_cache_fill_cache_pages: failed to getpages inode %llu: %d", cache->owner->ino, result);
+        goto leave;
+    }
+
+    if (!resp.result.success)
+    {
+        pr_dwarn(userfs, "userfs_inode_cache_fill_cache_pages: failed to getpages inode %llu: %s", cache->owner->ino, resp.result.error);
+        goto leave;
+    }
+
+    if (resp.page_grants_count)
+    {
+        for (size_t i = 0; i < resp.page_grants_count; i++)
+        {
+            phyframe_t *page = page_grant_take(resp.page_grants[i], userfs->server_pid);
+            if (page && n == i && n < req.npages)
+                pages[n++] = page;
+            else if (page)
+                pmm_unref_one(page); // after a hole, or more than requested
+        }
+    }
+    else if (resp.data)
+    {
+        const size_t npages_data = MIN(ALIGN_UP_TO_PAGE(resp.data->size) / MOS_PAGE_SIZE, (size_t) req.npages);
+        for (; n < npages_data; n++)
+        {
+            phyframe_t *page = pmm_ref_one(mm_get_free_page());
+            if (!page)
+                break;
+            memcpy((void *) phyframe_va(page), resp.data->bytes + n * MOS_PAGE_SIZE, MIN((size_t) MOS_PAGE_SIZE, resp.data->size - n * MOS_PAGE_SIZE));
+            pages[n] = page;
+        }
+    }
+
+leave:
+    pb_release(mos_rpc_fs_getpages_response_fields, &resp);
+    return n;
+}
+
+static long userfs_inode_cache_flush_pages(inode_cache_t *cache, off_t pgoff, size_t npages, phyframe_t **pages)
+{
+    inode_t *inode = cache->owner;
+    const size_t size = inode->size;
+    if ((size_t) pgoff * MOS_PAGE_SIZE >= size)
+        return 0; // the file has been truncated meanwhile
+
+    // the last page of the file is only sent up to the end of the file
+    const size_t nbytes = MIN(npages * MOS_PAGE_SIZE, size - pgoff * MOS_PAGE_SIZE);
+
+    userfs_t *userfs = container_of(inode->superblock->fs, userfs_t, fs);
+    mos_rpc_fs_putpage_request req = { 0 };
+    i_to_pb_ref(inode, &req.i_ref);
+    req.pgoff = pgoff;
+    req.size = size;
+    req.data = kmalloc(PB_BYTES_ARRAY_T_ALLOCSIZE(nbytes));
+    if (!req.data)
+        return -ENOMEM;
+
+    req.data->size = nbytes;
+    for (size_t i = 0; i * MOS_PAGE_SIZE < nbytes; i++)
+        memcpy(req.data->bytes + i * MOS_PAGE_SIZE, (void *) phyframe_va(pages[i]), MIN((size_t) MOS_PAGE_SIZE, nbytes - i * MOS_PAGE_SIZE));
+
+    mos_rpc_fs_putpage_response resp = { 0 };
+    userfs_ensure_connected(userfs);
+
+    const pf_point_t pp = profile_enter();
+    const int result = fs_client_putpage(userfs->rpc_server, &req, &resp);
+    profile_leave(pp, "userfs.'%s'.putpage", userfs->rpc_server_name);
+
+    long ret = 0;
+    if (result != RPC_RESULT_OK)
+    {
+        pr_warn("userfs_inode_cache_flush_pages: failed to putpage inode %llu: %d", inode->ino, result);
+        ret = -EIO;
+    }
+    else if (!resp.result.success)
+    {
+        pr_dwarn(userfs, "userfs_inode_cache_flush_pages: failed to putpage inode %llu: %s", inode->ino, resp.result.error);
+        ret = -EIO;
+    }
+
+    kfree(req.data);
+    pb_release(mos_rpc_fs_putpage_response_fields, &resp);
+    return ret;
+}
+
 static const inode_cache_ops_t userfs_inode_cache_ops = {
     .fill_cache = userfs_inode_cache_fill_cache,
-    .page_write_begin = NULL,
-    .page_write_end = NULL,
+    .fill_cache_pages = userfs_inode_cache_fill_cache_pages,
+    .flush_pages = userfs_inode_cache_flush_pages,
+    .page_write_begin = simple_page_write_begin,
+    .page_write_end = simple_page_write_end,
+};
+
+static long userfs_sbop_sync_inode(inode_t *inode)
+{
+    userfs_t *userfs = container_of(inode->superblock->fs, userfs_t, fs);
+    mos_rpc_fs_setattr_request req = { 0 };
+    i_to_pb_ref(inode, &req.i_ref);
+    i_to_pb_full(inode, &req.i_info);
+
+    mos_rpc_fs_setattr_response resp = { 0 };
+    userfs_ensure_connected(userfs);
+
+    const pf_point_t pp = profile_enter();
+    const int result = fs_client_setattr(userfs->rpc_server, &req, &resp);
+    profile_leave(pp, "userfs.'%s'.setattr", userfs->rpc_server_name);
+
+    long ret = 0;
+    if (result != RPC_RESULT_OK)
+    {
+        pr_warn("userfs_sbop_sync_inode: failed to setattr inode %llu: %d", inode->ino, result);
+        ret = -EIO;
+    }
+    else if (!resp.result.success)
+    {
+        pr_dwarn(userfs, "userfs_sbop_sync_inode: failed to setattr inode %llu: %s", inode->ino, resp.result.error);
+        ret = -EIO;
+    }
+
+    pb_release(mos_rpc_fs_setattr_response_fields, &resp);
+    return ret;
+}
+
+static long userfs_sbop_truncate(inode_t *inode, size_t size)
+{
+    userfs_t *userfs = container_of(inode->superblock->fs, userfs_t, fs);
+    mos_rpc_fs_truncate_request req = { 0 };
+    i_to_pb_ref(inode, &req.i_ref);
+    req.size = size;
+
+    mos_rpc_fs_truncate_response resp = { 0 };
+    userfs_ensure_connected(userfs);
+
+    const pf_point_t pp = profile_enter();
+    const int result = fs_client_truncate(userfs->rpc_server, &req, &resp);
+    profile_leave(pp, "userfs.'%s'.truncate", userfs->rpc_server_name);
+
+    long ret = 0;
+    if (result != RPC_RESULT_OK)
+    {
+        pr_warn("userfs_sbop_truncate: failed to truncate inode %llu: %d", inode->ino, result);
+        ret = -EIO;
+    }
+    else if (!resp.result.success)
+    {
+        pr_dwarn(userfs, "userfs_sbop_truncate: failed to truncate inode %llu: %s", inode->ino, resp.result.error);
+        ret = -EIO;
+    }
+
+    pb_release(mos_rpc_fs_truncate_response_fields, &resp);
+    return ret;
+}
+
+static superblock_ops_t userfs_sb_ops = {
+    .drop_inode = NULL,
+    .sync_inode = userfs_sbop_sync_inode,
+    .truncate = userfs_sbop_truncate,
 };
 
 dentry_t *userfs_fsop_mount(filesystem_t *fs, const char *device, const char *options)
@@ -384,8 +718,41 @@ dentry_t *userfs_fsop_mount(filesystem_t *fs, const char *device, const char *op
     inode_t *i = i_from_pbfull(&resp.root_info, sb, (void *) resp.root_ref.data);
 
     sb->fs = fs;
+    sb->ops = &userfs_sb_ops;
+    sb->dentries_reclaimable = true; // the server can look them up again
+    sb->negative_dentries = false;   // but files may appear without the kernel knowing, e.g. in blockdevfs
     sb->root = dentry_create(sb, NULL, NULL);
     sb->root->inode = i;
     sb->root->superblock = i->superblock = sb;
     return sb->root;
 }
+
+// ! sysfs support
+
+static bool userfs_sysfs_getpages_max_show(sysfs_file_t *f)
+{
+    sysfs_printf(f, "%zu\n", userfs_getpages_max);
+    return true;
+}
+
+static bool userfs_sysfs_getpages_max_store(sysfs_file_t *f, const char *buf, size_t count, off_t offset)
+{
+    MOS_UNUSED(f);
+    MOS_UNUSED(offset);
+
+    const size_t value = strntoll(buf, NULL, 10, count);
+    if (value == 0)
+    {
+        pr_warn("userfs: getpages_max must be at least 1");
+        return false;
+    }
+
+    userfs_getpages_max = value;
+    return true;
+}
+
+static sysfs_item_t userfs_sysfs_items[] = {
+    SYSFS_RW_ITEM("getpages_max", userfs_sysfs_getpages_max_show, userfs_sysfs_getpages_max_store),
+};
+
+SYSFS_AUTOREGISTER(userfs, userfs_sysfs_items);
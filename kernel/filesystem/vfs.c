@@ -6,6 +6,8 @@
 #include "mos/filesystem/sysfs/sysfs_autoinit.h"
 #include "mos/mm/mm.h"
 #include "mos/mm/mmstat.h"
+#include "mos/mm/paging/paging.h"
+#include "mos/mm/paging/table_ops.h"
 #include "mos/mm/physical/pmm.h"
 #include "mos/mm/slab_autoinit.h"
 
@@ -57,15 +59,7 @@ static void vfs_io_ops_close_dir(io_t *io)
 
     if (file->private_data)
     {
-        vfs_listdir_state_t *state = file->private_data;
-        list_foreach(vfs_listdir_entry_t, entry, state->entries)
-        {
-            list_remove(entry);
-            kfree(entry->name);
-            kfree(entry);
-        }
-
-        kfree(state);
+        vfs_listdir_release(file->private_data);
         file->private_data = NULL;
     }
 
@@ -144,49 +138,147 @@ static off_t vfs_io_ops_seek(io_t *io, off_t offset, io_seek_whence_t whence)
     return file->offset;
 }
 
+static void vfs_fault_around(vmap_t *vmap, file_t *file, size_t fault_pgoffset)
+{
+    // map the already-cached pages in an aligned window around the faulting page, so that
+    // (mostly) sequential accesses don't take one fault per page
+    inode_t *inode = file->dentry->inode;
+    const size_t vmap_first_pg = vmap->io_offset / MOS_PAGE_SIZE;
+    const size_t vmap_end_pg = vmap_first_pg + vmap->npages;
+    const size_t file_end_pg = ALIGN_UP_TO_PAGE(inode->size) / MOS_PAGE_SIZE;
+
+    const size_t window_start = fault_pgoffset - fault_pgoffset % MOS_MM_FAULT_AROUND_PAGES;
+    const size_t start = MAX(window_start, vmap_first_pg);
+    const size_t end = MIN(MIN(window_start + MOS_MM_FAULT_AROUND_PAGES, vmap_end_pg), file_end_pg);
+    if (start >= end)
+        return;
+
+    // private mappings are mapped read-only, so that a write still triggers a CoW
+    // shared mappings have no CoW, a read-only page would be wrongly copied on write
+    const vm_flags flags = vmap->type == VMAP_TYPE_PRIVATE ? (vmap->vmflags & ~VM_WRITE) : vmap->vmflags;
+
+    phyframe_t *pages[MOS_MM_FAULT_AROUND_PAGES];
+    off_t pgoffs[MOS_MM_FAULT_AROUND_PAGES];
+    const size_t n = pagecache_get_pages_cached(&inode->cache, start, end - start, pages, pgoffs);
+    for (size_t i = 0; i < n; i++)
+    {
+        const size_t pgoff = pgoffs[i];
+        const ptr_t vaddr = vmap->vaddr + (pgoff - vmap_first_pg) * MOS_PAGE_SIZE;
+        if (pgoff == fault_pgoffset || mm_do_get_pfn(vmap->mmctx->pgd, vaddr))
+        {
+            pagecache_put_page(pages[i]); // already mapped, maybe a private copy
+            continue;
+        }
+
+        if (flags & VM_WRITE)
+            pagecache_mark_dirty(&inode->cache, pgoff); // see vfs_fault_handler
+        mm_replace_page_locked(vmap->mmctx, vaddr, phyframe_pfn(pages[i]), flags);
+        pagecache_put_page(pages[i]);
+        vmap_stat_inc(vmap, pagecache);
+        if (vmap->type == VMAP_TYPE_PRIVATE)
+            vmap_stat_inc(vmap, cow);
+        else
+            vmap_stat_inc(vmap, regular);
+        pagecache_stat.fault_around++;
+    }
+}
+
+static void vfs_fault_readahead(file_t *file, size_t fault_pgoffset)
+{
+    if (MOS_MM_FAULT_READAHEAD_PAGES == 0)
+        return;
+
+    inode_t *inode = file->dentry->inode;
+    const size_t file_end_pg = ALIGN_UP_TO_PAGE(inode->size) / MOS_PAGE_SIZE;
+
+    // faults on the same file can race with each other, and with read()
+    spinlock_acquire(&file->ra.lock);
+    const size_t prev = file->fault_prev_pgoff;
+    file->fault_prev_pgoff = fault_pgoffset;
+
+    // a fault slightly ahead of the previous one is sequential, the gap being covered by fault-around
+    const bool sequential = fault_pgoffset > prev && fault_pgoffset - prev <= (size_t) MAX(MOS_MM_FAULT_AROUND_PAGES, 1);
+
+    // start the next window once half of the previous one has been consumed
+    const size_t start = MAX(fault_pgoffset + 1, (size_t) file->fault_ra_end);
+    const size_t end = MIN(fault_pgoffset + 1 + MOS_MM_FAULT_READAHEAD_PAGES, file_end_pg);
+    const bool start_window = sequential && fault_pgoffset + MOS_MM_FAULT_READAHEAD_PAGES / 2 >= (size_t) file->fault_ra_end && start < end;
+    if (start_window)
+        file->fault_ra_end = end;
+    spinlock_release(&file->ra.lock);
+
+    if (start_window)
+        pagecache_readahead_async(inode, start, end - start);
+}
+
 static vmfault_result_t vfs_fault_handler(vmap_t *vmap, ptr_t fault_addr, pagefault_t *info)
 {
     MOS_ASSERT(vmap->io);
     file_t *file = container_of(vmap->io, file_t, io);
+    inode_cache_t *icache = &file->dentry->inode->cache;
     const size_t fault_pgoffset = (vmap->io_offset + ALIGN_DOWN_TO_PAGE(fault_addr) - vmap->vaddr) / MOS_PAGE_SIZE;
-    phyframe_t *pagecache_page = pagecache_get_page_for_read(&file->dentry->inode->cache, fault_pgoffset);
+    phyframe_t *pagecache_page = pagecache_get_page_for_read(icache, fault_pgoffset);
 
     if (IS_ERR(pagecache_page))
         return VMFAULT_CANNOT_HANDLE;
 
-    if (info->is_present && info->is_write)
+    pagecache_stat.faults++;
+    if (!info->is_present && !info->is_write)
     {
-        if (pagecache_page == info->faulting_page)
-            vmap_stat_dec(vmap, pagecache); // the faulting page is a pagecache page
-        else
-            vmap_stat_dec(vmap, cow); // the faulting page is a COW page
-        vmap_stat_inc(vmap, regular);
-        return mm_resolve_cow_fault(vmap, fault_addr, info);
+        vfs_fault_readahead(file, fault_pgoffset);
+        if (MOS_MM_FAULT_AROUND_PAGES > 1)
+            vfs_fault_around(vmap, file, fault_pgoffset);
     }
 
-    info->backing_page = pagecache_page;
-    if (vmap->type == VMAP_TYPE_PRIVATE)
+    // the page is mapped here instead of by the caller, so that our reference keeps
+    // it from being reclaimed until the mapping holds its own
+    vmfault_result_t result = VMFAULT_COMPLETE;
+    if (info->is_present && info->is_write)
+    {
+        result = mm_resolve_cow_fault(vmap, fault_addr, info);
+        if (result != VMFAULT_CANNOT_HANDLE)
+        {
+            vmap->io_pages_only = false; // a private copy of the page is mapped
+            if (pagecache_page == info->faulting_page)
+                vmap_stat_dec(vmap, pagecache); // the faulting page was a pagecache page
+            else
+                vmap_stat_dec(vmap, cow); // the faulting page was a COW page
+            vmap_stat_inc(vmap, regular);
+        }
+    }
+    else if (vmap->type == VMAP_TYPE_PRIVATE && info->is_write)
     {
-        if (info->is_write)
+        // copy the backing page and map the copy, present pages are handled above
+        phyframe_t *page = mm_get_free_page_raw(); // will be ref'd by mm_replace_page_locked()
+        if (page)
         {
+            mm_copy_page(pagecache_page, page);
+            mm_replace_page_locked(vmap->mmctx, fault_addr, phyframe_pfn(page), vmap->vmflags);
+            vmap->io_pages_only = false;
             vmap_stat_inc(vmap, regular);
-            // present pages are handled above
-            MOS_ASSERT(!info->is_present);
-            return VMFAULT_COPY_BACKING_PAGE; // copy and (also) map the backing page
         }
         else
         {
-            vmap_stat_inc(vmap, pagecache);
-            vmap_stat_inc(vmap, cow);
-            return VMFAULT_MAP_BACKING_PAGE_RO;
+            result = VMFAULT_CANNOT_HANDLE;
         }
     }
+    else if (vmap->type == VMAP_TYPE_PRIVATE)
+    {
+        vmap_stat_inc(vmap, pagecache);
+        vmap_stat_inc(vmap, cow);
+        mm_replace_page_locked(vmap->mmctx, fault_addr, phyframe_pfn(pagecache_page), vmap->vmflags & ~VM_WRITE);
+    }
     else
     {
         vmap_stat_inc(vmap, pagecache);
         vmap_stat_inc(vmap, regular);
-        return VMFAULT_MAP_BACKING_PAGE;
+        if (vmap->vmflags & VM_WRITE)
+            pagecache_mark_dirty(icache, fault_pgoffset); // writes through the mapping cannot be tracked
+        mm_replace_page_locked(vmap->mmctx, fault_addr, phyframe_pfn(pagecache_page), vmap->vmflags);
     }
+
+    pagecache_put_page(pagecache_page);
+    return result;
 }
 
 static bool vfs_io_ops_mmap(io_t *io, vmap_t *vmap, off_t offset)
@@ -198,16 +290,44 @@ static bool vfs_io_ops_mmap(io_t *io, vmap_t *vmap, off_t offset)
     vmap->on_fault = vfs_fault_handler;
 
     if (file_ops->mmap)
-        return file_ops->mmap(file, vmap, offset);
+        return file_ops->mmap(file, vmap, offset); // the file may map pages that cannot be refaulted
+
+    vmap->io_pages_only = true;
 
     return true;
 }
 
+static void vfs_redirty_shared(vmap_t *vmap, file_t *file)
+{
+    // the pages of a shared writable mapping are mapped writable, so stores made after a writeback
+    // are not seen by the page cache, dirty the pages that are still mapped before they go away
+    inode_cache_t *icache = &file->dentry->inode->cache;
+    const size_t vmap_first_pg = vmap->io_offset / MOS_PAGE_SIZE;
+
+    phyframe_t *pages[16];
+    off_t pgoffs[16];
+    for (size_t pg = 0; pg < vmap->npages; pg += MOS_ARRAY_SIZE(pages))
+    {
+        const size_t npages = MIN(MOS_ARRAY_SIZE(pages), vmap->npages - pg);
+        const size_t n = pagecache_get_pages_cached(icache, vmap_first_pg + pg, npages, pages, pgoffs);
+        for (size_t i = 0; i < n; i++)
+        {
+            const ptr_t vaddr = vmap->vaddr + (pgoffs[i] - vmap_first_pg) * MOS_PAGE_SIZE;
+            if (mm_do_get_pfn(vmap->mmctx->pgd, vaddr) == phyframe_pfn(pages[i]))
+                pagecache_mark_dirty(icache, pgoffs[i]);
+            pagecache_put_page(pages[i]);
+        }
+    }
+}
+
 static bool vfs_io_ops_munmap(io_t *io, vmap_t *vmap, bool *unmapped)
 {
     file_t *file = container_of(io, file_t, io);
     const file_ops_t *const file_ops = file_get_ops(file);
 
+    if (vmap->type == VMAP_TYPE_SHARED && (vmap->vmflags & VM_WRITE))
+        vfs_redirty_shared(vmap, file);
+
     if (file_ops->munmap)
         return file_ops->munmap(file, vmap, unmapped);
 
@@ -288,6 +408,22 @@ static bool vfs_verify_permissions(dentry_t *file_dentry, bool open, bool read,
     return true;
 }
 
+static long vfs_truncate_inode(inode_t *inode, size_t size)
+{
+    // discard the cached data first, so that no dirty page past the new end is written back afterwards
+    pagecache_truncate(&inode->cache, size);
+
+    if (inode->superblock->ops && inode->superblock->ops->truncate)
+    {
+        const long ret = inode->superblock->ops->truncate(inode, size);
+        if (ret)
+            return ret;
+    }
+
+    inode->size = size;
+    return 0;
+}
+
 static file_t *vfs_do_open(dentry_t *base, const char *path, open_flags flags)
 {
     if (base == NULL)
@@ -330,6 +466,16 @@ static file_t *vfs_do_open(dentry_t *base, const char *path, open_flags flags)
     if (!vfs_verify_permissions(entry, true, read, may_create, exec, write))
         return ERR_PTR(-EACCES);
 
+    if (truncate && write && !created && entry->inode->type == FILE_TYPE_REGULAR && entry->inode->size > 0)
+    {
+        const long ret = vfs_truncate_inode(entry->inode, 0);
+        if (ret)
+        {
+            dentry_unref(entry);
+            return ERR_PTR(ret);
+        }
+    }
+
     file_t *file = kmalloc(file_cache);
     file->dentry = entry;
 
@@ -473,6 +619,7 @@ long vfs_unmount(const char *path)
     }
 
     MOS_ASSERT(mounted_root->refcount == mountpoint->refcount && mountpoint->refcount == 1);
+    pagecache_writeback_stop(mounted_root->superblock);
     if (mounted_root->superblock->fs->unmount)
         mounted_root->superblock->fs->unmount(mounted_root->superblock->fs, mounted_root);
     else
@@ -531,6 +678,33 @@ long vfs_fstatat(fd_t fd, const char *path, file_stat_t *restrict statbuf, fstat
     return 0;
 }
 
+long vfs_fsync(io_t *io, bool sync_metadata)
+{
+    if (!(io_valid(io) && (io->type == IO_FILE || io->type == IO_DIR)))
+        return -EBADF; // io is closed, or is not a file or directory
+
+    file_t *file = container_of(io, file_t, io);
+    inode_t *inode = file->dentry->inode;
+    pr_dinfo2(vfs, "vfs_fsync(file=%p, metadata=%d)", (void *) file, sync_metadata);
+
+    const file_ops_t *file_ops = file_get_ops(file);
+    if (file_ops && file_ops->flush)
+    {
+        const long ret = file_ops->flush(file);
+        if (ret)
+            return ret;
+    }
+
+    const long ret = pagecache_flush(&inode->cache, true);
+    if (ret)
+        return ret;
+
+    if (sync_metadata && inode->superblock->ops && inode->superblock->ops->sync_inode)
+        return inode->superblock->ops->sync_inode(inode);
+
+    return 0;
+}
+
 size_t vfs_readlinkat(fd_t dirfd, const char *path, char *buf, size_t size)
 {
     dentry_t *base = path_is_absolute(path) ? root_dentry : dentry_from_fd(dirfd);
@@ -634,42 +808,10 @@ size_t vfs_list_dir(io_t *io, void *user_buf, size_t user_size)
     if (file->private_data == NULL)
     {
         vfs_listdir_state_t *const state = file->private_data = kmalloc(sizeof(vfs_listdir_state_t));
-        linked_list_init(&state->entries);
-        state->n_count = state->read_offset = 0;
-        vfs_populate_listdir_buf(file->dentry, state);
-    }
-
-    vfs_listdir_state_t *const state = file->private_data;
-
-    if (state->read_offset >= state->n_count)
-        return 0; // no more entries
-
-    size_t bytes_copied = 0;
-    size_t i = 0;
-    list_foreach(vfs_listdir_entry_t, entry, state->entries)
-    {
-        if (i++ < state->read_offset)
-            continue; // skip the entries we have already read
-
-        if (state->read_offset >= state->n_count)
-            break;
-
-        const size_t entry_size = sizeof(ino_t) + sizeof(off_t) + sizeof(short) + sizeof(char) + entry->name_len + 1; // +1 for the null terminator
-        if (bytes_copied + entry_size > user_size)
-            break;
-
-        struct dirent *dirent = (struct dirent *) (((char *) user_buf) + bytes_copied);
-        dirent->d_ino = entry->ino;
-        dirent->d_type = entry->type;
-        dirent->d_reclen = entry_size;
-        dirent->d_off = entry_size - 1;
-        memcpy(dirent->d_name, entry->name, entry->name_len);
-        dirent->d_name[entry->name_len] = '\0';
-        bytes_copied += entry_size;
-        state->read_offset++;
+        *state = (vfs_listdir_state_t){ 0 };
     }
 
-    return bytes_copied;
+    return vfs_listdir_read(file->dentry, file->private_data, user_buf, user_size);
 }
 
 long vfs_chdir(const char *path)
@@ -753,10 +895,28 @@ static bool vfs_sysfs_dentry_stats(sysfs_file_t *f)
     return true;
 }
 
+static bool vfs_sysfs_pagecache_stats(sysfs_file_t *f)
+{
+    sysfs_printf(f, "%-20s %zu\n", "Hits:", (size_t) pagecache_stat.hits);
+    sysfs_printf(f, "%-20s %zu\n", "Misses:", (size_t) pagecache_stat.misses);
+    sysfs_printf(f, "%-20s %zu\n", "Reclaimed:", (size_t) pagecache_stat.reclaimed);
+    sysfs_printf(f, "%-20s %zu\n", "Dirty:", (size_t) pagecache_stat.dirty);
+    sysfs_printf(f, "%-20s %zu\n", "Writeback:", (size_t) pagecache_stat.writeback);
+    sysfs_printf(f, "%-20s %zu\n", "Written:", (size_t) pagecache_stat.written);
+    sysfs_printf(f, "%-20s %zu\n", "Throttled:", (size_t) pagecache_stat.throttled);
+    sysfs_printf(f, "%-20s %zu\n", "Faults:", (size_t) pagecache_stat.faults);
+    sysfs_printf(f, "%-20s %zu\n", "FaultAround:", (size_t) pagecache_stat.fault_around);
+    sysfs_printf(f, "%-20s %zu\n", "ReadaheadQueued:", (size_t) pagecache_stat.readahead_queued);
+    sysfs_printf(f, "%-20s %zu\n", "ReadaheadFilled:", (size_t) pagecache_stat.readahead_filled);
+    sysfs_printf(f, "%-20s %zu\n", "ReadaheadSync:", (size_t) pagecache_stat.readahead_sync);
+    return true;
+}
+
 static sysfs_item_t vfs_sysfs_items[] = {
     SYSFS_RO_ITEM("filesystems", vfs_sysfs_filesystems),
     SYSFS_RO_ITEM("mount", vfs_sysfs_mountpoints),
     SYSFS_RO_ITEM("dentry_stats", vfs_sysfs_dentry_stats),
+    SYSFS_RO_ITEM("pagecache_stats", vfs_sysfs_pagecache_stats),
 };
 
 SYSFS_AUTOREGISTER(vfs, vfs_sysfs_items);
@@ -2,6 +2,7 @@
 
 #include "mos/filesystem/vfs_utils.h"
 
+#include "mos/filesystem/dentry.h"
 #include "mos/filesystem/page_cache.h"
 #include "mos/filesystem/vfs_types.h"
 #include "mos/mm/physical/pmm.h"
@@ -17,28 +18,44 @@ slab_t *dentry_cache;
 SLAB_AUTOINIT("dentry", dentry_cache, dentry_t);
 
 dentry_t *dentry_create(superblock_t *sb, dentry_t *parent, const char *name)
+{
+    return dentry_create_n(sb, parent, name, name ? strlen(name) : 0);
+}
+
+dentry_t *dentry_create_n(superblock_t *sb, dentry_t *parent, const char *name, size_t name_len)
 {
     dentry_t *dentry = kmalloc(dentry_cache);
     dentry->superblock = sb;
     tree_node_init(tree_node(dentry));
 
+    linked_list_init(&dentry->hash_node);
+    linked_list_init(&dentry->lru_node);
+
     if (name)
-        dentry->name = strdup(name);
+        dentry->name = strndup(name, name_len);
 
     if (parent)
     {
-        tree_add_child(tree_node(parent), tree_node(dentry));
         dentry->superblock = parent->superblock;
+        dcache_insert(parent, dentry);
     }
 
     return dentry;
 }
 
+void dentry_destroy(dentry_t *dentry)
+{
+    dcache_remove(dentry);
+    if (dentry->name)
+        kfree(dentry->name);
+    kfree(dentry);
+}
+
 bool simple_page_write_begin(inode_cache_t *icache, off_t offset, size_t size, phyframe_t **page, void **private)
 {
     MOS_UNUSED(size);
     *page = pagecache_get_page_for_write(icache, offset / MOS_PAGE_SIZE);
-    if (!*page)
+    if (IS_ERR(*page))
         return false;
 
     *private = NULL;
@@ -47,12 +64,14 @@ bool simple_page_write_begin(inode_cache_t *icache, off_t offset, size_t size, p
 
 void simple_page_write_end(inode_cache_t *icache, off_t offset, size_t size, phyframe_t *page, void *private)
 {
-    MOS_UNUSED(page);
     MOS_UNUSED(private);
 
-    // also update the inode's size
+    // update the inode's size first, writeback only writes the pages up to it
     if (offset + size > icache->owner->size)
         icache->owner->size = offset + size;
+
+    pagecache_mark_dirty(icache, offset / MOS_PAGE_SIZE);
+    pagecache_put_page(page);
 }
 
 // read from the page cache, the size and offset are already validated to be in the file's bounds
@@ -61,7 +80,9 @@ ssize_t vfs_generic_read(const file_t *file, void *buf, size_t size, off_t offse
     // cap the read size to the file's size
     size = MIN(size, file->dentry->inode->size - offset);
     inode_cache_t *icache = &file->dentry->inode->cache;
-    const ssize_t read = vfs_read_pagecache(icache, buf, size, offset);
+    // the readahead state is bookkeeping of the open file, it changes with every read
+    file_ra_state_t *ra = (file_ra_state_t *) &file->ra;
+    const ssize_t read = vfs_read_pagecache(icache, buf, size, offset, ra);
     return read;
 }
 
@@ -83,9 +104,11 @@ bool vfs_simple_write_begin(inode_cache_t *icache, off_t offset, size_t size)
 
 void vfs_generic_iterate_dir(const dentry_t *dir, vfs_listdir_state_t *state, dentry_iterator_op add_record)
 {
+    dcache_tree_lock();
     tree_foreach_child(dentry_t, child, dir)
     {
         if (child->inode)
             add_record(state, child->inode->ino, child->name, strlen(child->name), child->inode->type);
     }
+    dcache_tree_unlock();
 }
@@ -32,10 +32,10 @@ typedef struct _console
 
     struct
     {
-        spinlock_t lock;
-        ring_buffer_pos_t pos;
+        spinlock_t lock;        ///< serialises the readers, console_putc() is the only writer
+        ring_buffer_spsc_t pos;
         u8 *buf;
-        size_t size;
+        size_t size;            ///< a power of two
     } read;
 
     struct
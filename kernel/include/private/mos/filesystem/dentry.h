@@ -126,6 +126,7 @@ dentry_t *dentry_from_fd(fd_t fd);
  *
  * @return The child dentry, always non-NULL, even if the child dentry does not exist in the filesystem
  * @note The returned dentry will have its reference count incremented, even if it does not exist.
+ * A negative dentry is released with dcache_put_negative().
  */
 dentry_t *dentry_get_child(dentry_t *parent, const char *name);
 
@@ -165,12 +166,22 @@ __nodiscard bool dentry_mount(dentry_t *mountpoint, dentry_t *root, filesystem_t
 __nodiscard dentry_t *dentry_unmount(dentry_t *root);
 
 /**
- * @brief List the contents of a directory
+ * @brief List the contents of a directory as dirent records, continuing where the previous call stopped
  *
  * @param dir The directory to list
+ * @param state The state of the directory iterator, zero-initialised before the first call
+ * @param buf The buffer to write the records to
+ * @param size The size of the buffer
+ * @return size_t The number of bytes written, 0 if all entries have been listed
+ */
+size_t vfs_listdir_read(dentry_t *dir, vfs_listdir_state_t *state, void *buf, size_t size);
+
+/**
+ * @brief Free the state of a directory iterator
+ *
  * @param state The state of the directory iterator
  */
-void vfs_populate_listdir_buf(dentry_t *dir, vfs_listdir_state_t *state);
+void vfs_listdir_release(vfs_listdir_state_t *state);
 
 /**
  * @brief Get the path of a dentry
@@ -183,4 +194,107 @@ void vfs_populate_listdir_buf(dentry_t *dir, vfs_listdir_state_t *state);
  */
 ssize_t dentry_path(dentry_t *dentry, dentry_t *root, char *buf, size_t size);
 
+/**
+ * @brief Check if a dentry is a cached failed lookup
+ */
+should_inline bool dentry_is_cached_negative(const dentry_t *dentry)
+{
+    return dentry->inode == NULL && !list_is_empty(&dentry->lru_node);
+}
+
+#define DCACHE_HASH_INIT 2166136261u ///< initial value of a name hash (FNV-1a)
+
+/**
+ * @brief Add a character to a name hash, so that names can be hashed while they are being parsed
+ */
+should_inline u32 dcache_hash_step(u32 hash, char c)
+{
+    return (hash ^ (u8) c) * 16777619u;
+}
+
+should_inline u32 dcache_hash_name(const char *name, size_t len)
+{
+    u32 hash = DCACHE_HASH_INIT;
+    for (size_t i = 0; i < len; i++)
+        hash = dcache_hash_step(hash, name[i]);
+    return hash;
+}
+
+/**
+ * @brief Add a dentry to its parent's children, and to the dentry cache if it has a name, done by dentry_create()
+ */
+void dcache_insert(dentry_t *parent, dentry_t *dentry);
+
+/**
+ * @brief Remove a dentry from the dentry cache and its parent's children, done before it is freed
+ */
+void dcache_remove(dentry_t *dentry);
+
+/**
+ * @brief Lock the children lists of all dentries, so that the shrinker doesn't free a child while walking them
+ */
+void dcache_tree_lock(void);
+void dcache_tree_unlock(void);
+
+/**
+ * @brief Find a child dentry in the dentry cache, without asking the filesystem
+ *
+ * @param parent The parent dentry
+ * @param name The name of the child
+ * @return dentry_t* The child, which may be a negative dentry, or NULL if it is not cached.
+ * @note The returned dentry is not referenced.
+ */
+dentry_t *dcache_lookup(const dentry_t *parent, const char *name);
+
+/**
+ * @brief Same as dcache_lookup(), but the dentry is returned with a reference
+ *
+ * @details A negative dentry is pinned by the reference, so that the shrinker leaves it alone.
+ * The reference is dropped with dcache_put_negative() if the dentry is still negative.
+ *
+ * @param parent The parent dentry
+ * @param name The name of the child, not necessarily null-terminated
+ * @param len The length of the name
+ * @param hash The hash of the name, see dcache_hash_name()
+ */
+dentry_t *dcache_get(const dentry_t *parent, const char *name, size_t len, u32 hash);
+
+/**
+ * @brief Keep an unused negative dentry in the cache instead of freeing it
+ *
+ * @param dentry The dentry, without an inode, children or references
+ * @return true if the dentry is kept, false if the caller should free it
+ */
+bool dcache_keep_negative(dentry_t *dentry);
+
+/**
+ * @brief Pin a dentry that is being looked up, it is either referenced or put with dcache_put_negative() afterwards
+ */
+void dcache_pin(dentry_t *dentry);
+
+/**
+ * @brief Drop the reference of a lookup on a negative dentry, it is cached or freed if it is no longer used
+ *
+ * @param dentry The dentry, from dentry_get_child() or dcache_get()
+ */
+void dcache_put_negative(dentry_t *dentry);
+
+/**
+ * @brief Free unused dentries, negative ones first
+ *
+ * @param max Maximum number of dentries to free
+ * @return size_t Number of dentries freed
+ */
+size_t dcache_shrink(size_t max);
+
+typedef struct
+{
+    atomic_t hits;          ///< lookups that found a positive dentry in the cache
+    atomic_t negative_hits; ///< lookups answered by a cached negative dentry
+    atomic_t misses;        ///< lookups that had to ask the filesystem
+    atomic_t reclaimed;     ///< dentries freed by the shrinker or the negative dentry LRU
+} dcache_stat_t;
+
+extern dcache_stat_t dcache_stat;
+
 /**@}*/
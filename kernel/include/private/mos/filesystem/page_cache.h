@@ -5,23 +5,142 @@
 #include "mos/filesystem/vfs_types.h"
 #include "mos/mm/physical/pmm.h"
 
+#define PAGECACHE_TAG_DIRTY     0 ///< the page has been modified
+#define PAGECACHE_TAG_WRITEBACK 1 ///< the page is being written back to the backing storage
+
 /**
- * @brief Get a page from the page cache
+ * @brief Get a page from the page cache, filling it on a miss
  *
  * @param cache The inode cache
  * @param pgoff The page offset
- * @return phyframe_t* The page, or NULL if it doesn't exist
+ * @return phyframe_t* The page, or an error pointer if it cannot be filled
+ *
+ * @note The returned page holds a reference for the caller, which keeps it from being reclaimed,
+ * release it with pagecache_put_page().
  */
 phyframe_t *pagecache_get_page_for_read(inode_cache_t *cache, off_t pgoff);
 
+/**
+ * @brief Get a page from the page cache, without filling it on a miss
+ *
+ * @param cache The inode cache
+ * @param pgoff The page offset
+ * @return phyframe_t* The page, or NULL if it is not cached
+ *
+ * @note The returned page must be released with pagecache_put_page().
+ */
+phyframe_t *pagecache_get_page_cached(inode_cache_t *cache, off_t pgoff);
+
+/**
+ * @brief Get the cached pages in a range, without filling the missing ones
+ *
+ * @param cache The inode cache
+ * @param pgoff The first page offset
+ * @param npages Number of pages in the range
+ * @param pages Array of at least npages, receives the pages found in ascending order
+ * @param pgoffs Array of at least npages, receives the page offsets of the pages found
+ * @return size_t Number of pages found, each must be released with pagecache_put_page()
+ */
+size_t pagecache_get_pages_cached(inode_cache_t *cache, off_t pgoff, size_t npages, phyframe_t **pages, off_t *pgoffs);
+
 /**
  * @brief Get a page from the page cache for writing
  *
  * @param cache The inode cache
  * @param pgoff The page offset
- * @return phyframe_t* The page
+ * @return phyframe_t* The page, or an error pointer
+ *
+ * @note The returned page must be released with pagecache_put_page().
  */
 phyframe_t *pagecache_get_page_for_write(inode_cache_t *cache, off_t pgoff);
 
-ssize_t vfs_read_pagecache(inode_cache_t *icache, void *buf, size_t size, off_t offset);
+/**
+ * @brief Release a page obtained from the page cache
+ */
+void pagecache_put_page(phyframe_t *page);
+
+/**
+ * @brief Mark a cached page as dirty, it will not be reclaimed before it is written back
+ *
+ * @details If the filesystem can write pages back, the inode is queued for the superblock's
+ * writeback thread, otherwise the page stays in memory for as long as the inode exists.
+ * Once the writeback thread has been stopped, the inode is written back right away.
+ *
+ * @param cache The inode cache
+ * @param pgoff The page offset
+ */
+void pagecache_mark_dirty(inode_cache_t *cache, off_t pgoff);
+
+/**
+ * @brief Write the dirty pages of an inode back to the underlying storage
+ *
+ * @param cache The inode cache
+ * @param wait Also wait for pages that are being written back by someone else
+ * @return long 0 on success, or the last error returned by the filesystem
+ */
+long pagecache_flush(inode_cache_t *cache, bool wait);
+
+/**
+ * @brief Discard the cached pages after a new end of file
+ *
+ * @details Dirty pages in the range are not written back. Pages that are still mapped or in use
+ * are zeroed instead of being dropped, as is the tail of the page that contains the new end.
+ *
+ * @param cache The inode cache
+ * @param size The new size of the file
+ */
+void pagecache_truncate(inode_cache_t *cache, size_t size);
+
+/**
+ * @brief Drop all pages of an inode from the page cache, used when the inode is freed
+ */
+void pagecache_drop_all(inode_cache_t *cache);
+
+/**
+ * @brief Evict clean pages that are not in use from the page cache
+ *
+ * @param npages Maximum number of pages to evict
+ * @return size_t Number of pages evicted
+ */
+size_t pagecache_reclaim(size_t npages);
+
+/**
+ * @brief Read pages into the page cache in the background
+ *
+ * @param inode The inode, a reference is held until the readahead completes
+ * @param pgoff The first page offset to read
+ * @param npages Number of pages to read
+ */
+void pagecache_readahead_async(inode_t *inode, off_t pgoff, size_t npages);
+
+/**
+ * @brief Write back the remaining dirty pages of a superblock and stop its writeback thread.
+ * @note Called on unmount, the thread no longer uses the superblock once this returns.
+ */
+void pagecache_writeback_stop(superblock_t *sb);
+
+typedef struct
+{
+    atomic_t hits;             ///< lookups that found the page in the cache
+    atomic_t misses;           ///< lookups that had to fill the page
+    atomic_t reclaimed;        ///< pages evicted from the cache
+    atomic_t dirty;            ///< dirty pages waiting to be written back
+    atomic_t writeback;        ///< pages being written back
+    atomic_t written;          ///< pages written back
+    atomic_t throttled;        ///< writes that had to write back pages because too much memory was dirty
+    atomic_t faults;           ///< file-backed page faults handled
+    atomic_t fault_around;     ///< cached pages mapped around a faulting page
+    atomic_t readahead_queued; ///< pages queued for asynchronous readahead
+    atomic_t readahead_filled; ///< pages read into the page cache by the readahead thread
+    atomic_t readahead_sync;   ///< pages read ahead synchronously, together with the requested ones
+} pagecache_stat_t;
+
+extern pagecache_stat_t pagecache_stat;
+
+/**
+ * @brief Read from the page cache
+ *
+ * @param ra The readahead state of the open file, or NULL to read only the requested pages
+ */
+ssize_t vfs_read_pagecache(inode_cache_t *icache, void *buf, size_t size, off_t offset, file_ra_state_t *ra);
 ssize_t vfs_write_pagecache(inode_cache_t *icache, const void *buf, size_t total_size, off_t offset);
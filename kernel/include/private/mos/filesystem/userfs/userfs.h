@@ -12,6 +12,7 @@ typedef struct
     filesystem_t fs;               ///< The filesystem, "userfs.<name>".
     const char *rpc_server_name;   ///< The name of the RPC server.
     rpc_server_stub_t *rpc_server; ///< The RPC server stub, if connected.
+    pid_t server_pid;              ///< The process serving the filesystem, page grants are only taken from it.
 } userfs_t;
 
 /**
@@ -84,6 +84,15 @@ file_t *vfs_openat(int fd, const char *path, open_flags flags);
  */
 long vfs_fstatat(fd_t fd, const char *path, file_stat_t *restrict stat, fstatat_flags flags);
 
+/**
+ * @brief Write the cached data of a file back to the underlying storage
+ *
+ * @param io The open file
+ * @param sync_metadata Also write back the inode's metadata, false for fdatasync
+ * @return long 0 on success, or errno on failure
+ */
+long vfs_fsync(io_t *io, bool sync_metadata);
+
 /**
  * @brief Read a symbolic link
  *
@@ -5,6 +5,7 @@
 #include "mos/mm/mm.h"
 #include "mos/mm/physical/pmm.h"
 #include "mos/mm/slab.h"
+#include "mos/tasks/wait.h"
 
 #include <abi-bits/stat.h>
 #include <mos/filesystem/fs_types.h>
@@ -12,6 +13,7 @@
 #include <mos/io/io_types.h>
 #include <mos/lib/structures/hashmap.h>
 #include <mos/lib/structures/list.h>
+#include <mos/lib/structures/radix_tree.h>
 #include <mos/lib/structures/tree.h>
 #include <mos/lib/sync/spinlock.h>
 #include <mos/platform/platform.h>
@@ -27,28 +29,38 @@ typedef struct _file file_t;
 
 typedef struct
 {
-    as_linked_list;
-    ino_t ino;
-    const char *name;
-    size_t name_len;
-    file_type_t type;
-} vfs_listdir_entry_t;
+    // the buffer of the current vfs_list_dir call, entries are written to it directly
+    char *buf;
+    size_t buf_size;
+    size_t buf_used;
+    bool buf_full; ///< an entry didn't fit, continue with it in the next call
 
-typedef struct
-{
-    list_head entries;
-    size_t n_count;     ///< number of entries in the list
-    size_t read_offset; ///< user has read up to this offset, start from this offset when reading more entries
+    u8 n_dots;  ///< how many of "." and ".." have been listed
+    off_t pos;  ///< position of the next entry, as given by the filesystem's readdir, 0 for the first entry
+    bool eof;   ///< the filesystem has listed all entries
+
+    // for filesystems that can't continue from a position, all entries are listed on the first
+    // call into a contiguous buffer of dirent records, which later calls copy from
+    bool buffered;
+    char *arena;
+    size_t arena_size;
+    size_t arena_used;
+    size_t read_offset; ///< user has read up to this offset of the arena
 } vfs_listdir_state_t;
 
 typedef void(dentry_iterator_op)(vfs_listdir_state_t *state, u64 ino, const char *name, size_t name_len, file_type_t type);
 
+/// emit a directory entry, @p next is the position of the entry after it, returns false if the entry doesn't fit and the listing should stop
+typedef bool(dentry_readdir_op)(vfs_listdir_state_t *state, u64 ino, const char *name, size_t name_len, file_type_t type, off_t next);
+
 typedef struct
 {
     /// create a hard link
     bool (*hardlink)(dentry_t *old_dentry, inode_t *dir, dentry_t *new_dentry);
     /// iterate over the contents of a directory
     void (*iterate_dir)(dentry_t *dentry, vfs_listdir_state_t *iterator_state, dentry_iterator_op op);
+    /// list a directory starting at iterator_state->pos until op returns false, return false if it can't be listed from there
+    bool (*readdir)(dentry_t *dentry, vfs_listdir_state_t *iterator_state, dentry_readdir_op op);
     /// lookup a file in a directory, if it's unset for a directory, the VFS will use the default lookup
     bool (*lookup)(inode_t *dir, dentry_t *dentry);
     /// create a new directory
@@ -84,6 +96,10 @@ typedef struct
 typedef struct
 {
     bool (*drop_inode)(inode_t *inode);
+    /// write the inode's metadata back to the underlying storage, optional
+    long (*sync_inode)(inode_t *inode);
+    /// change the size of a file in the underlying storage, optional
+    long (*truncate)(inode_t *inode, size_t size);
 } superblock_ops_t;
 
 typedef struct _superblock
@@ -93,6 +109,15 @@ typedef struct _superblock
     filesystem_t *fs;
     list_head mounts;
     superblock_ops_t *ops;
+
+    bool dentries_reclaimable; // unused dentries can be dropped, the filesystem looks them up again when needed
+    bool negative_dentries;    // failed lookups can be cached, nothing is created in a directory without the VFS knowing
+
+    spinlock_t writeback_lock;  // protects dirty_inodes
+    list_head dirty_inodes;     // inode_cache_t with pages to be written back, initialised on first use
+    thread_t *writeback_thread; // started when the first page of this superblock is dirtied
+    bool writeback_stop;        // set on unmount, the writeback thread writes back what is left and exits
+    bool writeback_exited;      // set by the writeback thread once it no longer uses the superblock
 } superblock_t;
 
 typedef struct _dentry
@@ -105,6 +130,10 @@ typedef struct _dentry
     superblock_t *superblock; // The root of the dentry tree
     bool is_mountpoint;
     void *private; // fs-specific data
+
+    u32 name_hash;         // hash of the name, for the dentry cache
+    list_node_t hash_node; // in the dentry cache hash table, if the dentry has a parent
+    list_node_t lru_node;  // in the negative dentry LRU, if the dentry is a cached failed lookup
 } dentry_t;
 
 extern dentry_t *root_dentry;
@@ -123,6 +152,29 @@ typedef struct _inode_cache_ops
      */
     phyframe_t *(*fill_cache)(inode_cache_t *cache, off_t pgoff);
 
+    /**
+     * @brief Read up to npages pages starting at pgoff in one request, optional
+     *
+     * @return the number of pages read into pages[], 0 on error
+     */
+    size_t (*fill_cache_pages)(inode_cache_t *cache, off_t pgoff, size_t npages, phyframe_t **pages);
+
+    /**
+     * @brief Write a dirty page back to the underlying storage, optional
+     * @note Without it, dirty pages are kept in memory until the inode is dropped.
+     *
+     * @return 0 on success, or a negative errno
+     */
+    long (*flush_page)(inode_cache_t *cache, off_t pgoff, phyframe_t *page);
+
+    /**
+     * @brief Write npages consecutive dirty pages starting at pgoff back in one request, optional
+     * @note If set, it is used instead of flush_page.
+     *
+     * @return 0 on success, or a negative errno (all pages are then considered not written)
+     */
+    long (*flush_pages)(inode_cache_t *cache, off_t pgoff, size_t npages, phyframe_t **pages);
+
     bool (*page_write_begin)(inode_cache_t *cache, off_t file_offset, size_t inpage_size, phyframe_t **page_out, void **private);
     void (*page_write_end)(inode_cache_t *cache, off_t file_offset, size_t inpage_size, phyframe_t *page, void *private);
 } inode_cache_ops_t;
@@ -130,7 +182,10 @@ typedef struct _inode_cache_ops
 typedef struct _inode_cache
 {
     inode_t *owner;
-    hashmap_t pages; // page index -> phyframe_t *
+    spinlock_t lock;              // protects pages
+    radix_tree_t pages;           // page index -> pagecache_entry_t *
+    list_node_t dirty_node;       // in the superblock's dirty_inodes, holds a reference to the inode
+    waitlist_t writeback_waiters; // flushers waiting for pages that someone else is writing back
     const inode_cache_ops_t *ops;
 } inode_cache_t;
 
@@ -177,12 +232,24 @@ typedef struct _mount
     filesystem_t *fs;
 } mount_t;
 
+typedef struct
+{
+    spinlock_t lock;   ///< protects this state, and the file's mmap fault readahead state
+    off_t prev_pgoff;  ///< the last page read
+    off_t start;       ///< first page of the current readahead window
+    size_t size;       ///< number of pages in the current window, 0 if there is none
+    size_t async_size; ///< the next window is started when a read reaches this many pages before the end of the window
+} file_ra_state_t;
+
 typedef struct _file
 {
     io_t io; // refcount is tracked by the io_t
     dentry_t *dentry;
     spinlock_t offset_lock; // protects the offset field
     size_t offset;          // tracks the current position in the file
+    off_t fault_prev_pgoff; // page offset of the last mmap fault, for sequential access detection, protected by ra.lock
+    off_t fault_ra_end;     // end (in pages) of the last readahead window started by mmap faults, protected by ra.lock
+    file_ra_state_t ra;     // readahead state for reads
     void *private_data;
 } file_t;
 
@@ -19,6 +19,16 @@ inode_t *inode_create(superblock_t *sb, u64 ino, file_type_t type);
  */
 dentry_t *dentry_create(superblock_t *sb, dentry_t *parent, const char *name);
 
+/**
+ * @brief Same as dentry_create(), with a name that is not necessarily null-terminated
+ */
+dentry_t *dentry_create_n(superblock_t *sb, dentry_t *parent, const char *name, size_t name_len);
+
+/**
+ * @brief Free a dentry that has no inode, children or references, and detach it from its parent
+ */
+void dentry_destroy(dentry_t *dentry);
+
 ssize_t vfs_generic_read(const file_t *file, void *buf, size_t size, off_t offset);
 ssize_t vfs_generic_write(const file_t *file, const void *buf, size_t size, off_t offset);
 ssize_t vfs_generic_lseek(const file_t *file, off_t offset, int whence);
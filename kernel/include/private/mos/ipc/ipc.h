@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <mos/types.h>
 #include <stddef.h>
 
 typedef struct _ipc ipc_t;
@@ -13,6 +14,14 @@ ipc_server_t *ipc_server_create(const char *name, size_t max_pending_connections
 
 ipc_server_t *ipc_get_server(const char *name);
 
+/**
+ * @brief Get the process that created an IPC server
+ *
+ * @param name The name of the server
+ * @return pid_t The pid of the server's creator, or 0 if there is no such server
+ */
+pid_t ipc_get_server_owner(const char *name);
+
 ipc_t *ipc_server_accept(ipc_server_t *server);
 
 void ipc_server_close(ipc_server_t *server);
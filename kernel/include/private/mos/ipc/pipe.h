@@ -10,12 +10,15 @@
 typedef struct
 {
     u32 magic;
-    waitlist_t waitlist; ///< for both reader and writer, only one party can wait on the pipe at a time
-    spinlock_t lock;     ///< protects the buffer_pos (and thus the buffer)
+    waitlist_t readers;  ///< readers waiting for data
+    waitlist_t writers;  ///< writers waiting for space in the buffer
+    spinlock_t lock;     ///< serialises the readers and the writers, so that buffer_pos has a single producer and a single consumer
     bool other_closed;   ///< true if the other end of the pipe has been closed
+    size_t reader_wants; ///< bytes of data the blocked readers wait for (the smallest), 0 if none is blocked
+    size_t writer_wants; ///< bytes of free space the blocked writers wait for (the smallest), 0 if none is blocked
     void *buffers;
     size_t buffer_npages;
-    ring_buffer_pos_t buffer_pos;
+    ring_buffer_spsc_t buffer_pos;
 } pipe_t;
 
 pipe_t *pipe_create(size_t bufsize);
@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/moslib_global.h>
+#include <mos/types.h>
+
+/**
+ * @defgroup avl_tree libs.AVLTree
+ * @ingroup libs
+ * @brief An intrusive, self-balancing binary search tree, with optional augmented data.
+ *
+ * @details The tree keeps track of the parent of each node, so that a node can be removed (or
+ * have its augmented data updated) without searching for it again.
+ *
+ * Augmented data (e.g. the maximum value in a subtree) is maintained by an @ref avl_augment_t
+ * callback, which is called whenever the children of a node change, from the bottom to the top.
+ * @{
+ */
+
+typedef struct avl_node avl_node_t;
+
+typedef struct avl_node
+{
+    avl_node_t *left, *right, *parent;
+    s32 height;
+} avl_node_t;
+
+typedef struct
+{
+    avl_node_t *root;
+} avl_tree_t;
+
+/**
+ * @brief Embed an AVL tree node into a struct
+ */
+#define as_avl_node avl_node_t avl_node
+
+#define avl_entry(node, type) container_of((node), type, avl_node)
+#define avl_node(element)     (&((element)->avl_node))
+
+/**
+ * @brief Compare two nodes, returns negative if a < b, positive if a > b
+ */
+typedef int (*avl_compare_t)(const avl_node_t *a, const avl_node_t *b);
+
+/**
+ * @brief Recompute the augmented data of a node from itself and its (already up-to-date) children
+ */
+typedef void (*avl_augment_t)(avl_node_t *node);
+
+MOSAPI void avl_insert(avl_tree_t *tree, avl_node_t *node, avl_compare_t compare, avl_augment_t augment);
+MOSAPI void avl_remove(avl_tree_t *tree, avl_node_t *node, avl_augment_t augment);
+
+/**
+ * @brief Update the augmented data of a node and all its ancestors, after the node has changed.
+ *
+ * @note The change must not affect the order of the node in the tree.
+ */
+MOSAPI void avl_propagate(avl_node_t *node, avl_augment_t augment);
+
+MOSAPI avl_node_t *avl_first(const avl_tree_t *tree);
+MOSAPI avl_node_t *avl_last(const avl_tree_t *tree);
+MOSAPI avl_node_t *avl_next(const avl_node_t *node);
+MOSAPI avl_node_t *avl_prev(const avl_node_t *node);
+
+/** @} */
@@ -9,7 +9,18 @@
 /**
  * @defgroup libs_hashmap libs.HashMap
  * @ingroup libs
- * @brief A simple hashmap.
+ * @brief An open-addressing hashmap with Robin Hood probing.
+ *
+ * @details Entries are stored in a power-of-two array of slots, each entry as close as possible
+ * to the slot its hash points to: on insertion, an entry that has probed further than the one
+ * occupying a slot takes that slot, and the displaced entry continues probing. This keeps the
+ * probe sequences short and even, and a lookup can stop as soon as it reaches an entry closer to
+ * its home slot than the key would be. The table doubles when it is 7/8 full.
+ *
+ * Modifications are serialised by the map's spinlock. Tables replaced by a larger one are kept
+ * until the map is deinitialised, so that hashmap_foreach() and hashmap_get_lockless(), which
+ * don't take the lock, never read freed memory. Both retry a read that overlapped a modification
+ * (see hashmap_t::seq), so they never see the key of one entry with the value of another.
  * @{
  */
 
@@ -22,12 +33,13 @@ typedef struct hashmap_entry hashmap_entry_t;
 typedef struct _hashmap
 {
     s32 magic;
-    hashmap_entry_t **entries;
-    size_t capacity;
-    size_t size;
+    hashmap_entry_t *entries; ///< the slots, a power of two of them
+    size_t capacity;          ///< the number of slots, grows as entries are added
+    size_t size;              ///< the number of entries
     hashmap_hash_t hash_func;
     hashmap_key_compare_t key_compare_func;
     spinlock_t lock;
+    u32 seq;                  ///< odd while the map is being modified, see hashmap_get_lockless()
 } hashmap_t;
 
 MOSAPI void hashmap_init(hashmap_t *map, size_t capacity, hashmap_hash_t hash_func, hashmap_key_compare_t compare_func);
@@ -37,6 +49,24 @@ MOSAPI void *hashmap_put(hashmap_t *map, uintn key, void *value);
 MOSAPI void *hashmap_get(hashmap_t *map, uintn key);
 MOSAPI void *hashmap_remove(hashmap_t *map, uintn key);
 
+/**
+ * @brief Look up a key without taking the map's lock.
+ *
+ * @details The lookup is retried if the map is modified while it runs, so it only returns a value
+ * that was in the map at some point during the call.
+ *
+ * @warning Keys in the middle of being moved or removed may be passed to the hash and compare
+ * functions, so this is only for maps whose keys are not pointers to memory that can be freed
+ * (e.g. maps using hashmap_identity_hash() and hashmap_simple_key_compare()).
+ */
+MOSAPI void *hashmap_get_lockless(hashmap_t *map, uintn key);
+
+/**
+ * @brief Call a function for every entry, without taking the map's lock
+ *
+ * @details Each entry is read consistently, but an entry inserted or moved during the walk may
+ * be missed or seen twice. The callback may modify the map.
+ */
 MOSAPI void hashmap_foreach(hashmap_t *map, hashmap_foreach_func_t func, void *data);
 
 /** @} */
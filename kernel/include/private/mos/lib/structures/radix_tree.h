@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/moslib_global.h>
+#include <mos/types.h>
+
+/**
+ * @defgroup radix_tree libs.RadixTree
+ * @ingroup libs
+ * @brief A radix tree mapping integer indices to pointers, with per-entry tags.
+ *
+ * @details Each node has 64 slots, so a tree grows one level for every 6 bits of the largest
+ * index it holds, and dense ranges (e.g. the pages of a file) share their nodes. Every node also
+ * keeps one bitmap per tag, in which a bit is set if the slot (or anything below it) is tagged,
+ * so that tagged entries can be found without visiting untagged subtrees.
+ *
+ * Modifications must be serialised by the user. Slots and nodes are published with release
+ * stores, and read with acquire loads, so that a lookup never observes a half-initialised node.
+ * Empty nodes are freed on deletion though, so lookups still have to be serialised against
+ * deletions (by the same lock, or by deferring the deletion until no lookup can be in progress).
+ * @{
+ */
+
+#define RADIX_TREE_MAP_SHIFT 6
+#define RADIX_TREE_MAP_SIZE  (1ul << RADIX_TREE_MAP_SHIFT)
+#define RADIX_TREE_MAP_MASK  (RADIX_TREE_MAP_SIZE - 1)
+#define RADIX_TREE_MAX_TAGS  2
+
+typedef struct radix_tree_node radix_tree_node_t;
+
+typedef struct radix_tree_node
+{
+    u8 shift;                       ///< the number of index bits below this node
+    u8 offset;                      ///< the slot in the parent that points to this node
+    u8 count;                       ///< number of non-NULL slots
+    radix_tree_node_t *parent;      ///< NULL for the root node
+    void *slots[RADIX_TREE_MAP_SIZE];
+    u64 tags[RADIX_TREE_MAX_TAGS];  ///< bit n is set if slot n is tagged, or has tagged entries below it
+} radix_tree_node_t;
+
+typedef struct
+{
+    radix_tree_node_t *root; ///< NULL for an empty tree
+    size_t count;            ///< number of entries in the tree
+} radix_tree_t;
+
+#define RADIX_TREE_INIT { .root = NULL, .count = 0 }
+
+MOSAPI void radix_tree_init(radix_tree_t *tree);
+
+/**
+ * @brief Free all nodes of the tree, the entries themselves are not freed.
+ */
+MOSAPI void radix_tree_destroy(radix_tree_t *tree);
+
+MOSAPI void *radix_tree_lookup(const radix_tree_t *tree, u64 index);
+
+/**
+ * @brief Insert an entry into the tree.
+ *
+ * @return true if the entry is inserted, false if the index is already occupied or out of memory.
+ */
+MOSAPI bool radix_tree_insert(radix_tree_t *tree, u64 index, void *item);
+
+/**
+ * @brief Remove an entry (and all its tags) from the tree.
+ *
+ * @return void* The removed entry, or NULL if there is no entry at the index.
+ */
+MOSAPI void *radix_tree_delete(radix_tree_t *tree, u64 index);
+
+MOSAPI void radix_tree_tag_set(radix_tree_t *tree, u64 index, u32 tag);
+MOSAPI void radix_tree_tag_clear(radix_tree_t *tree, u64 index, u32 tag);
+MOSAPI bool radix_tree_tag_get(const radix_tree_t *tree, u64 index, u32 tag);
+
+/**
+ * @brief Check whether any entry in the tree has the given tag.
+ */
+MOSAPI bool radix_tree_tagged(const radix_tree_t *tree, u32 tag);
+
+/**
+ * @brief Find entries in ascending index order.
+ *
+ * @param tree The tree
+ * @param results Array to store the found entries
+ * @param indices Array to store the indices of the found entries, can be NULL
+ * @param first_index The index to start searching from
+ * @param max_items Maximum number of entries to return
+ * @return size_t Number of entries found
+ */
+MOSAPI size_t radix_tree_gang_lookup(const radix_tree_t *tree, void **results, u64 *indices, u64 first_index, size_t max_items);
+
+/**
+ * @brief Find entries with the given tag in ascending index order, see @ref radix_tree_gang_lookup.
+ */
+MOSAPI size_t radix_tree_gang_lookup_tag(const radix_tree_t *tree, void **results, u64 *indices, u64 first_index, size_t max_items, u32 tag);
+
+/** @} */
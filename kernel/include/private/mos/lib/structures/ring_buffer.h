@@ -79,4 +79,35 @@ should_inline size_t ring_buffer_push_back_byte(ring_buffer_t *buffer, u8 byte)
 should_inline u8 ring_buffer_pop_back_byte(ring_buffer_t *buffer) { return ring_buffer_pos_pop_back_byte(buffer->data, &buffer->pos); }
 should_inline u8 ring_buffer_pop_front_byte(ring_buffer_t *buffer) { return ring_buffer_pos_pop_front_byte(buffer->data, &buffer->pos); }
 // clang-format on
+
+/**
+ * @brief A position-only ring buffer with a power-of-two capacity.
+ *
+ * @details head and tail count the bytes ever popped and pushed. They are never wrapped, so the
+ * number of bytes in the buffer is always tail - head (even after the counters overflow), and the
+ * offset of a byte in the buffer is its counter masked by capacity - 1. A push or pop copies at
+ * most two segments, the one up to the end of the buffer and the one from its start.
+ *
+ * A single producer and a single consumer may use the buffer at the same time without a lock:
+ * each of them only writes its own counter, and publishes it with a release store after copying
+ * the data, so the other side never sees the counter before the bytes. With more than one
+ * producer (or consumer), they must be serialised against each other.
+ */
+typedef struct _ring_buffer_spsc
+{
+    size_t capacity; ///< a power of two
+    size_t head;     ///< the number of bytes popped, only written by the consumer
+    size_t tail;     ///< the number of bytes pushed, only written by the producer
+} ring_buffer_spsc_t;
+
+MOSAPI void ring_buffer_spsc_init(ring_buffer_spsc_t *ring, size_t capacity);
+MOSAPI size_t ring_buffer_spsc_push(u8 *buffer, ring_buffer_spsc_t *ring, const u8 *data, size_t size);
+MOSAPI size_t ring_buffer_spsc_pop(u8 *buffer, ring_buffer_spsc_t *ring, u8 *buf, size_t size);
+
+// clang-format off
+should_inline size_t ring_buffer_spsc_used(const ring_buffer_spsc_t *ring) { return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE); }
+should_inline bool ring_buffer_spsc_is_empty(const ring_buffer_spsc_t *ring) { return ring_buffer_spsc_used(ring) == 0; }
+should_inline bool ring_buffer_spsc_is_full(const ring_buffer_spsc_t *ring) { return ring_buffer_spsc_used(ring) == ring->capacity; }
+should_inline size_t ring_buffer_spsc_push_byte(u8 *buffer, ring_buffer_spsc_t *ring, u8 data) { return ring_buffer_spsc_push(buffer, ring, &data, 1); }
+// clang-format on
 /** @} */
@@ -6,6 +6,7 @@
 #include "mos/mm/physical/pmm.h"
 #include "mos/platform/platform.h"
 
+#include <mos/lib/structures/avl_tree.h>
 #include <mos/lib/structures/list.h>
 #include <mos/lib/sync/spinlock.h>
 #include <mos/mm/mm_types.h>
@@ -57,6 +58,7 @@ typedef vmfault_result_t (*vmfault_handler_t)(vmap_t *vmap, ptr_t fault_addr, pa
 typedef struct _vmap
 {
     as_linked_list;
+    as_avl_node;
     spinlock_t lock;
 
     ptr_t vaddr; // virtual addresses
@@ -64,15 +66,22 @@ typedef struct _vmap
     vm_flags vmflags; // the expected flags for the region, regardless of the copy-on-write state
     mm_context_t *mmctx;
 
-    io_t *io;        // the io object that (possibly) backs this vmap
-    off_t io_offset; // the offset in the io object, page-aligned
+    io_t *io;           // the io object that (possibly) backs this vmap
+    off_t io_offset;    // the offset in the io object, page-aligned
+    bool io_pages_only; // all mapped pages come from the io's page cache (no private copies), so they can be refaulted
 
     vmap_content_t content;
     vmap_type_t type;
     vmap_stat_t stat;
     vmfault_handler_t on_fault;
+
+    // augmented data of the vmap tree, describes the subtree rooted at this vmap
+    ptr_t subtree_start, subtree_end;
+    size_t subtree_max_gap; ///< the largest gap between two vmaps in the subtree, in bytes
 } vmap_t;
 
+#define vmap_end(vmap) ((vmap)->vaddr + (vmap)->npages * MOS_PAGE_SIZE)
+
 #define pfn_va(pfn)        ((ptr_t) (platform_info->direct_map_base + (pfn) * (MOS_PAGE_SIZE)))
 #define va_pfn(va)         ((((ptr_t) (va)) - platform_info->direct_map_base) / MOS_PAGE_SIZE)
 #define va_phyframe(va)    (&phyframes[va_pfn(va)])
@@ -82,6 +91,7 @@ typedef struct _vmap
 phyframe_t *mm_get_free_page(void);
 phyframe_t *mm_get_free_page_raw(void);
 phyframe_t *mm_get_free_pages(size_t npages);
+void mm_copy_page(const phyframe_t *src, const phyframe_t *dst);
 
 #define mm_free_page(frame)          pmm_free_frames(frame, 1)
 #define mm_free_pages(frame, npages) pmm_free_frames(frame, npages)
@@ -139,6 +149,36 @@ void vmap_destroy(vmap_t *vmap);
  */
 vmap_t *vmap_obtain(mm_context_t *mmctx, ptr_t vaddr, size_t *out_offset);
 
+/**
+ * @brief Grow a vmap object in place, by extending its end address.
+ *
+ * @param vmap The vmap object, must be locked
+ * @param npages The number of pages to add
+ * @return true if the vmap has been grown, false if it would overlap with the next vmap.
+ * @note The mm_lock of the vmap's mm context must be held.
+ */
+bool vmap_grow(vmap_t *vmap, size_t npages);
+
+/**
+ * @brief Check if a range of the address space doesn't overlap with any vmap.
+ *
+ * @param mmctx The address space, its mm_lock must be held
+ * @param vaddr The starting virtual address of the range
+ * @param npages The number of pages in the range
+ */
+bool mm_is_range_free_locked(mm_context_t *mmctx, ptr_t vaddr, size_t npages);
+
+/**
+ * @brief Find the lowest free range of at least npages pages, starting at or after base_vaddr.
+ *
+ * @param mmctx The address space, its mm_lock must be held
+ * @param base_vaddr The lowest acceptable address
+ * @param npages The number of pages needed
+ * @param out_vaddr Receives the starting address of the free range
+ * @return true if such a range exists below the kernel, false otherwise.
+ */
+bool mm_find_free_range_locked(mm_context_t *mmctx, ptr_t base_vaddr, size_t npages, ptr_t *out_vaddr);
+
 /**
  * @brief Split a vmap object into two, at the specified offset.
  *
@@ -158,6 +198,15 @@ vmap_t *vmap_split(vmap_t *vmap, size_t split);
  */
 vmap_t *vmap_split_for_range(vmap_t *vmap, size_t rstart_pgoff, size_t rend_pgoff);
 
+/**
+ * @brief Split the transparent huge pages overlapping a range of a vmap into 4K pages.
+ *
+ * @param vmap The vmap object, either it or its mm context must be locked
+ * @param vaddr The starting virtual address of the range
+ * @param npages The number of pages in the range
+ */
+void vmap_split_huge_pages(vmap_t *vmap, ptr_t vaddr, size_t npages);
+
 /**
  * @brief Finalize the initialization of a vmap object.
  *
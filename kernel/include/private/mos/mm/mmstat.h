@@ -56,15 +56,23 @@ void mmstat_dec(mmstat_type_t type, size_t size);
  *                  zero page is mapped
  *      Written     regular++, cow--,
  *      Forked      cow += regular, regular = 0 (regular pages now becomes cow pages)
+ *      Huge        regular += 512, thp++ (a whole 2 MiB range is faulted in at once)
+ *                  thp-- when the huge page is split into 4K pages (partial munmap, mprotect, fork)
  *  Shared Anonymous:
  *      NOT IMPLEMENTED (yet)
  *
+ *  CoW write faults are also counted as events: cow_copied if the page had to be copied,
+ *  cow_reused if the mapping was the sole owner of the frame and it was made writable in place.
+ *
  */
 typedef struct
 {
-    size_t regular;   ///< regular pages with no special flags being set or unset
-    size_t pagecache; ///< pages that are in the page cache (file-backed only)
-    size_t cow;       ///< pages that are copy-on-write
+    size_t regular;    ///< regular pages with no special flags being set or unset
+    size_t pagecache;  ///< pages that are in the page cache (file-backed only)
+    size_t cow;        ///< pages that are copy-on-write
+    size_t thp;        ///< transparent huge pages, each of them is also counted as regular pages
+    size_t cow_copied; ///< CoW write faults resolved by copying the page
+    size_t cow_reused; ///< CoW write faults resolved by reusing the (no longer shared) page
 } vmap_stat_t;
 
 #define vmap_stat_inc(vmap, type) (vmap)->stat.type += 1
@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include "mos/mm/mm.h"
+#include "mos/mm/physical/pmm.h"
+#include "mos/tasks/task_types.h"
+
+/**
+ * @defgroup page_grant kernel.mm.page_grant
+ * @brief Hand pages filled by a userspace process over to the kernel, without copying them.
+ *
+ * @details A process (e.g. a userspace filesystem server) grants one of its pages, and sends the
+ * returned handle to the kernel instead of the data. The granted frame is removed from the
+ * process, which sees a fresh zero page at the same address from then on, so the kernel is the
+ * only owner of the frame once it takes the grant.
+ *
+ * A grant belongs to the process that made it: only a taker that expects pages from that process
+ * (e.g. the userfs client of its server) can take it. A process can have at most
+ * MOS_MM_PAGE_GRANT_MAX grants that are not taken yet, and they are released when it exits.
+ * @{
+ */
+
+/**
+ * @brief Grant a page of a process to the kernel
+ *
+ * @param process The granting process, usually the current one
+ * @param vaddr The page-aligned address of a private, writable page that is not shared with
+ * any other address space
+ * @return u64 The grant handle, or 0 if the page cannot be granted or the process has too many grants
+ */
+u64 page_grant_create(process_t *process, ptr_t vaddr);
+
+/**
+ * @brief Take over a granted page, a grant can only be taken once
+ *
+ * @param handle The grant handle
+ * @param owner The process the grant is expected to come from
+ * @return phyframe_t* The page, holding the grant's reference, or NULL if there is no such grant
+ * made by @p owner
+ */
+phyframe_t *page_grant_take(u64 handle, pid_t owner);
+
+/**
+ * @brief Drop all grants of an exiting process that have not been taken
+ *
+ * @param process The process
+ */
+void page_grant_release_all(process_t *process);
+
+/** @} */
@@ -89,6 +89,16 @@ void mm_replace_page_locked(mm_context_t *mmctx, ptr_t vaddr, pfn_t pfn, vm_flag
  */
 vmap_t *mm_clone_vmap_locked(vmap_t *src_vmap, mm_context_t *dst_ctx);
 
+/**
+ * @brief Clone a vmap into another paging context, without copying any page mappings.
+ *
+ * @param src_vmap The source vmap, whose pages must all be refaultable (see vmap_t::io_pages_only)
+ * @param dst_ctx The destination paging context
+ *
+ * @details The pages are faulted in from the backing io on first access in the destination context.
+ */
+vmap_t *mm_clone_vmap_lazy_locked(vmap_t *src_vmap, mm_context_t *dst_ctx);
+
 /**
  * @brief Get if a virtual address is mapped in a page table.
  *
@@ -13,3 +13,11 @@ pml2e_t *pml2_entry(pml2_t pml2, ptr_t vaddr);
 bool pml2e_is_present(const pml2e_t *pml2e);
 
 pml1_t pml2e_get_or_create_pml1(pml2e_t *pml2e);
+
+#if MOS_CONFIG(PML2_HUGE_CAPABLE)
+/**
+ * @brief Split a huge pml2 entry into a pml1 table of 4K pages, keeping the flags and the mapped frames.
+ * @note The range starting at @p vaddr is only invalidated in this CPU's TLB.
+ */
+void pml2e_split_huge(pml2e_t *pml2e, ptr_t vaddr);
+#endif
@@ -12,3 +12,10 @@ void mm_do_mask_flags(pgd_t max, ptr_t vaddr, size_t n_pages, vm_flags to_remove
 void mm_do_copy(pgd_t src, pgd_t dst, ptr_t vaddr, size_t n_pages);
 pfn_t mm_do_get_pfn(pgd_t top, ptr_t vaddr);
 vm_flags mm_do_get_flags(pgd_t max, ptr_t vaddr);
+
+#if MOS_CONFIG(PML2_HUGE_CAPABLE)
+bool mm_do_can_map_huge(pgd_t top, ptr_t vaddr);
+bool mm_do_map_huge(pgd_t top, ptr_t vaddr, pfn_t pfn, vm_flags flags);
+size_t mm_do_split_huge(pgd_t top, ptr_t vaddr, size_t n_pages);
+size_t mm_do_count_huge(pgd_t top, ptr_t vaddr, size_t n_pages);
+#endif
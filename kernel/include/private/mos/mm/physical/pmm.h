@@ -95,6 +95,25 @@ void pmm_init(size_t max_frames);
 phyframe_t *pmm_allocate_frames(size_t n_frames, pmm_allocation_flags_t flags);
 void pmm_free_frames(phyframe_t *start_frame, size_t n_pages);
 
+typedef enum
+{
+    PMM_WATERMARK_LOW,  ///< below this, the page cache starts to be reclaimed
+    PMM_WATERMARK_HIGH, ///< reclaim stops once this much memory is free again
+} pmm_watermark_t;
+
+/**
+ * @brief Get the number of frames that are neither allocated nor reserved.
+ */
+size_t pmm_get_free_frames(void);
+
+/**
+ * @brief Check whether the amount of free memory is below a watermark.
+ *
+ * @param watermark The watermark to check.
+ * @return true if fewer frames than the watermark are free.
+ */
+bool pmm_below_watermark(pmm_watermark_t watermark);
+
 /**
  * @brief Mark a range of physical memory as reserved.
  *
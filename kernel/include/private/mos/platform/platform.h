@@ -7,6 +7,7 @@
 #include "mos/mm/physical/pmm.h"
 #include "mos/platform/platform_defs.h"
 
+#include <mos/lib/structures/avl_tree.h>
 #include <mos/lib/structures/list.h>
 #include <mos/lib/sync/spinlock.h>
 #include <mos/mm/mm_types.h>
@@ -32,6 +33,7 @@
 typedef void (*irq_handler)(u32 irq);
 
 typedef struct _thread thread_t;
+typedef struct _vmap vmap_t;
 
 typedef enum
 {
@@ -99,9 +101,11 @@ typedef struct
 
 typedef struct
 {
-    spinlock_t mm_lock; ///< protects [pgd] and the [mmaps] list (the list itself, not the vmap_t objects)
+    spinlock_t mm_lock; ///< protects [pgd], the [mmaps] list and the [vmap_tree] (the containers themselves, not the vmap_t objects)
     pgd_t pgd;
-    list_head mmaps;
+    list_head mmaps;       ///< all vmaps, sorted by address
+    avl_tree_t vmap_tree;  ///< all vmaps, indexed by address range
+    vmap_t *heap;          ///< the (lowest) heap vmap, if any
 } mm_context_t;
 
 typedef struct _platform_regs platform_regs_t;
@@ -247,6 +251,7 @@ pfn_t platform_pml4e_get_huge_pfn(const pml4e_t *pml4);
 void platform_context_setup_main_thread(thread_t *thread, ptr_t entry, ptr_t sp, int argc, ptr_t argv, ptr_t envp);
 void platform_context_setup_child_thread(thread_t *thread, thread_entry_t entry, void *arg);
 void platform_context_clone(const thread_t *from, thread_t *to);
+void platform_context_cleanup(thread_t *thread);
 
 // Platform Context Switching APIs
 void platform_switch_mm(const mm_context_t *new_mm);
@@ -0,0 +1,21 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/types.h>
+
+#define KSTACK_SIZE (MOS_STACK_PAGES_KERNEL * MOS_PAGE_SIZE)
+
+/**
+ * @brief Allocate a kernel stack, from the per-CPU cache if possible
+ *
+ * @return ptr_t The lowest address of the stack, which is KSTACK_SIZE bytes large
+ */
+ptr_t kstack_allocate(void);
+
+/**
+ * @brief Free a kernel stack, it's kept in the per-CPU cache if there's room
+ *
+ * @param stack The lowest address of the stack, as returned by kstack_allocate()
+ */
+void kstack_free(ptr_t stack);
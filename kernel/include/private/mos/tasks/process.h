@@ -45,4 +45,18 @@ void process_dump_mmaps(const process_t *process);
 bool process_register_signal_handler(process_t *process, signal_t sig, const sigaction_t *sigaction);
 
 process_t *process_do_fork(process_t *process);
+
+/**
+ * @brief Create a child process that borrows the parent's mm until it execs or exits.
+ *
+ * @details The calling thread is suspended until then, the child must not return from the function that called vfork.
+ */
+process_t *process_do_vfork(process_t *process);
+
+/**
+ * @brief Give the borrowed mm of a vfork child back to its parent, and resume the parent.
+ *
+ * @details The child continues with its own (empty) mm.
+ */
+void process_vfork_release(process_t *process);
 long process_do_execveat(process_t *process, fd_t dirfd, const char *path, const char *const argv[], const char *const envp[], int flags);
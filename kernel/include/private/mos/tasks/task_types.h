@@ -54,10 +54,18 @@ typedef struct _process
 
     thread_t *main_thread;
     list_head threads;
+    spinlock_t threads_lock; ///< serialises reaping joined threads with exit and exec walking the thread list
+    bool threads_frozen;     ///< exit or exec is walking the thread list, joined threads are not reaped
 
     mm_context_t *mm;
     dentry_t *working_directory;
 
+    list_head page_grants; ///< pages granted by this process that have not been taken yet
+    size_t page_grants_n;  ///< number of entries in page_grants
+
+    process_t *vfork_parent; ///< (vfork) the parent whose mm is borrowed, until this process execs or exits
+    mm_context_t *vfork_mm;  ///< (vfork) the process's own mm, in use once the borrowed one is given back
+
     platform_process_options_t platform_options; ///< platform per-process flags
 
     process_signal_info_t signal_info; ///< signal handling info
@@ -81,6 +89,7 @@ typedef struct _thread
     spinlock_t state_lock;     ///< protects the thread state
     thread_state_t state;      ///< thread state
     downwards_stack_t u_stack; ///< user-mode stack
+    bool u_stack_explicit;     ///< the user-mode stack was provided by userspace, it's not freed with the thread
     downwards_stack_t k_stack; ///< kernel-mode stack
 
     platform_thread_options_t platform_options; ///< platform-specific thread options
@@ -23,4 +23,11 @@ thread_t *thread_complete_init(thread_t *thread);
 thread_t *thread_get(tid_t id);
 bool thread_wait_for_tid(tid_t tid);
 
+/**
+ * @brief Destroy a joined thread of the current process right away, so that its kernel stack goes
+ *        back to the cache instead of staying around until the process exits.
+ * @note Only for userspace joins, exit and exec destroy the threads they wait for themselves.
+ */
+void thread_try_reap(tid_t tid);
+
 noreturn void thread_handle_exit(thread_t *t);
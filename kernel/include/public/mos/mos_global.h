@@ -50,6 +50,7 @@
 
 #define asmlinkage    __attribute__((sysv_abi))
 #define should_inline __maybe_unused static inline
+#define must_inline   __attribute__((__always_inline__)) should_inline
 
 #define likely(x)   __builtin_expect(!!(x), 1)
 #define unlikely(x) __builtin_expect(!!(x), 0)
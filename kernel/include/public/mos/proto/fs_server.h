@@ -16,4 +16,11 @@ RPC_DEFINE_ENUMS(userfs_manager, USERFS_MANAGER, USERFS_MANAGER_X)
     PB(xarg, 1, readdir, READDIR, mos_rpc_fs_readdir_request, mos_rpc_fs_readdir_response)                                                                               \
     PB(xarg, 2, lookup, LOOKUP, mos_rpc_fs_lookup_request, mos_rpc_fs_lookup_response)                                                                                   \
     PB(xarg, 3, readlink, READLINK, mos_rpc_fs_readlink_request, mos_rpc_fs_readlink_response)                                                                           \
-    PB(xarg, 4, getpage, GETPAGE, mos_rpc_fs_getpage_request, mos_rpc_fs_getpage_response)
+    PB(xarg, 4, getpage, GETPAGE, mos_rpc_fs_getpage_request, mos_rpc_fs_getpage_response)                                                                               \
+    PB(xarg, 5, putpage, PUTPAGE, mos_rpc_fs_putpage_request, mos_rpc_fs_putpage_response)                                                                               \
+    PB(xarg, 6, create, CREATE, mos_rpc_fs_create_request, mos_rpc_fs_create_response)                                                                                   \
+    PB(xarg, 7, unlink, UNLINK, mos_rpc_fs_unlink_request, mos_rpc_fs_unlink_response)                                                                                   \
+    PB(xarg, 8, truncate, TRUNCATE, mos_rpc_fs_truncate_request, mos_rpc_fs_truncate_response)                                                                           \
+    PB(xarg, 9, setattr, SETATTR, mos_rpc_fs_setattr_request, mos_rpc_fs_setattr_response)                                                                               \
+    PB(xarg, 10, getpages, GETPAGES, mos_rpc_fs_getpages_request, mos_rpc_fs_getpages_response)                                                                          \
+    PB(xarg, 11, readdirplus, READDIRPLUS, mos_rpc_fs_readdirplus_request, mos_rpc_fs_readdirplus_response)
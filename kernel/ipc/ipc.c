@@ -50,6 +50,7 @@ typedef struct _ipc_server
 {
     as_linked_list;
     const char *name;
+    pid_t owner; ///< the process that created the server
     spinlock_t lock;
     inode_t *sysfs_ino; ///< inode for sysfs
     size_t pending_max, pending_n;
@@ -195,6 +196,7 @@ ipc_server_t *ipc_server_create(const char *name, size_t max_pending)
     linked_list_init(&server->established);
     waitlist_init(&server->server_waitlist);
     server->name = strdup(name);
+    server->owner = current_process->pid;
     server->pending_max = max_pending;
 
     // now announce the server
@@ -234,6 +236,22 @@ ipc_server_t *ipc_get_server(const char *name)
     return NULL;
 }
 
+pid_t ipc_get_server_owner(const char *name)
+{
+    pid_t owner = 0;
+    spinlock_acquire(&ipc_lock);
+    list_foreach(ipc_server_t, server, ipc_servers)
+    {
+        if (strcmp(server->name, name) == 0)
+        {
+            owner = server->owner;
+            break;
+        }
+    }
+    spinlock_release(&ipc_lock);
+    return owner;
+}
+
 ipc_t *ipc_server_accept(ipc_server_t *ipc_server)
 {
     pr_dinfo(ipc, "accepting connection on ipc server '%s'...", ipc_server->name);
@@ -2,7 +2,6 @@
 // abstract pipe implementation
 // A pipe is a buffer that only has a single reader and a single writer
 
-#include <limits.h>
 #define pr_fmt(fmt) "pipe: " fmt
 
 #include "mos/ipc/pipe.h"
@@ -26,6 +25,38 @@ SLAB_AUTOINIT("pipeio", pipeio_slab, pipeio_t);
 
 #define advance_buffer(buffer, bytes) ((buffer) = (void *) ((char *) (buffer) + (bytes)))
 
+// A blocked reader or writer is only woken once the other side has made enough progress for it
+// (the watermark): a reader once the data it waits for is there, a writer once a good part of
+// what it has left fits. Both are read and written under pipe->lock.
+//
+// A waiter sets its watermark and gets onto the waitlist before it releases pipe->lock, so the
+// other side, which decides whether to wake it under the same lock, either sees the watermark
+// and finds the waiter on the list, or has already made its progress before the waiter checked.
+//
+// Pipe ends can be shared (fork, dup), so several threads may wait on the same side: the
+// watermark is the smallest one of them, and it is cleared by whoever wakes them. As the whole
+// waitlist is woken, those who still have to wait set it again when they go back to sleep.
+
+static size_t pipe_reader_watermark(const pipe_t *pipe, size_t size)
+{
+    return MIN(size, pipe->buffer_pos.capacity);
+}
+
+static size_t pipe_writer_watermark(const pipe_t *pipe, size_t size)
+{
+    return MIN(size, pipe->buffer_pos.capacity / 2);
+}
+
+static bool pipe_should_wake_reader(const pipe_t *pipe)
+{
+    return pipe->reader_wants && ring_buffer_spsc_used(&pipe->buffer_pos) >= pipe->reader_wants;
+}
+
+static bool pipe_should_wake_writer(const pipe_t *pipe)
+{
+    return pipe->writer_wants && pipe->buffer_pos.capacity - ring_buffer_spsc_used(&pipe->buffer_pos) >= pipe->writer_wants;
+}
+
 size_t pipe_write(pipe_t *pipe, const void *buf, size_t size)
 {
     if (pipe->magic != PIPE_MAGIC)
@@ -50,16 +81,23 @@ size_t pipe_write(pipe_t *pipe, const void *buf, size_t size)
     size_t total_written = 0;
 
 retry_write:;
-    const size_t written = ring_buffer_pos_push_back(pipe->buffers, &pipe->buffer_pos, buf, size);
+    const size_t written = ring_buffer_spsc_push(pipe->buffers, &pipe->buffer_pos, buf, size);
     advance_buffer(buf, written), size -= written, total_written += written;
+    const bool wake_reader = pipe_should_wake_reader(pipe);
+    if (wake_reader)
+        pipe->reader_wants = 0; // all readers are woken below
 
     if (size > 0)
     {
         // buffer is full, wait for the reader to read some data
         pr_dinfo2(pipe, "%pt: pipe buffer full, waiting...", (void *) current_thread);
+        if (wake_reader)
+            waitlist_wake_all(&pipe->readers); // the buffer is full, that's enough for any reader
+        const size_t watermark = pipe_writer_watermark(pipe, size);
+        pipe->writer_wants = pipe->writer_wants ? MIN(pipe->writer_wants, watermark) : watermark;
+        MOS_ASSERT(waitlist_append(&pipe->writers));
         spinlock_release(&pipe->lock);
-        waitlist_wake(&pipe->waitlist, INT_MAX);              // wake up any readers that are waiting for data
-        MOS_ASSERT(reschedule_for_waitlist(&pipe->waitlist)); // wait for the reader to read some data
+        blocked_reschedule(); // wait for the reader to read some data
         spinlock_acquire(&pipe->lock);
 
         // check if the pipe is still valid
@@ -76,8 +114,8 @@ retry_write:;
 
     spinlock_release(&pipe->lock);
 
-    // wake up any readers that are waiting for data
-    waitlist_wake(&pipe->waitlist, INT_MAX);
+    if (wake_reader)
+        waitlist_wake_all(&pipe->readers);
     return total_written;
 }
 
@@ -97,34 +135,40 @@ size_t pipe_read(pipe_t *pipe, void *buf, size_t size)
     size_t total_read = 0;
 
 retry_read:;
-    const size_t read = ring_buffer_pos_pop_front(pipe->buffers, &pipe->buffer_pos, buf, size);
+    const size_t read = ring_buffer_spsc_pop(pipe->buffers, &pipe->buffer_pos, buf, size);
     advance_buffer(buf, read), size -= read, total_read += read;
+    const bool wake_writer = pipe_should_wake_writer(pipe);
+    if (wake_writer)
+        pipe->writer_wants = 0; // all writers are woken below
 
     if (size > 0)
     {
         // check if the pipe is still valid
-        if (pipe->other_closed && ring_buffer_pos_is_empty(&pipe->buffer_pos))
+        if (pipe->other_closed && ring_buffer_spsc_is_empty(&pipe->buffer_pos))
         {
             pr_dinfo2(pipe, "%pt: pipe closed", (void *) current_thread);
             spinlock_release(&pipe->lock);
-            waitlist_wake(&pipe->waitlist, INT_MAX);
             pr_dinfo2(pipe, "read %zu bytes", total_read);
             return total_read; // EOF
         }
 
         // buffer is empty, wait for the writer to write some data
         pr_dinfo2(pipe, "%pt: pipe buffer empty, waiting...", (void *) current_thread);
+        if (wake_writer)
+            waitlist_wake_all(&pipe->writers); // the buffer is empty, that's enough for any writer
+        const size_t watermark = pipe_reader_watermark(pipe, size);
+        pipe->reader_wants = pipe->reader_wants ? MIN(pipe->reader_wants, watermark) : watermark;
+        MOS_ASSERT(waitlist_append(&pipe->readers));
         spinlock_release(&pipe->lock);
-        waitlist_wake(&pipe->waitlist, INT_MAX);              // wake up any writers that are waiting for space in the buffer
-        MOS_ASSERT(reschedule_for_waitlist(&pipe->waitlist)); // wait for the writer to write some data
+        blocked_reschedule(); // wait for the writer to write some data
         spinlock_acquire(&pipe->lock);
         goto retry_read;
     }
 
     spinlock_release(&pipe->lock);
 
-    // wake up any writers that are waiting for space in the buffer
-    waitlist_wake(&pipe->waitlist, INT_MAX);
+    if (wake_writer)
+        waitlist_wake_all(&pipe->writers);
 
     pr_dinfo2(pipe, "read %zu bytes", total_read);
     return total_read;
@@ -145,7 +189,8 @@ bool pipe_close_one_end(pipe_t *pipe)
         spinlock_release(&pipe->lock);
 
         // wake up any readers/writers that are waiting for data/space in the buffer
-        waitlist_wake(&pipe->waitlist, INT_MAX);
+        waitlist_wake_all(&pipe->readers);
+        waitlist_wake_all(&pipe->writers);
         return false;
     }
     else
@@ -163,14 +208,19 @@ bool pipe_close_one_end(pipe_t *pipe)
 
 pipe_t *pipe_create(size_t bufsize)
 {
-    bufsize = ALIGN_UP_TO_PAGE(bufsize);
+    // the ring buffer needs a power-of-two size
+    size_t npages = 1;
+    while (npages * MOS_PAGE_SIZE < bufsize)
+        npages *= 2;
+    bufsize = npages * MOS_PAGE_SIZE;
 
     pipe_t *pipe = kmalloc(pipe_slab);
     pipe->magic = PIPE_MAGIC;
     pipe->buffer_npages = bufsize / MOS_PAGE_SIZE;
     pipe->buffers = (void *) phyframe_va(mm_get_free_pages(pipe->buffer_npages));
-    waitlist_init(&pipe->waitlist);
-    ring_buffer_pos_init(&pipe->buffer_pos, bufsize);
+    waitlist_init(&pipe->readers);
+    waitlist_init(&pipe->writers);
+    ring_buffer_spsc_init(&pipe->buffer_pos, bufsize);
     return pipe;
 }
 
@@ -6,6 +6,7 @@
 #include "mos/misc/power.h"
 #include "mos/mm/dma.h"
 #include "mos/mm/mm.h"
+#include "mos/mm/page_grant.h"
 #include "mos/tasks/signal.h"
 
 #include <bits/posix/iovec.h>
@@ -134,6 +135,15 @@ DEFINE_SYSCALL(pid_t, fork)(void)
     return child->pid; // return 0 for child, pid for parent
 }
 
+DEFINE_SYSCALL(pid_t, vfork)(void)
+{
+    process_t *parent = current_process;
+    process_t *child = process_do_vfork(parent);
+    if (unlikely(child == NULL))
+        return -1;
+    return child->pid; // return 0 for child, pid for parent
+}
+
 DEFINE_SYSCALL(pid_t, get_pid)(void)
 {
     return current_process->pid;
@@ -180,15 +190,9 @@ DEFINE_SYSCALL(ptr_t, heap_control)(heap_control_op op, ptr_t arg)
 {
     process_t *process = current_process;
 
-    vmap_t *block = NULL;
-    list_foreach(vmap_t, map, process->mm->mmaps)
-    {
-        if (map->content == VMAP_HEAP)
-        {
-            block = map;
-            break;
-        }
-    }
+    spinlock_acquire(&process->mm->mm_lock);
+    vmap_t *block = process->mm->heap;
+    spinlock_release(&process->mm->mm_lock);
 
     if (block == NULL)
     {
@@ -238,7 +242,11 @@ DEFINE_SYSCALL(ptr_t, heap_control)(heap_control_op op, ptr_t arg)
 
 DEFINE_SYSCALL(bool, wait_for_thread)(tid_t tid)
 {
-    return thread_wait_for_tid(tid);
+    if (!thread_wait_for_tid(tid))
+        return false;
+
+    thread_try_reap(tid);
+    return true;
 }
 
 DEFINE_SYSCALL(bool, futex_wait)(futex_word_t *futex, u32 val)
@@ -614,6 +622,15 @@ DEFINE_SYSCALL(long, vfs_fchmodat)(fd_t dirfd, const char *path, int mode, int f
     return vfs_fchmodat(dirfd, path, mode, flags);
 }
 
+DEFINE_SYSCALL(long, vfs_fsync)(fd_t fd, bool data_only)
+{
+    io_t *io = process_get_fd(current_process, fd);
+    if (!io)
+        return -EBADF;
+
+    return vfs_fsync(io, !data_only);
+}
+
 DEFINE_SYSCALL(long, io_pread)(fd_t fd, void *buf, size_t count, off_t offset)
 {
     if (fd < 0)
@@ -628,3 +645,8 @@ DEFINE_SYSCALL(long, io_pread)(fd_t fd, void *buf, size_t count, off_t offset)
 
     return io_pread(io, buf, count, offset);
 }
+
+DEFINE_SYSCALL(u64, vm_page_grant)(void *addr)
+{
+    return page_grant_create(current_process, (ptr_t) addr);
+}
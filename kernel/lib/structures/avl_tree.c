@@ -0,0 +1,201 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <mos/lib/structures/avl_tree.h>
+#include <mos/moslib_global.h>
+#include <mos_stdlib.h>
+
+static s32 avl_height(const avl_node_t *node)
+{
+    return node ? node->height : 0;
+}
+
+static void avl_update(avl_node_t *node, avl_augment_t augment)
+{
+    node->height = 1 + MAX(avl_height(node->left), avl_height(node->right));
+    if (augment)
+        augment(node);
+}
+
+static void avl_replace_child(avl_tree_t *tree, avl_node_t *parent, avl_node_t *old, avl_node_t *new)
+{
+    if (!parent)
+        tree->root = new;
+    else if (parent->left == old)
+        parent->left = new;
+    else
+        parent->right = new;
+
+    if (new)
+        new->parent = parent;
+}
+
+static avl_node_t *avl_rotate_left(avl_tree_t *tree, avl_node_t *node, avl_augment_t augment)
+{
+    avl_node_t *const pivot = node->right;
+    avl_replace_child(tree, node->parent, node, pivot);
+
+    node->right = pivot->left;
+    if (pivot->left)
+        pivot->left->parent = node;
+
+    pivot->left = node;
+    node->parent = pivot;
+
+    avl_update(node, augment);
+    avl_update(pivot, augment);
+    return pivot;
+}
+
+static avl_node_t *avl_rotate_right(avl_tree_t *tree, avl_node_t *node, avl_augment_t augment)
+{
+    avl_node_t *const pivot = node->left;
+    avl_replace_child(tree, node->parent, node, pivot);
+
+    node->left = pivot->right;
+    if (pivot->right)
+        pivot->right->parent = node;
+
+    pivot->right = node;
+    node->parent = pivot;
+
+    avl_update(node, augment);
+    avl_update(pivot, augment);
+    return pivot;
+}
+
+// returns the node that now takes the place of 'node'
+static avl_node_t *avl_rebalance(avl_tree_t *tree, avl_node_t *node, avl_augment_t augment)
+{
+    avl_update(node, augment);
+    const s32 balance = avl_height(node->left) - avl_height(node->right);
+
+    if (balance > 1)
+    {
+        if (avl_height(node->left->left) < avl_height(node->left->right))
+            avl_rotate_left(tree, node->left, augment);
+        return avl_rotate_right(tree, node, augment);
+    }
+
+    if (balance < -1)
+    {
+        if (avl_height(node->right->right) < avl_height(node->right->left))
+            avl_rotate_right(tree, node->right, augment);
+        return avl_rotate_left(tree, node, augment);
+    }
+
+    return node;
+}
+
+static void avl_rebalance_to_root(avl_tree_t *tree, avl_node_t *node, avl_augment_t augment)
+{
+    while (node)
+        node = avl_rebalance(tree, node, augment)->parent;
+}
+
+void avl_insert(avl_tree_t *tree, avl_node_t *node, avl_compare_t compare, avl_augment_t augment)
+{
+    node->left = node->right = NULL;
+
+    avl_node_t *parent = NULL;
+    avl_node_t **link = &tree->root;
+    while (*link)
+    {
+        parent = *link;
+        link = compare(node, parent) < 0 ? &parent->left : &parent->right;
+    }
+
+    *link = node;
+    node->parent = parent;
+    avl_update(node, augment);
+    avl_rebalance_to_root(tree, parent, augment);
+}
+
+void avl_remove(avl_tree_t *tree, avl_node_t *node, avl_augment_t augment)
+{
+    avl_node_t *fixup_from = NULL;
+
+    if (node->left && node->right)
+    {
+        // replace the node with its in-order successor, which has no left child
+        avl_node_t *successor = node->right;
+        while (successor->left)
+            successor = successor->left;
+
+        if (successor->parent == node)
+        {
+            fixup_from = successor;
+        }
+        else
+        {
+            fixup_from = successor->parent;
+            avl_replace_child(tree, successor->parent, successor, successor->right);
+            successor->right = node->right;
+            node->right->parent = successor;
+        }
+
+        successor->left = node->left;
+        node->left->parent = successor;
+        avl_replace_child(tree, node->parent, node, successor);
+    }
+    else
+    {
+        fixup_from = node->parent;
+        avl_replace_child(tree, node->parent, node, node->left ? node->left : node->right);
+    }
+
+    node->left = node->right = node->parent = NULL;
+    node->height = 0;
+    avl_rebalance_to_root(tree, fixup_from, augment);
+}
+
+void avl_propagate(avl_node_t *node, avl_augment_t augment)
+{
+    for (; node; node = node->parent)
+        avl_update(node, augment);
+}
+
+avl_node_t *avl_first(const avl_tree_t *tree)
+{
+    avl_node_t *node = tree->root;
+    while (node && node->left)
+        node = node->left;
+    return node;
+}
+
+avl_node_t *avl_last(const avl_tree_t *tree)
+{
+    avl_node_t *node = tree->root;
+    while (node && node->right)
+        node = node->right;
+    return node;
+}
+
+avl_node_t *avl_next(const avl_node_t *node)
+{
+    if (node->right)
+    {
+        node = node->right;
+        while (node->left)
+            node = node->left;
+        return (avl_node_t *) node;
+    }
+
+    while (node->parent && node->parent->right == node)
+        node = node->parent;
+    return node->parent;
+}
+
+avl_node_t *avl_prev(const avl_node_t *node)
+{
+    if (node->left)
+    {
+        node = node->left;
+        while (node->right)
+            node = node->right;
+        return (avl_node_t *) node;
+    }
+
+    while (node->parent && node->parent->left == node)
+        node = node->parent;
+    return node->parent;
+}
@@ -9,13 +9,106 @@
 
 #define HASHMAP_MAGIC MOS_FOURCC('H', 'M', 'a', 'p')
 
+#define HASHMAP_MIN_CAPACITY  8
+#define HASHMAP_MAX_LOAD(cap) ((cap) / 8 * 7)
+
+#define hashmap_load(x)       __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define hashmap_store(x, val) __atomic_store_n(&(x), (val), __ATOMIC_RELEASE)
+
 typedef struct hashmap_entry
 {
-    ptr_t key;
+    uintn key;
     void *value;
-    hashmap_entry_t *next;
+    u64 hash;     // the key's hash, after hashmap_hash()
+    u32 distance; // 1 + the distance from the slot the hash points to, 0 for an empty slot
 } hashmap_entry_t;
 
+// hash functions like hashmap_identity_hash() leave the high bits empty, mix them in (Fibonacci hashing)
+static u64 hashmap_hash(const hashmap_t *map, uintn key)
+{
+    return map->hash_func(key).hash * 0x9e3779b97f4a7c15ull;
+}
+
+// the slot a hash points to, taken from the top bits as they are the best mixed ones
+static size_t hashmap_home(u64 hash, size_t capacity)
+{
+    return hash >> (64 - __builtin_ctzll(capacity));
+}
+
+// the slot after the last one is not used for entries, it links to the table this one replaced (and its capacity)
+static hashmap_entry_t *hashmap_alloc_table(size_t capacity)
+{
+    return kcalloc(capacity + 1, sizeof(hashmap_entry_t));
+}
+
+static void hashmap_write_begin(hashmap_t *map)
+{
+    __atomic_store_n(&map->seq, map->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void hashmap_write_end(hashmap_t *map)
+{
+    hashmap_store(map->seq, map->seq + 1);
+}
+
+static hashmap_entry_t *hashmap_find(const hashmap_t *map, hashmap_entry_t *entries, size_t capacity, uintn key, u64 hash)
+{
+    const size_t mask = capacity - 1;
+    size_t i = hashmap_home(hash, capacity);
+    for (u32 distance = 1; distance <= capacity; distance++, i = (i + 1) & mask)
+    {
+        hashmap_entry_t *entry = &entries[i];
+        if (entry->distance < distance)
+            return NULL; // the key would have taken this slot
+        if (entry->hash == hash && map->key_compare_func(entry->key, key))
+            return entry;
+    }
+
+    return NULL;
+}
+
+static void hashmap_insert(hashmap_entry_t *entries, size_t capacity, hashmap_entry_t entry)
+{
+    const size_t mask = capacity - 1;
+    size_t i = hashmap_home(entry.hash, capacity);
+    entry.distance = 1;
+    while (entries[i].distance)
+    {
+        // take the slot from an entry that is closer to its home, and find another slot for that one
+        if (entries[i].distance < entry.distance)
+        {
+            const hashmap_entry_t displaced = entries[i];
+            entries[i] = entry;
+            entry = displaced;
+        }
+        i = (i + 1) & mask;
+        entry.distance++;
+    }
+    entries[i] = entry;
+}
+
+static bool hashmap_grow(hashmap_t *map)
+{
+    const size_t capacity = map->capacity * 2;
+    hashmap_entry_t *entries = hashmap_alloc_table(capacity);
+    if (!entries)
+        return false;
+
+    hashmap_entry_t *old = map->entries;
+    for (size_t i = 0; i < map->capacity; i++)
+        if (old[i].distance)
+            hashmap_insert(entries, capacity, old[i]);
+
+    entries[capacity].key = map->capacity;
+    entries[capacity].value = old;
+
+    // a lockless reader that sees the new capacity must also see the new table
+    hashmap_store(map->entries, entries);
+    hashmap_store(map->capacity, capacity);
+    return true;
+}
+
 void hashmap_init(hashmap_t *map, size_t capacity, hashmap_hash_t hash_func, hashmap_key_compare_t compare_func)
 {
     MOS_LIB_ASSERT(map);
@@ -24,10 +117,15 @@ void hashmap_init(hashmap_t *map, size_t capacity, hashmap_hash_t hash_func, has
         mos_panic("hashmap_init: hashmap %p is already initialized", (void *) map);
         return;
     }
+
+    size_t slots = HASHMAP_MIN_CAPACITY;
+    while (slots < capacity)
+        slots *= 2;
+
     memzero(map, sizeof(hashmap_t));
     map->magic = HASHMAP_MAGIC;
-    map->entries = kcalloc(capacity, sizeof(hashmap_entry_t *));
-    map->capacity = capacity;
+    map->entries = hashmap_alloc_table(slots);
+    map->capacity = slots;
     map->size = 0;
     map->hash_func = hash_func;
     map->key_compare_func = compare_func;
@@ -36,118 +134,152 @@ void hashmap_init(hashmap_t *map, size_t capacity, hashmap_hash_t hash_func, has
 /**
  * @brief Deinitialize a hashmap.
  * @pre The hashmap must be initialized.
- * @pre The hashmap should be empty, otherwise the entries will be leaked.
  * @warning This function does not free the hashmap itself, nor does it free the keys or values, but only the internal data structures.
  *
  * @param map The hashmap to deinitialize.
  */
 void hashmap_deinit(hashmap_t *map)
 {
-    MOS_LIB_ASSERT_X(map && map->magic == HASHMAP_MAGIC, "hashmap_put: hashmap %p is not initialized", (void *) map);
+    MOS_LIB_ASSERT_X(map && map->magic == HASHMAP_MAGIC, "hashmap_deinit: hashmap %p is not initialized", (void *) map);
     spinlock_acquire(&map->lock);
-    for (size_t i = 0; i < map->capacity; i++)
+    hashmap_entry_t *table = map->entries;
+    size_t capacity = map->capacity;
+    while (table)
     {
-        hashmap_entry_t *entry = map->entries[i];
-        while (entry != NULL)
-        {
-            hashmap_entry_t *next = entry->next;
-            kfree(entry);
-            entry = next;
-        }
+        hashmap_entry_t *const replaced = table[capacity].value;
+        capacity = table[capacity].key;
+        kfree(table);
+        table = replaced;
     }
-    kfree(map->entries);
     spinlock_release(&map->lock);
 }
 
 void *hashmap_put(hashmap_t *map, uintn key, void *value)
 {
     MOS_LIB_ASSERT_X(map && map->magic == HASHMAP_MAGIC, "hashmap_put: hashmap %p is not initialized", (void *) map);
+    const u64 hash = hashmap_hash(map, key);
+
     spinlock_acquire(&map->lock);
-    size_t index = map->hash_func(key).hash % map->capacity;
-    hashmap_entry_t *entry = map->entries[index];
-    while (entry != NULL)
+    hashmap_write_begin(map);
+    hashmap_entry_t *entry = hashmap_find(map, map->entries, map->capacity, key, hash);
+    if (entry)
     {
-        if (map->key_compare_func(entry->key, key))
-        {
-            // key already exists, replace value
-            void *old_value = entry->value;
-            entry->value = value;
-            spinlock_release(&map->lock);
-            return old_value;
-        }
-        entry = entry->next;
+        // key already exists, replace value
+        void *old_value = entry->value;
+        entry->value = value;
+        hashmap_write_end(map);
+        spinlock_release(&map->lock);
+        return old_value;
     }
-    entry = kmalloc(sizeof(hashmap_entry_t));
-    entry->key = key;
-    entry->value = value;
-    entry->next = map->entries[index];
-    map->entries[index] = entry;
+
+    if (map->size + 1 > HASHMAP_MAX_LOAD(map->capacity) && !hashmap_grow(map))
+        MOS_LIB_ASSERT_X(map->size < map->capacity, "hashmap_put: hashmap %p is full and cannot grow", (void *) map);
+
+    hashmap_insert(map->entries, map->capacity, (hashmap_entry_t){ .key = key, .value = value, .hash = hash });
     map->size++;
+    hashmap_write_end(map);
     spinlock_release(&map->lock);
     return NULL;
 }
 
 void *hashmap_get(hashmap_t *map, uintn key)
 {
-    MOS_LIB_ASSERT_X(map && map->magic == HASHMAP_MAGIC, "hashmap_put: hashmap %p is not initialized", (void *) map);
+    MOS_LIB_ASSERT_X(map && map->magic == HASHMAP_MAGIC, "hashmap_get: hashmap %p is not initialized", (void *) map);
+    const u64 hash = hashmap_hash(map, key);
+
     spinlock_acquire(&map->lock);
-    size_t index = map->hash_func(key).hash % map->capacity;
-    hashmap_entry_t *entry = map->entries[index];
-    while (entry != NULL)
+    const hashmap_entry_t *entry = hashmap_find(map, map->entries, map->capacity, key, hash);
+    void *value = entry ? entry->value : NULL;
+    spinlock_release(&map->lock);
+    return value;
+}
+
+void *hashmap_get_lockless(hashmap_t *map, uintn key)
+{
+    MOS_LIB_ASSERT_X(map && map->magic == HASHMAP_MAGIC, "hashmap_get_lockless: hashmap %p is not initialized", (void *) map);
+    const u64 hash = hashmap_hash(map, key);
+
+    while (true)
     {
-        if (map->key_compare_func(entry->key, key))
-        {
-            void *value = entry->value;
-            spinlock_release(&map->lock);
+        const u32 seq = hashmap_load(map->seq);
+        if (seq & 1)
+            continue; // being modified
+
+        const size_t capacity = hashmap_load(map->capacity);
+        hashmap_entry_t *entries = hashmap_load(map->entries);
+        const hashmap_entry_t *entry = hashmap_find(map, entries, capacity, key, hash);
+        void *value = entry ? entry->value : NULL;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&map->seq, __ATOMIC_RELAXED) == seq)
             return value;
-        }
-        entry = entry->next;
     }
-
-    spinlock_release(&map->lock);
-    return NULL;
 }
 
 void *hashmap_remove(hashmap_t *map, uintn key)
 {
-    MOS_LIB_ASSERT_X(map && map->magic == HASHMAP_MAGIC, "hashmap_put: hashmap %p is not initialized", (void *) map);
+    MOS_LIB_ASSERT_X(map && map->magic == HASHMAP_MAGIC, "hashmap_remove: hashmap %p is not initialized", (void *) map);
+    const u64 hash = hashmap_hash(map, key);
+
     spinlock_acquire(&map->lock);
-    size_t index = map->hash_func(key).hash % map->capacity;
-    hashmap_entry_t *entry = map->entries[index];
-    hashmap_entry_t *prev = NULL;
-    while (entry != NULL)
+    hashmap_entry_t *entry = hashmap_find(map, map->entries, map->capacity, key, hash);
+    if (!entry)
     {
-        if (map->key_compare_func(entry->key, key))
-        {
-            if (prev == NULL)
-                map->entries[index] = entry->next;
-            else
-                prev->next = entry->next;
-            void *value = entry->value;
-            kfree(entry);
-            map->size--;
-            spinlock_release(&map->lock);
-            return value;
-        }
-        prev = entry;
-        entry = entry->next;
+        spinlock_release(&map->lock);
+        return NULL;
+    }
+
+    hashmap_write_begin(map);
+    void *value = entry->value;
+
+    // shift the following entries back until one is in its home slot, so no tombstone is needed
+    hashmap_entry_t *entries = map->entries;
+    const size_t mask = map->capacity - 1;
+    size_t i = entry - entries;
+    for (size_t next = (i + 1) & mask; entries[next].distance > 1; i = next, next = (next + 1) & mask)
+    {
+        entries[i] = entries[next];
+        entries[i].distance--;
     }
+    entries[i] = (hashmap_entry_t){ 0 };
 
+    map->size--;
+    hashmap_write_end(map);
     spinlock_release(&map->lock);
-    return NULL;
+    return value;
 }
 
+/**
+ * @brief Call a function for every entry in the hashmap, until it returns false.
+ *
+ * @details The map is not locked, so the function may modify it. The table is re-read for every
+ * slot, so entries that are moved (by the function or concurrently) may be skipped or visited twice.
+ */
 void hashmap_foreach(hashmap_t *map, hashmap_foreach_func_t func, void *data)
 {
-    MOS_LIB_ASSERT_X(map && map->magic == HASHMAP_MAGIC, "hashmap_put: hashmap %p is not initialized", (void *) map);
-    for (size_t i = 0; i < map->capacity; i++)
+    MOS_LIB_ASSERT_X(map && map->magic == HASHMAP_MAGIC, "hashmap_foreach: hashmap %p is not initialized", (void *) map);
+    for (size_t i = 0;; i++)
     {
-        hashmap_entry_t *entry = map->entries[i];
-        while (entry != NULL)
+        // writers move entries between slots in place, so each slot is copied like hashmap_get_lockless() reads
+        hashmap_entry_t entry;
+        while (true)
         {
-            if (!func(entry->key, entry->value, data))
+            const u32 seq = hashmap_load(map->seq);
+            if (seq & 1)
+                continue; // being modified
+
+            const size_t capacity = hashmap_load(map->capacity);
+            const hashmap_entry_t *entries = hashmap_load(map->entries);
+            if (i >= capacity)
                 return;
-            entry = entry->next;
+            entry = entries[i];
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&map->seq, __ATOMIC_RELAXED) == seq)
+                break;
         }
+
+        if (entry.distance && !func(entry.key, entry.value, data))
+            return;
     }
 }
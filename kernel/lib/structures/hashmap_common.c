@@ -4,17 +4,36 @@
 #include <mos/types.h>
 #include <mos_string.h>
 
-static hash_t __pure string_hash(const char *s, const int n)
+// FxHash: mix in a word at a time with a rotate, xor and multiply, hashmap_hash() spreads the result further
+#define FXHASH_SEED 0x517cc1b727220a95ull
+
+should_inline u64 fxhash_add(u64 hash, u64 word)
 {
-    const int p = 31, m = 1e9 + 7;
-    hash_t h = { 0 };
-    long p_pow = 1;
-    for (int i = 0; i < n; i++)
+    return (((hash << 5) | (hash >> 59)) ^ word) * FXHASH_SEED;
+}
+
+static hash_t __pure string_hash(const char *s, size_t n)
+{
+    u64 h = 0;
+    for (; n >= sizeof(u64); s += sizeof(u64), n -= sizeof(u64))
     {
-        h.hash = (h.hash + (s[i] - 'a' + 1) * p_pow) % m;
-        p_pow = (p_pow * p) % m;
+        u64 word;
+        __builtin_memcpy(&word, s, sizeof(word)); // the string may not be aligned
+        h = fxhash_add(h, word);
     }
-    return h;
+
+    if (n >= sizeof(u32))
+    {
+        u32 word;
+        __builtin_memcpy(&word, s, sizeof(word));
+        h = fxhash_add(h, word);
+        s += sizeof(u32), n -= sizeof(u32);
+    }
+
+    for (; n; s++, n--)
+        h = fxhash_add(h, (u8) *s);
+
+    return (hash_t){ .hash = h };
 }
 
 hash_t __pure hashmap_hash_string(uintn key)
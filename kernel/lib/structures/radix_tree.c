@@ -0,0 +1,287 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <mos/lib/structures/radix_tree.h>
+#include <mos/moslib_global.h>
+#include <mos_stdlib.h>
+
+#define radix_load(ptr)       __atomic_load_n(&(ptr), __ATOMIC_ACQUIRE)
+#define radix_store(ptr, val) __atomic_store_n(&(ptr), (val), __ATOMIC_RELEASE)
+
+#define radix_tag_bit(offset) (1ull << (offset))
+
+// the largest index a node with the given shift can hold
+static u64 radix_node_maxindex(u32 shift)
+{
+    if (shift + RADIX_TREE_MAP_SHIFT >= 64)
+        return (u64) -1;
+    return (1ull << (shift + RADIX_TREE_MAP_SHIFT)) - 1;
+}
+
+static radix_tree_node_t *radix_node_alloc(u32 shift, radix_tree_node_t *parent, u32 offset)
+{
+    radix_tree_node_t *node = kcalloc(1, sizeof(radix_tree_node_t));
+    if (!node)
+        return NULL;
+    node->shift = shift;
+    node->parent = parent;
+    node->offset = offset;
+    return node;
+}
+
+static radix_tree_node_t *radix_find_leaf(const radix_tree_t *tree, u64 index)
+{
+    radix_tree_node_t *node = radix_load(tree->root);
+    if (!node || index > radix_node_maxindex(node->shift))
+        return NULL;
+
+    while (node && node->shift > 0)
+        node = radix_load(node->slots[(index >> node->shift) & RADIX_TREE_MAP_MASK]);
+
+    return node;
+}
+
+void radix_tree_init(radix_tree_t *tree)
+{
+    tree->root = NULL;
+    tree->count = 0;
+}
+
+static void radix_node_free_recursive(radix_tree_node_t *node)
+{
+    if (node->shift > 0)
+    {
+        for (size_t i = 0; i < RADIX_TREE_MAP_SIZE; i++)
+            if (node->slots[i])
+                radix_node_free_recursive(node->slots[i]);
+    }
+    kfree(node);
+}
+
+void radix_tree_destroy(radix_tree_t *tree)
+{
+    if (tree->root)
+        radix_node_free_recursive(tree->root);
+    tree->root = NULL;
+    tree->count = 0;
+}
+
+void *radix_tree_lookup(const radix_tree_t *tree, u64 index)
+{
+    radix_tree_node_t *leaf = radix_find_leaf(tree, index);
+    return leaf ? radix_load(leaf->slots[index & RADIX_TREE_MAP_MASK]) : NULL;
+}
+
+bool radix_tree_insert(radix_tree_t *tree, u64 index, void *item)
+{
+    MOS_LIB_ASSERT_X(item, "radix_tree_insert: NULL entries cannot be stored");
+
+    if (!tree->root)
+    {
+        radix_tree_node_t *root = radix_node_alloc(0, NULL, 0);
+        if (!root)
+            return false;
+        radix_store(tree->root, root);
+    }
+
+    // grow the tree until the index fits, the old root becomes the first child of the new one
+    while (index > radix_node_maxindex(tree->root->shift))
+    {
+        radix_tree_node_t *old_root = tree->root;
+        radix_tree_node_t *root = radix_node_alloc(old_root->shift + RADIX_TREE_MAP_SHIFT, NULL, 0);
+        if (!root)
+            return false;
+
+        root->count = 1;
+        root->slots[0] = old_root;
+        for (u32 tag = 0; tag < RADIX_TREE_MAX_TAGS; tag++)
+            if (old_root->tags[tag])
+                root->tags[tag] = radix_tag_bit(0);
+
+        old_root->parent = root;
+        radix_store(tree->root, root);
+    }
+
+    radix_tree_node_t *node = tree->root;
+    while (node->shift > 0)
+    {
+        const u32 offset = (index >> node->shift) & RADIX_TREE_MAP_MASK;
+        radix_tree_node_t *child = node->slots[offset];
+        if (!child)
+        {
+            child = radix_node_alloc(node->shift - RADIX_TREE_MAP_SHIFT, node, offset);
+            if (!child)
+                return false;
+            radix_store(node->slots[offset], child);
+            node->count++;
+        }
+        node = child;
+    }
+
+    const u32 offset = index & RADIX_TREE_MAP_MASK;
+    if (node->slots[offset])
+        return false;
+
+    radix_store(node->slots[offset], item);
+    node->count++;
+    tree->count++;
+    return true;
+}
+
+static void radix_node_tag_clear(radix_tree_node_t *node, u32 offset, u32 tag)
+{
+    // clear the bit, and the bits of the ancestors that have nothing tagged below them anymore
+    while (node)
+    {
+        node->tags[tag] &= ~radix_tag_bit(offset);
+        if (node->tags[tag])
+            break;
+        offset = node->offset;
+        node = node->parent;
+    }
+}
+
+void *radix_tree_delete(radix_tree_t *tree, u64 index)
+{
+    radix_tree_node_t *node = radix_find_leaf(tree, index);
+    const u32 offset = index & RADIX_TREE_MAP_MASK;
+    void *item = node ? node->slots[offset] : NULL;
+    if (!item)
+        return NULL;
+
+    for (u32 tag = 0; tag < RADIX_TREE_MAX_TAGS; tag++)
+        if (node->tags[tag] & radix_tag_bit(offset))
+            radix_node_tag_clear(node, offset, tag);
+
+    radix_store(node->slots[offset], NULL);
+    node->count--;
+    tree->count--;
+
+    // free the nodes that became empty
+    while (node && node->count == 0)
+    {
+        radix_tree_node_t *parent = node->parent;
+        if (parent)
+        {
+            radix_store(parent->slots[node->offset], NULL);
+            parent->count--;
+        }
+        else
+        {
+            radix_store(tree->root, NULL);
+        }
+        kfree(node);
+        node = parent;
+    }
+
+    // shrink the tree while the root only has its first child
+    while (tree->root && tree->root->shift > 0 && tree->root->count == 1 && tree->root->slots[0])
+    {
+        radix_tree_node_t *root = tree->root;
+        radix_tree_node_t *child = root->slots[0];
+        child->parent = NULL;
+        radix_store(tree->root, child);
+        kfree(root);
+    }
+
+    return item;
+}
+
+void radix_tree_tag_set(radix_tree_t *tree, u64 index, u32 tag)
+{
+    MOS_LIB_ASSERT(tag < RADIX_TREE_MAX_TAGS);
+    radix_tree_node_t *node = radix_find_leaf(tree, index);
+    u32 offset = index & RADIX_TREE_MAP_MASK;
+    MOS_LIB_ASSERT_X(node && node->slots[offset], "radix_tree_tag_set: no entry at index %llu", (unsigned long long) index);
+
+    // set the bit, and the bits of the ancestors, stopping at the first one that is already set
+    while (node && !(node->tags[tag] & radix_tag_bit(offset)))
+    {
+        node->tags[tag] |= radix_tag_bit(offset);
+        offset = node->offset;
+        node = node->parent;
+    }
+}
+
+void radix_tree_tag_clear(radix_tree_t *tree, u64 index, u32 tag)
+{
+    MOS_LIB_ASSERT(tag < RADIX_TREE_MAX_TAGS);
+    radix_tree_node_t *node = radix_find_leaf(tree, index);
+    const u32 offset = index & RADIX_TREE_MAP_MASK;
+    if (node && (node->tags[tag] & radix_tag_bit(offset)))
+        radix_node_tag_clear(node, offset, tag);
+}
+
+bool radix_tree_tag_get(const radix_tree_t *tree, u64 index, u32 tag)
+{
+    MOS_LIB_ASSERT(tag < RADIX_TREE_MAX_TAGS);
+    const radix_tree_node_t *node = radix_find_leaf(tree, index);
+    return node && (node->tags[tag] & radix_tag_bit(index & RADIX_TREE_MAP_MASK));
+}
+
+bool radix_tree_tagged(const radix_tree_t *tree, u32 tag)
+{
+    MOS_LIB_ASSERT(tag < RADIX_TREE_MAX_TAGS);
+    const radix_tree_node_t *root = radix_load(tree->root);
+    return root && root->tags[tag];
+}
+
+typedef struct
+{
+    void **results;
+    u64 *indices;
+    size_t nfound, max_items;
+    s32 tag; // -1 for untagged lookups
+} radix_gang_t;
+
+// visit the slots of a node whose first slot starts at 'base', returns false once enough entries are found
+static bool radix_gang_visit(const radix_tree_node_t *node, u64 base, u64 first_index, radix_gang_t *gang)
+{
+    u32 offset = first_index > base ? (first_index - base) >> node->shift : 0;
+    for (; offset < RADIX_TREE_MAP_SIZE; offset++)
+    {
+        if (gang->tag >= 0 && !(node->tags[gang->tag] & radix_tag_bit(offset)))
+            continue;
+
+        void *slot = radix_load(node->slots[offset]);
+        if (!slot)
+            continue;
+
+        const u64 slot_base = base + ((u64) offset << node->shift);
+        if (node->shift > 0)
+        {
+            if (!radix_gang_visit(slot, slot_base, first_index, gang))
+                return false;
+            continue;
+        }
+
+        gang->results[gang->nfound] = slot;
+        if (gang->indices)
+            gang->indices[gang->nfound] = slot_base;
+        if (++gang->nfound == gang->max_items)
+            return false;
+    }
+
+    return true;
+}
+
+static size_t radix_do_gang_lookup(const radix_tree_t *tree, void **results, u64 *indices, u64 first_index, size_t max_items, s32 tag)
+{
+    const radix_tree_node_t *root = radix_load(tree->root);
+    if (!root || max_items == 0 || first_index > radix_node_maxindex(root->shift))
+        return 0;
+
+    radix_gang_t gang = { .results = results, .indices = indices, .nfound = 0, .max_items = max_items, .tag = tag };
+    radix_gang_visit(root, 0, first_index, &gang);
+    return gang.nfound;
+}
+
+size_t radix_tree_gang_lookup(const radix_tree_t *tree, void **results, u64 *indices, u64 first_index, size_t max_items)
+{
+    return radix_do_gang_lookup(tree, results, indices, first_index, max_items, -1);
+}
+
+size_t radix_tree_gang_lookup_tag(const radix_tree_t *tree, void **results, u64 *indices, u64 first_index, size_t max_items, u32 tag)
+{
+    MOS_LIB_ASSERT(tag < RADIX_TREE_MAX_TAGS);
+    return radix_do_gang_lookup(tree, results, indices, first_index, max_items, tag);
+}
@@ -149,3 +149,41 @@ size_t ring_buffer_pos_pop_front(u8 *data, ring_buffer_pos_t *pos, u8 *target, s
     pos->size -= size;
     return size;
 }
+
+void ring_buffer_spsc_init(ring_buffer_spsc_t *ring, size_t capacity)
+{
+    MOS_LIB_ASSERT_X(capacity && (capacity & (capacity - 1)) == 0, "ring buffer capacity %zu is not a power of two", capacity);
+    ring->capacity = capacity;
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+size_t ring_buffer_spsc_push(u8 *data, ring_buffer_spsc_t *ring, const u8 *source, size_t size)
+{
+    const size_t tail = ring->tail;
+    const size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE); // the consumer is done with everything before it
+    size = MIN(size, ring->capacity - (tail - head));
+
+    const size_t offset = tail & (ring->capacity - 1);
+    const size_t first_part_size = MIN(size, ring->capacity - offset);
+    memcpy(data + offset, source, first_part_size);
+    memcpy(data, source + first_part_size, size - first_part_size);
+
+    __atomic_store_n(&ring->tail, tail + size, __ATOMIC_RELEASE);
+    return size;
+}
+
+size_t ring_buffer_spsc_pop(u8 *data, ring_buffer_spsc_t *ring, u8 *target, size_t size)
+{
+    const size_t head = ring->head;
+    const size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE); // the producer has written everything before it
+    size = MIN(size, tail - head);
+
+    const size_t offset = head & (ring->capacity - 1);
+    const size_t first_part_size = MIN(size, ring->capacity - offset);
+    memcpy(target, data + offset, first_part_size);
+    memcpy(target + first_part_size, data, size - first_part_size);
+
+    __atomic_store_n(&ring->head, head + size, __ATOMIC_RELEASE);
+    return size;
+}
@@ -5,6 +5,7 @@
 #include "mos/mm/mm.h"
 #include "mos/mm/mmstat.h"
 #include "mos/mm/paging/paging.h"
+#include "mos/mm/paging/table_ops.h"
 #include "mos/platform/platform.h"
 
 #include <mos/interrupt/ipi.h>
@@ -25,21 +26,85 @@ static phyframe_t *zero_page(void)
     {
         _zero_page = pmm_ref_one(mm_get_free_page());
         MOS_ASSERT(_zero_page);
-        memzero((void *) phyframe_va(_zero_page), MOS_PAGE_SIZE);
+        memzero_page((void *) phyframe_va(_zero_page));
     }
 
     return _zero_page;
 }
 
+#if MOS_CONFIG(MOS_MM_TRANSPARENT_HUGEPAGE) && MOS_CONFIG(PML2_HUGE_CAPABLE)
+#define THP_SIZE (PML2E_NPAGES * MOS_PAGE_SIZE)
+
+/**
+ * @brief Try to fault in a whole 2 MiB range of a private anonymous vmap with a single huge page.
+ *
+ * @return true if the huge page has been mapped, false if the caller should fall back to 4K pages.
+ */
+static bool cow_try_fault_huge(vmap_t *vmap, ptr_t fault_addr)
+{
+    if (vmap->type != VMAP_TYPE_PRIVATE || vmap->io)
+        return false;
+
+    if (vmap->content != VMAP_HEAP && vmap->content != VMAP_STACK && vmap->content != VMAP_MMAP)
+        return false;
+
+    const ptr_t huge_start = ALIGN_DOWN(fault_addr, THP_SIZE);
+    if (huge_start < vmap->vaddr || huge_start + THP_SIZE > vmap->vaddr + vmap->npages * MOS_PAGE_SIZE)
+        return false; // the 2 MiB range is not fully inside this vmap
+
+    if (!mm_do_can_map_huge(vmap->mmctx->pgd, huge_start))
+        return false; // some 4K pages in this range have already been mapped
+
+    phyframe_t *frames = pmm_allocate_frames(PML2E_NPAGES, PMM_ALLOC_NORMAL);
+    if (!frames)
+        return false;
+
+    const pfn_t pfn = phyframe_pfn(frames);
+    if (pfn % PML2E_NPAGES)
+    {
+        // the buddy allocator didn't give us a naturally aligned block
+        pmm_free_frames(frames, PML2E_NPAGES);
+        return false;
+    }
+
+    memzero((void *) phyframe_va(frames), THP_SIZE);
+    pmm_ref(frames, PML2E_NPAGES);
+    MOS_ASSERT(mm_do_map_huge(vmap->mmctx->pgd, huge_start, pfn, vmap->vmflags));
+
+    pr_dinfo2(cow, "mapped huge page " PFN_FMT " at " PTR_FMT, pfn, huge_start);
+    vmap->stat.regular += PML2E_NPAGES;
+    vmap_stat_inc(vmap, thp);
+    return true;
+}
+#endif
+
 static vmfault_result_t cow_zod_fault_handler(vmap_t *vmap, ptr_t fault_addr, pagefault_t *info)
 {
     MOS_UNUSED(fault_addr);
 
     if (info->is_present && info->is_write)
     {
-        vmap_stat_dec(vmap, cow); // the faulting page is a CoW page
-        vmap_stat_inc(vmap, regular);
-        return mm_resolve_cow_fault(vmap, fault_addr, info);
+        vmfault_result_t result;
+        bool resolved;
+        if (info->faulting_page == _zero_page)
+        {
+            // nothing to copy from the zero page, just map a fresh zeroed page, the caller reports NULL as out of memory
+            info->backing_page = mm_get_free_page();
+            result = VMFAULT_MAP_BACKING_PAGE;
+            resolved = info->backing_page != NULL;
+        }
+        else
+        {
+            result = mm_resolve_cow_fault(vmap, fault_addr, info);
+            resolved = result != VMFAULT_CANNOT_HANDLE;
+        }
+
+        if (resolved)
+        {
+            vmap_stat_dec(vmap, cow); // the faulting page was a CoW page
+            vmap_stat_inc(vmap, regular);
+        }
+        return result;
     }
 
     MOS_ASSERT(!info->is_present); // we can't have (present && !write)
@@ -47,8 +112,13 @@ static vmfault_result_t cow_zod_fault_handler(vmap_t *vmap, ptr_t fault_addr, pa
     if (info->is_write)
     {
         // non-present and write, must be a ZoD page
+#if MOS_CONFIG(MOS_MM_TRANSPARENT_HUGEPAGE) && MOS_CONFIG(PML2_HUGE_CAPABLE)
+        if (cow_try_fault_huge(vmap, fault_addr))
+            return VMFAULT_COMPLETE;
+#endif
         info->backing_page = mm_get_free_page();
-        vmap_stat_inc(vmap, regular);
+        if (info->backing_page)
+            vmap_stat_inc(vmap, regular);
         return VMFAULT_MAP_BACKING_PAGE;
     }
     else
@@ -61,6 +131,9 @@ static vmfault_result_t cow_zod_fault_handler(vmap_t *vmap, ptr_t fault_addr, pa
 
 vmap_t *cow_clone_vmap_locked(mm_context_t *target_mmctx, vmap_t *src_vmap)
 {
+    // huge pages are only ever privately owned, CoW works on 4K pages
+    vmap_split_huge_pages(src_vmap, src_vmap->vaddr, src_vmap->npages);
+
     // remove that VM_WRITE flag
     mm_flag_pages_locked(src_vmap->mmctx, src_vmap->vaddr, src_vmap->npages, src_vmap->vmflags & ~VM_WRITE);
     src_vmap->stat.cow += src_vmap->stat.regular;
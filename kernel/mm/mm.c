@@ -45,7 +45,7 @@ phyframe_t *mm_get_free_page(void)
     phyframe_t *frame = mm_get_free_page_raw();
     if (!frame)
         return NULL;
-    memzero((void *) phyframe_va(frame), MOS_PAGE_SIZE);
+    memzero_page((void *) phyframe_va(frame));
     return frame;
 }
 
@@ -65,6 +65,8 @@ mm_context_t *mm_create_context(void)
 {
     mm_context_t *mmctx = kmalloc(mm_context_cache);
     linked_list_init(&mmctx->mmaps);
+    mmctx->vmap_tree.root = NULL;
+    mmctx->heap = NULL;
 
     pml4_t pml4 = pml_create_table(pml4);
 
@@ -81,6 +83,7 @@ void mm_destroy_context(mm_context_t *mmctx)
 {
     MOS_ASSERT(mmctx != platform_info->kernel_mm); // you can't destroy the kernel mmctx
     MOS_ASSERT(list_is_empty(&mmctx->mmaps));
+    MOS_ASSERT(mmctx->vmap_tree.root == NULL);
 
     ptr_t zero = 0;
     size_t userspace_npages = (MOS_USER_END_VADDR + 1) / MOS_PAGE_SIZE;
@@ -132,25 +135,142 @@ mm_context_t *mm_switch_context(mm_context_t *new_ctx)
     return old_ctx;
 }
 
+// ! the vmap tree, sorted by vaddr, each node also describes the address range and the largest gap of its subtree
+
+static int vmap_tree_compare(const avl_node_t *a, const avl_node_t *b)
+{
+    const ptr_t va = avl_entry(a, vmap_t)->vaddr;
+    const ptr_t vb = avl_entry(b, vmap_t)->vaddr;
+    return va < vb ? -1 : va > vb;
+}
+
+static void vmap_tree_augment(avl_node_t *node)
+{
+    vmap_t *const vmap = avl_entry(node, vmap_t);
+    vmap->subtree_start = vmap->vaddr;
+    vmap->subtree_end = vmap_end(vmap);
+    vmap->subtree_max_gap = 0;
+
+    if (node->left)
+    {
+        const vmap_t *left = avl_entry(node->left, vmap_t);
+        vmap->subtree_start = left->subtree_start;
+        vmap->subtree_max_gap = MAX(left->subtree_max_gap, vmap->vaddr - left->subtree_end);
+    }
+
+    if (node->right)
+    {
+        const vmap_t *right = avl_entry(node->right, vmap_t);
+        vmap->subtree_end = right->subtree_end;
+        vmap->subtree_max_gap = MAX(vmap->subtree_max_gap, right->subtree_max_gap);
+        vmap->subtree_max_gap = MAX(vmap->subtree_max_gap, right->subtree_start - vmap_end(vmap));
+    }
+}
+
+// the last vmap that starts at or before vaddr
+static vmap_t *vmap_tree_find_floor(const mm_context_t *mmctx, ptr_t vaddr)
+{
+    vmap_t *result = NULL;
+    avl_node_t *node = mmctx->vmap_tree.root;
+    while (node)
+    {
+        vmap_t *vmap = avl_entry(node, vmap_t);
+        if (vmap->vaddr <= vaddr)
+        {
+            result = vmap;
+            node = node->right;
+        }
+        else
+        {
+            node = node->left;
+        }
+    }
+
+    return result;
+}
+
+// find the lowest gap between two vmaps in the subtree that has at least 'size' bytes after 'lowest'
+static bool vmap_tree_find_gap(const avl_node_t *node, ptr_t lowest, size_t size, ptr_t *out_vaddr)
+{
+    if (!node)
+        return false;
+
+    const vmap_t *vmap = avl_entry(node, vmap_t);
+    if (vmap->subtree_max_gap < size || vmap->subtree_end <= lowest)
+        return false; // no gap is large enough, or all of them are below 'lowest'
+
+    if (vmap_tree_find_gap(node->left, lowest, size, out_vaddr))
+        return true;
+
+    if (node->left)
+    {
+        const ptr_t gap_start = MAX(avl_entry(node->left, vmap_t)->subtree_end, lowest);
+        if (gap_start < vmap->vaddr && vmap->vaddr - gap_start >= size)
+        {
+            *out_vaddr = gap_start;
+            return true;
+        }
+    }
+
+    if (node->right)
+    {
+        const ptr_t gap_start = MAX(vmap_end(vmap), lowest);
+        const ptr_t gap_end = avl_entry(node->right, vmap_t)->subtree_start;
+        if (gap_start < gap_end && gap_end - gap_start >= size)
+        {
+            *out_vaddr = gap_start;
+            return true;
+        }
+    }
+
+    return vmap_tree_find_gap(node->right, lowest, size, out_vaddr);
+}
+
+bool mm_is_range_free_locked(mm_context_t *mmctx, ptr_t vaddr, size_t npages)
+{
+    MOS_ASSERT(spinlock_is_locked(&mmctx->mm_lock));
+    const vmap_t *vmap = vmap_tree_find_floor(mmctx, vaddr + npages * MOS_PAGE_SIZE - 1);
+    return !vmap || vmap_end(vmap) <= vaddr;
+}
+
+bool mm_find_free_range_locked(mm_context_t *mmctx, ptr_t base_vaddr, size_t npages, ptr_t *out_vaddr)
+{
+    MOS_ASSERT(spinlock_is_locked(&mmctx->mm_lock));
+    const size_t size = npages * MOS_PAGE_SIZE;
+
+    ptr_t vaddr = base_vaddr;
+    if (mmctx->vmap_tree.root)
+    {
+        const vmap_t *all = avl_entry(mmctx->vmap_tree.root, vmap_t);
+        const bool before_all = base_vaddr + size <= all->subtree_start;
+        const bool after_all = base_vaddr >= all->subtree_end;
+        if (!before_all && !after_all && !vmap_tree_find_gap(mmctx->vmap_tree.root, base_vaddr, size, &vaddr))
+            vaddr = all->subtree_end; // no gap in between, try after the last vmap
+    }
+
+    if (vaddr + size > MOS_KERNEL_START_VADDR)
+        return false;
+
+    *out_vaddr = vaddr;
+    return true;
+}
+
 static void do_attach_vmap(mm_context_t *mmctx, vmap_t *vmap)
 {
     MOS_ASSERT(spinlock_is_locked(&mmctx->mm_lock));
     MOS_ASSERT_X(list_is_empty(list_node(vmap)), "vmap is already attached to something");
     MOS_ASSERT(vmap->mmctx == NULL || vmap->mmctx == mmctx);
+    MOS_ASSERT_X(mm_is_range_free_locked(mmctx, vmap->vaddr, vmap->npages), "vmap overlaps with an existing one");
 
     vmap->mmctx = mmctx;
+    avl_insert(&mmctx->vmap_tree, avl_node(vmap), vmap_tree_compare, vmap_tree_augment);
 
     // add to the list, sorted by address
-    list_foreach(vmap_t, m, mmctx->mmaps)
-    {
-        if (m->vaddr > vmap->vaddr)
-        {
-            list_insert_before(m, vmap);
-            return;
-        }
-    }
-
-    list_node_append(&mmctx->mmaps, list_node(vmap)); // append at the end
+    avl_node_t *next = avl_next(avl_node(vmap));
+    if (next)
+        list_insert_before(avl_entry(next, vmap_t), vmap);
+    else
+        list_node_append(&mmctx->mmaps, list_node(vmap)); // append at the end
 }
 
 vmap_t *vmap_create(mm_context_t *mmctx, ptr_t vaddr, size_t npages)
@@ -179,9 +299,18 @@ void vmap_destroy(vmap_t *vmap)
         if (unmapped)
             goto unmapped;
     }
+    vmap_split_huge_pages(vmap, vmap->vaddr, vmap->npages); // the page table walkers only unmap 4K pages
     mm_do_unmap(mm->pgd, vmap->vaddr, vmap->npages, true);
 
 unmapped:
+    if (mm->heap == vmap)
+    {
+        // the heap may have been split, the remaining part (if any) takes over
+        avl_node_t *next = avl_next(avl_node(vmap));
+        mm->heap = (next && avl_entry(next, vmap_t)->content == VMAP_HEAP) ? avl_entry(next, vmap_t) : NULL;
+    }
+
+    avl_remove(&mm->vmap_tree, avl_node(vmap), vmap_tree_augment);
     list_remove(vmap);
     kfree(vmap);
 }
@@ -190,15 +319,13 @@ vmap_t *vmap_obtain(mm_context_t *mmctx, ptr_t vaddr, size_t *out_offset)
 {
     MOS_ASSERT(spinlock_is_locked(&mmctx->mm_lock));
 
-    list_foreach(vmap_t, m, mmctx->mmaps)
+    vmap_t *m = vmap_tree_find_floor(mmctx, vaddr);
+    if (m && vaddr < vmap_end(m))
     {
-        if (m->vaddr <= vaddr && vaddr < m->vaddr + m->npages * MOS_PAGE_SIZE)
-        {
-            spinlock_acquire(&m->lock);
-            if (out_offset)
-                *out_offset = vaddr - m->vaddr;
-            return m;
-        }
+        spinlock_acquire(&m->lock);
+        if (out_offset)
+            *out_offset = vaddr - m->vaddr;
+        return m;
     }
 
     if (out_offset)
@@ -206,16 +333,33 @@ vmap_t *vmap_obtain(mm_context_t *mmctx, ptr_t vaddr, size_t *out_offset)
     return NULL;
 }
 
+bool vmap_grow(vmap_t *vmap, size_t npages)
+{
+    MOS_ASSERT(spinlock_is_locked(&vmap->lock));
+    MOS_ASSERT(spinlock_is_locked(&vmap->mmctx->mm_lock));
+
+    if (!mm_is_range_free_locked(vmap->mmctx, vmap_end(vmap), npages))
+        return false;
+
+    vmap->npages += npages;
+    avl_propagate(avl_node(vmap), vmap_tree_augment);
+    return true;
+}
+
 vmap_t *vmap_split(vmap_t *first, size_t split)
 {
     MOS_ASSERT(spinlock_is_locked(&first->lock));
     MOS_ASSERT(split && split < first->npages);
 
+    // a huge page can't belong to two vmaps
+    vmap_split_huge_pages(first, first->vaddr + split * MOS_PAGE_SIZE, 1);
+
     vmap_t *second = kmalloc(vmap_cache);
     *second = *first;                    // copy the whole structure
     linked_list_init(list_node(second)); // except for the list node
 
     first->npages = split; // shrink the first vmap
+    avl_propagate(avl_node(first), vmap_tree_augment);
     second->npages -= split;
     second->vaddr += split * MOS_PAGE_SIZE;
     if (first->io)
@@ -224,6 +368,15 @@ vmap_t *vmap_split(vmap_t *first, size_t split)
         second->io_offset += split * MOS_PAGE_SIZE;
     }
 
+#if MOS_CONFIG(PML2_HUGE_CAPABLE)
+    if (first->stat.thp)
+    {
+        // the copied counter covers both halves
+        first->stat.thp = mm_do_count_huge(first->mmctx->pgd, first->vaddr, first->npages);
+        second->stat.thp = mm_do_count_huge(second->mmctx->pgd, second->vaddr, second->npages);
+    }
+#endif
+
     do_attach_vmap(first->mmctx, second);
     return second;
 }
@@ -251,6 +404,22 @@ vmap_t *vmap_split_for_range(vmap_t *vmap, size_t rstart_pgoff, size_t rend_pgof
     return second;
 }
 
+void vmap_split_huge_pages(vmap_t *vmap, ptr_t vaddr, size_t npages)
+{
+    MOS_ASSERT(spinlock_is_locked(&vmap->lock) || spinlock_is_locked(&vmap->mmctx->mm_lock));
+#if MOS_CONFIG(PML2_HUGE_CAPABLE)
+    if (!vmap->stat.thp)
+        return;
+
+    const size_t n_split = mm_do_split_huge(vmap->mmctx->pgd, vaddr, npages);
+    MOS_ASSERT(n_split <= vmap->stat.thp);
+    vmap->stat.thp -= n_split;
+#else
+    MOS_UNUSED(vaddr);
+    MOS_UNUSED(npages);
+#endif
+}
+
 void vmap_finalise_init(vmap_t *vmap, vmap_content_t content, vmap_type_t type)
 {
     MOS_ASSERT(spinlock_is_locked(&vmap->lock));
@@ -259,12 +428,16 @@ void vmap_finalise_init(vmap_t *vmap, vmap_content_t content, vmap_type_t type)
 
     vmap->content = content;
     vmap->type = type;
+    if (content == VMAP_HEAP && (!vmap->mmctx->heap || vmap->vaddr < vmap->mmctx->heap->vaddr))
+        vmap->mmctx->heap = vmap;
     spinlock_release(&vmap->lock);
 }
 
+MOS_STATIC_ASSERT(MOS_PAGE_SIZE == MOS_STRING_PAGE_SIZE, "memcpy_page() and memzero_page() copy 4 KiB pages");
+
 void mm_copy_page(const phyframe_t *src, const phyframe_t *dst)
 {
-    memcpy((void *) phyframe_va(dst), (void *) phyframe_va(src), MOS_PAGE_SIZE);
+    memcpy_page((void *) phyframe_va(dst), (void *) phyframe_va(src));
 }
 
 vmfault_result_t mm_resolve_cow_fault(vmap_t *vmap, ptr_t fault_addr, pagefault_t *info)
@@ -272,10 +445,22 @@ vmfault_result_t mm_resolve_cow_fault(vmap_t *vmap, ptr_t fault_addr, pagefault_
     MOS_ASSERT(spinlock_is_locked(&vmap->lock));
     MOS_ASSERT(info->is_write && info->is_present);
 
-    // fast path to handle CoW
-    phyframe_t *page = mm_get_free_page();
+    // if this mapping is the only user of the frame, nobody else can observe the write
+    // (the page cache and the zero page always hold their own references)
+    if (info->faulting_page->allocated_refcount == 1)
+    {
+        mm_flag_pages_locked(vmap->mmctx, ALIGN_DOWN_TO_PAGE(fault_addr), 1, vmap->vmflags);
+        vmap_stat_inc(vmap, cow_reused);
+        return VMFAULT_COMPLETE;
+    }
+
+    // fast path to handle CoW, the page is fully overwritten so there's no need to zero it
+    phyframe_t *page = mm_get_free_page_raw();
+    if (!page)
+        return VMFAULT_CANNOT_HANDLE;
     mm_copy_page(info->faulting_page, page);
     mm_replace_page_locked(vmap->mmctx, fault_addr, phyframe_pfn(page), vmap->vmflags);
+    vmap_stat_inc(vmap, cow_copied);
 
     return VMFAULT_COMPLETE;
 }
@@ -400,6 +585,7 @@ void mm_handle_fault(ptr_t fault_addr, pagefault_t *info)
     {
         // vmprotect has been called on this vmap to enable execution
         // we need to make sure that the page is executable
+        vmap_split_huge_pages(fault_vmap, fault_addr, 1);
         mm_do_flag(fault_vmap->mmctx->pgd, fault_addr, 1, page_flags | VM_EXEC);
         mm_unlock_ctx_pair(mm, NULL);
         spinlock_release(&fault_vmap->lock);
@@ -201,6 +201,7 @@ bool vm_protect(mm_context_t *mmctx, ptr_t addr, size_t size, vm_flags perm)
         mask |= VM_EXEC;
 
     // remove permissions immediately
+    vmap_split_huge_pages(to_protect, to_protect->vaddr, to_protect->npages);
     mm_do_mask_flags(mmctx->pgd, to_protect->vaddr, to_protect->npages, mask);
 
     // do not add permissions immediately, we will let the page fault handler do it
@@ -2,6 +2,8 @@
 
 #include "mos/mm/mmstat.h"
 
+#include "mos/filesystem/dentry.h"
+#include "mos/filesystem/page_cache.h"
 #include "mos/filesystem/sysfs/sysfs.h"
 #include "mos/filesystem/sysfs/sysfs_autoinit.h"
 #include "mos/mm/paging/iterator.h"
@@ -55,11 +57,32 @@ static bool mmstat_sysfs_stat(sysfs_file_t *f)
     format_size(size_buf, sizeof(size_buf), pmm_reserved_frames * MOS_PAGE_SIZE);
     sysfs_printf(f, "%-20s: %s, %zu pages\n", "Reserved", size_buf, pmm_reserved_frames);
 
+    const size_t free_frames = pmm_get_free_frames();
+    format_size(size_buf, sizeof(size_buf), free_frames * MOS_PAGE_SIZE);
+    sysfs_printf(f, "%-20s: %s, %zu pages\n", "Free", size_buf, free_frames);
+
     for (u32 i = 0; i < _MEM_MAX_TYPES; i++)
     {
         format_size(size_buf, sizeof(size_buf), stat[i].npages * MOS_PAGE_SIZE);
         sysfs_printf(f, "%-20s: %s, %zu pages\n", mem_type_names[i], size_buf, stat[i].npages);
     }
+
+    const size_t hits = pagecache_stat.hits, misses = pagecache_stat.misses;
+    const size_t hit_rate = hits + misses ? hits * 100 / (hits + misses) : 0;
+    sysfs_printf(f, "%-20s: %zu%%, %zu hits, %zu misses\n", "PageCacheHitRate", hit_rate, hits, misses);
+    sysfs_printf(f, "%-20s: %zu pages\n", "PageCacheReclaimed", (size_t) pagecache_stat.reclaimed);
+    return true;
+}
+
+static bool mmstat_sysfs_drop_caches(sysfs_file_t *f, const char *buf, size_t count, off_t offset)
+{
+    MOS_UNUSED(f);
+    MOS_UNUSED(buf);
+    MOS_UNUSED(count);
+    MOS_UNUSED(offset);
+    const size_t dropped_dentries = dcache_shrink((size_t) -1); // also drops the pages of their inodes
+    const size_t dropped = pagecache_reclaim((size_t) -1);
+    pr_info("mmstat: dropped %zu dentries and %zu page cache pages", dropped_dentries, dropped);
     return true;
 }
 
@@ -153,6 +176,7 @@ static sysfs_item_t mmstat_sysfs_items[] = {
     SYSFS_RO_ITEM("stat", mmstat_sysfs_stat),
     SYSFS_RW_ITEM("phyframe_stat", mmstat_sysfs_phyframe_stat_show, mmstat_sysfs_phyframe_stat_store),
     SYSFS_RW_ITEM("pagetable", mmstat_sysfs_pagetable_show, mmstat_sysfs_pagetable_store),
+    SYSFS_WO_ITEM("drop_caches", mmstat_sysfs_drop_caches),
 };
 
 SYSFS_AUTOREGISTER(mmstat, mmstat_sysfs_items);
@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mos/mm/page_grant.h"
+
+#include "mos/interrupt/ipi.h"
+#include "mos/mm/mm.h"
+#include "mos/mm/paging/paging.h"
+#include "mos/mm/paging/table_ops.h"
+#include "mos/mm/slab_autoinit.h"
+#include "mos/platform/platform.h"
+#include "mos/setup.h"
+#include "mos/tasks/task_types.h"
+
+#include <mos/lib/structures/hashmap.h>
+#include <mos/lib/structures/hashmap_common.h>
+#include <mos/lib/structures/list.h>
+#include <mos/lib/sync/spinlock.h>
+#include <mos/mos_global.h>
+#include <mos/printk.h>
+#include <mos_stdlib.h>
+
+typedef struct
+{
+    as_linked_list; ///< node in the granting process's page_grants list
+    u64 handle;
+    process_t *owner;
+    phyframe_t *frame; ///< holds one reference until the grant is taken or released
+} page_grant_t;
+
+static slab_t *page_grant_slab = NULL;
+SLAB_AUTOINIT("page_grant", page_grant_slab, page_grant_t);
+
+#define PAGE_GRANT_MAP_SIZE 64
+static spinlock_t page_grants_lock = SPINLOCK_INIT; // protects page_grants and the grant list of every process
+static hashmap_t page_grants = { 0 };              // handle -> page_grant_t *
+static u64 page_grant_secret = 0;
+static u64 page_grant_seq = 0;
+
+static void page_grant_init(void)
+{
+    hashmap_init(&page_grants, PAGE_GRANT_MAP_SIZE, hashmap_identity_hash, hashmap_simple_key_compare);
+    page_grant_secret = platform_get_timestamp();
+}
+MOS_INIT(POST_MM, page_grant_init);
+
+// splitmix64 of a per-boot secret plus a sequence number: handles are unique, but not sequential
+static u64 page_grant_new_handle(void)
+{
+    u64 z = page_grant_secret + (++page_grant_seq) * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+u64 page_grant_create(process_t *process, ptr_t vaddr)
+{
+    if (vaddr % MOS_PAGE_SIZE)
+        return 0;
+
+    // reserve a slot, so that a process cannot pin an unbounded number of frames with grants nobody takes
+    spinlock_acquire(&page_grants_lock);
+    if (process->page_grants_n >= MOS_MM_PAGE_GRANT_MAX)
+    {
+        spinlock_release(&page_grants_lock);
+        pr_dwarn(vmm, "process %pp has too many outstanding page grants", (void *) process);
+        return 0;
+    }
+    process->page_grants_n++;
+    spinlock_release(&page_grants_lock);
+
+    page_grant_t *grant = kmalloc(page_grant_slab);
+    if (!grant)
+        goto unreserve;
+
+    mm_context_t *mmctx = process->mm;
+    spinlock_acquire(&mmctx->mm_lock);
+    vmap_t *vmap = vmap_obtain(mmctx, vaddr, NULL);
+    if (!vmap)
+    {
+        spinlock_release(&mmctx->mm_lock);
+        goto free_grant;
+    }
+
+    // only anonymous memory can be given away, the process gets a zero page in its place
+    if (vmap->type != VMAP_TYPE_PRIVATE || vmap->io || !(vmap->vmflags & VM_WRITE))
+        goto fail;
+
+    vmap_split_huge_pages(vmap, vaddr, 1);
+    const pfn_t pfn = mm_do_get_pfn(mmctx->pgd, vaddr);
+    if (!pfn)
+        goto fail; // never touched, there is nothing to grant
+
+    phyframe_t *frame = pfn_phyframe(pfn);
+    if (frame->allocated_refcount != 1)
+        goto fail; // shared with another address space (e.g. copy-on-write after fork)
+
+    phyframe_t *zero = mm_get_free_page();
+    if (!zero)
+        goto fail;
+
+    // the grant takes over the reference of the mapping, which is dropped when the zero page replaces it
+    pmm_ref_one(frame);
+    mm_replace_page_locked(mmctx, vaddr, phyframe_pfn(zero), vmap->vmflags);
+    spinlock_release(&vmap->lock);
+    spinlock_release(&mmctx->mm_lock);
+    ipi_send_all(IPI_TYPE_INVALIDATE_TLB);
+
+    linked_list_init(list_node(grant));
+    grant->owner = process;
+    grant->frame = frame;
+
+    spinlock_acquire(&page_grants_lock);
+    do
+        grant->handle = page_grant_new_handle();
+    while (!grant->handle || hashmap_get(&page_grants, grant->handle));
+    hashmap_put(&page_grants, grant->handle, grant);
+    list_node_append(&process->page_grants, list_node(grant));
+    spinlock_release(&page_grants_lock);
+    return grant->handle;
+
+fail:
+    spinlock_release(&vmap->lock);
+    spinlock_release(&mmctx->mm_lock);
+free_grant:
+    kfree(grant);
+unreserve:
+    spinlock_acquire(&page_grants_lock);
+    process->page_grants_n--;
+    spinlock_release(&page_grants_lock);
+    return 0;
+}
+
+phyframe_t *page_grant_take(u64 handle, pid_t owner)
+{
+    if (!handle || !owner)
+        return NULL;
+
+    spinlock_acquire(&page_grants_lock);
+    page_grant_t *grant = hashmap_get(&page_grants, handle);
+    if (!grant || grant->owner->pid != owner)
+    {
+        spinlock_release(&page_grants_lock);
+        return NULL; // a handle made up by, or granted by, some other process
+    }
+
+    hashmap_remove(&page_grants, handle);
+    list_remove(grant);
+    grant->owner->page_grants_n--;
+    spinlock_release(&page_grants_lock);
+
+    phyframe_t *frame = grant->frame;
+    kfree(grant);
+    return frame;
+}
+
+void page_grant_release_all(process_t *process)
+{
+    spinlock_acquire(&page_grants_lock);
+    list_foreach(page_grant_t, grant, process->page_grants)
+    {
+        hashmap_remove(&page_grants, grant->handle);
+        list_remove(grant);
+        pmm_unref_one(grant->frame);
+        kfree(grant);
+    }
+    process->page_grants_n = 0;
+    spinlock_release(&page_grants_lock);
+}
@@ -22,57 +22,19 @@ vmap_t *mm_get_free_vaddr_locked(mm_context_t *mmctx, size_t n_pages, ptr_t base
 
     if (flags & VALLOC_EXACT)
     {
-        const ptr_t end_vaddr = base_vaddr + n_pages * MOS_PAGE_SIZE;
         // we need to find a free area that starts at base_vaddr
-        list_foreach(vmap_t, vmap, mmctx->mmaps)
-        {
-            const ptr_t this_vaddr = vmap->vaddr;
-            const ptr_t this_end_vaddr = this_vaddr + vmap->npages * MOS_PAGE_SIZE;
-
-            // see if this vmap overlaps with the area we want to allocate
-            if (this_vaddr < end_vaddr && this_end_vaddr > base_vaddr)
-            {
-                // this mmap overlaps with the area we want to allocate
-                // so we can't allocate here
-                return NULL;
-            }
-        }
-
-        // nothing seems to overlap
+        if (!mm_is_range_free_locked(mmctx, base_vaddr, n_pages))
+            return NULL; // some vmap overlaps with the area we want to allocate
+
         return vmap_create(mmctx, base_vaddr, n_pages);
     }
     else
     {
-        ptr_t retry_addr = base_vaddr;
-        list_foreach(vmap_t, mmap, mmctx->mmaps)
-        {
-            // we've reached the end of the user address space?
-            if (retry_addr + n_pages * MOS_PAGE_SIZE > MOS_KERNEL_START_VADDR)
-                return NULL;
-
-            const ptr_t this_vaddr = mmap->vaddr;
-            const ptr_t this_end_vaddr = this_vaddr + mmap->npages * MOS_PAGE_SIZE;
-
-            const ptr_t target_vaddr_end = retry_addr + n_pages * MOS_PAGE_SIZE;
-            if (this_vaddr < target_vaddr_end && this_end_vaddr > retry_addr)
-            {
-                // this mmap overlaps with the area we want to allocate
-                // so we can't allocate here
-                retry_addr = this_end_vaddr; // try the next area
-            }
-
-            if (retry_addr + n_pages * MOS_PAGE_SIZE <= this_vaddr)
-            {
-                // we've found a free area that is large enough
-                return vmap_create(mmctx, retry_addr, n_pages);
-            }
-        }
-
-        // we've reached the end of the list, no matter it's empty or not
-        if (retry_addr + n_pages * MOS_PAGE_SIZE <= MOS_KERNEL_START_VADDR)
-            return vmap_create(mmctx, retry_addr, n_pages);
-        else
-            return NULL;
+        ptr_t vaddr;
+        if (!mm_find_free_range_locked(mmctx, base_vaddr, n_pages, &vaddr))
+            return NULL; // we've reached the end of the user address space
+
+        return vmap_create(mmctx, vaddr, n_pages);
     }
 }
 
@@ -126,7 +88,7 @@ void mm_replace_page_locked(mm_context_t *ctx, ptr_t vaddr, pfn_t pfn, vm_flags
     mm_do_map(ctx->pgd, vaddr, pfn, 1, flags, false);
 }
 
-vmap_t *mm_clone_vmap_locked(vmap_t *src_vmap, mm_context_t *dst_ctx)
+static vmap_t *do_clone_vmap_locked(vmap_t *src_vmap, mm_context_t *dst_ctx, bool copy_mappings)
 {
     vmap_t *dst_vmap = mm_get_free_vaddr_locked(dst_ctx, src_vmap->npages, src_vmap->vaddr, VALLOC_EXACT);
 
@@ -136,15 +98,19 @@ vmap_t *mm_clone_vmap_locked(vmap_t *src_vmap, mm_context_t *dst_ctx)
         return NULL;
     }
 
-    pr_dinfo2(vmm, "copying mapping from " PTR_FMT ", %zu pages", src_vmap->vaddr, src_vmap->npages);
-    mm_do_copy(src_vmap->mmctx->pgd, dst_vmap->mmctx->pgd, src_vmap->vaddr, src_vmap->npages);
+    if (copy_mappings)
+    {
+        pr_dinfo2(vmm, "copying mapping from " PTR_FMT ", %zu pages", src_vmap->vaddr, src_vmap->npages);
+        mm_do_copy(src_vmap->mmctx->pgd, dst_vmap->mmctx->pgd, src_vmap->vaddr, src_vmap->npages);
+        dst_vmap->stat = src_vmap->stat;
+    }
 
     dst_vmap->vmflags = src_vmap->vmflags;
     dst_vmap->io = src_vmap->io;
     dst_vmap->io_offset = src_vmap->io_offset;
+    dst_vmap->io_pages_only = src_vmap->io_pages_only;
     dst_vmap->content = src_vmap->content;
     dst_vmap->type = src_vmap->type;
-    dst_vmap->stat = src_vmap->stat;
     dst_vmap->on_fault = src_vmap->on_fault;
 
     if (src_vmap->io)
@@ -153,16 +119,21 @@ vmap_t *mm_clone_vmap_locked(vmap_t *src_vmap, mm_context_t *dst_ctx)
     return dst_vmap;
 }
 
-bool mm_get_is_mapped_locked(mm_context_t *mmctx, ptr_t vaddr)
+vmap_t *mm_clone_vmap_locked(vmap_t *src_vmap, mm_context_t *dst_ctx)
 {
-    MOS_ASSERT(spinlock_is_locked(&mmctx->mm_lock));
-    list_foreach(vmap_t, vmap, mmctx->mmaps)
-    {
-        if (vmap->vaddr <= vaddr && vaddr < vmap->vaddr + vmap->npages * MOS_PAGE_SIZE)
-            return true;
-    }
+    return do_clone_vmap_locked(src_vmap, dst_ctx, true);
+}
 
-    return false;
+vmap_t *mm_clone_vmap_lazy_locked(vmap_t *src_vmap, mm_context_t *dst_ctx)
+{
+    MOS_ASSERT(src_vmap->io && src_vmap->io_pages_only && src_vmap->on_fault);
+    pr_dinfo2(vmm, "lazily cloning mapping at " PTR_FMT ", %zu pages", src_vmap->vaddr, src_vmap->npages);
+    return do_clone_vmap_locked(src_vmap, dst_ctx, false);
+}
+
+bool mm_get_is_mapped_locked(mm_context_t *mmctx, ptr_t vaddr)
+{
+    return !mm_is_range_free_locked(mmctx, ALIGN_DOWN_TO_PAGE(vaddr), 1);
 }
 
 void mm_flag_pages_locked(mm_context_t *ctx, ptr_t vaddr, size_t npages, vm_flags flags)
@@ -19,6 +19,10 @@ void pml2_traverse(pml2_t pml2, ptr_t *vaddr, size_t *n_pages, pagetable_walk_op
 
         if (pml2e_is_present(pml2e))
         {
+#if MOS_CONFIG(PML2_HUGE_CAPABLE)
+            // the walkers only understand 4K pages, and can't account for the split in the vmap
+            MOS_ASSERT_X(!platform_pml2e_is_huge(pml2e), "huge page at " PTR_FMT " must be split with vmap_split_huge_pages() first", *vaddr);
+#endif
             pml1 = pml2e_get_or_create_pml1(pml2e);
         }
         else
@@ -91,3 +95,32 @@ pml1_t pml2e_get_or_create_pml1(pml2e_t *pml2e)
     platform_pml2e_set_pml1(pml2e, pml1, va_pfn(pml1.table));
     return pml1;
 }
+
+#if MOS_CONFIG(PML2_HUGE_CAPABLE)
+void pml2e_split_huge(pml2e_t *pml2e, ptr_t vaddr)
+{
+    MOS_ASSERT(pml2e_is_present(pml2e) && platform_pml2e_is_huge(pml2e));
+
+    const pfn_t pfn = platform_pml2e_get_huge_pfn(pml2e);
+    const vm_flags flags = platform_pml2e_get_flags(pml2e);
+
+    // the frames were allocated with order 0 and are refcounted individually,
+    // so the new pml1 entries just take over the existing references
+    pml1_t pml1 = pml_create_table(pml1);
+    for (size_t i = 0; i < PML1_ENTRIES; i++)
+    {
+        pml1e_t *pml1e = &pml1.table[i];
+        platform_pml1e_set_present(pml1e, true);
+        platform_pml1e_set_flags(pml1e, flags);
+        platform_pml1e_set_pfn(pml1e, pfn + i);
+    }
+
+    platform_pml2e_set_present(pml2e, true); // this clears the huge bit
+    platform_pml2e_set_pml1(pml2e, pml1, va_pfn(pml1.table));
+    platform_pml2e_set_flags(pml2e, flags);
+
+    // drop the stale 2 MiB translation on this CPU, the caller shoots down the others
+    for (size_t i = 0; i < PML1_ENTRIES; i++)
+        platform_invalidate_tlb(vaddr + i * MOS_PAGE_SIZE);
+}
+#endif
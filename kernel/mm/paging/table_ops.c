@@ -2,6 +2,7 @@
 
 #include "mos/mm/paging/table_ops.h"
 
+#include "mos/interrupt/ipi.h"
 #include "mos/mm/mm.h"
 #include "mos/mm/mmstat.h"
 #include "mos/mm/paging/pml_types.h"
@@ -168,6 +169,86 @@ vm_flags mm_do_get_flags(pgd_t max, ptr_t vaddr)
     return flags;
 }
 
+#if MOS_CONFIG(PML2_HUGE_CAPABLE)
+static pml2e_t *mm_do_get_pml2e(pgd_t max, ptr_t vaddr, bool create)
+{
+    pml5e_t *pml5e = pml5_entry(max.max, vaddr);
+    if (!create && !pml5e_is_present(pml5e))
+        return NULL;
+
+    const pml4_t pml4 = pml5e_get_or_create_pml4(pml5e);
+    pml4e_t *pml4e = pml4_entry(pml4, vaddr);
+    if (!create && !pml4e_is_present(pml4e))
+        return NULL;
+
+    const pml3_t pml3 = pml4e_get_or_create_pml3(pml4e);
+    pml3e_t *pml3e = pml3_entry(pml3, vaddr);
+    if (!create && !pml3e_is_present(pml3e))
+        return NULL;
+
+    const pml2_t pml2 = pml3e_get_or_create_pml2(pml3e);
+    return pml2_entry(pml2, vaddr);
+}
+
+bool mm_do_can_map_huge(pgd_t max, ptr_t vaddr)
+{
+    const pml2e_t *pml2e = mm_do_get_pml2e(max, vaddr, false);
+    return !pml2e || !pml2e_is_present(pml2e);
+}
+
+bool mm_do_map_huge(pgd_t max, ptr_t vaddr, pfn_t pfn, vm_flags flags)
+{
+    MOS_ASSERT(vaddr % (PML2E_NPAGES * MOS_PAGE_SIZE) == 0);
+    MOS_ASSERT(pfn % PML2E_NPAGES == 0);
+
+    pml5e_t *pml5e = pml5_entry(max.max, vaddr);
+    pml4e_t *pml4e = pml4_entry(pml5e_get_or_create_pml4(pml5e), vaddr);
+    platform_pml4e_set_flags(pml4e, flags);
+    pml3e_t *pml3e = pml3_entry(pml4e_get_or_create_pml3(pml4e), vaddr);
+    platform_pml3e_set_flags(pml3e, flags);
+    pml2e_t *pml2e = pml2_entry(pml3e_get_or_create_pml2(pml3e), vaddr);
+
+    if (pml2e_is_present(pml2e))
+        return false; // some 4K pages in this range are already mapped
+
+    platform_pml2e_set_huge(pml2e, pfn);
+    platform_pml2e_set_flags(pml2e, flags);
+    platform_invalidate_tlb(vaddr);
+    return true;
+}
+
+static size_t mm_do_foreach_huge(pgd_t max, ptr_t vaddr, size_t n_pages, bool split)
+{
+    size_t n_huge = 0;
+    const ptr_t end = vaddr + n_pages * MOS_PAGE_SIZE;
+    for (ptr_t addr = ALIGN_DOWN(vaddr, PML2E_NPAGES * MOS_PAGE_SIZE); addr < end; addr += PML2E_NPAGES * MOS_PAGE_SIZE)
+    {
+        pml2e_t *pml2e = mm_do_get_pml2e(max, addr, false);
+        if (!pml2e || !pml2e_is_present(pml2e) || !platform_pml2e_is_huge(pml2e))
+            continue;
+
+        if (split)
+            pml2e_split_huge(pml2e, addr);
+        n_huge++;
+    }
+
+    return n_huge;
+}
+
+size_t mm_do_split_huge(pgd_t max, ptr_t vaddr, size_t n_pages)
+{
+    const size_t n_split = mm_do_foreach_huge(max, vaddr, n_pages, true);
+    if (n_split)
+        ipi_send_all(IPI_TYPE_INVALIDATE_TLB); // other CPUs may still have the 2 MiB translations
+    return n_split;
+}
+
+size_t mm_do_count_huge(pgd_t max, ptr_t vaddr, size_t n_pages)
+{
+    return mm_do_foreach_huge(max, vaddr, n_pages, false);
+}
+#endif
+
 void *__create_page_table(void)
 {
     mmstat_inc1(MEM_PAGETABLE);
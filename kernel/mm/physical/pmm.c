@@ -64,6 +64,19 @@ void pmm_free_frames(phyframe_t *start_frame, size_t n_pages)
     pmm_allocated_frames -= n_pages;
 }
 
+size_t pmm_get_free_frames(void)
+{
+    const size_t used = pmm_allocated_frames + pmm_reserved_frames;
+    return pmm_total_frames > used ? pmm_total_frames - used : 0;
+}
+
+bool pmm_below_watermark(pmm_watermark_t watermark)
+{
+    const size_t usable = pmm_total_frames - MIN(pmm_reserved_frames, pmm_total_frames);
+    const size_t percent = watermark == PMM_WATERMARK_LOW ? MOS_MM_WATERMARK_LOW_PERCENT : MOS_MM_WATERMARK_HIGH_PERCENT;
+    return pmm_get_free_frames() < usable * percent / 100;
+}
+
 pfn_t pmm_reserve_frames(pfn_t pfn_start, size_t npages)
 {
     MOS_ASSERT_X(pfn_start + npages <= pmm_total_frames, "out of bounds: " PFN_RANGE ", %zu pages", pfn_start, pfn_start + npages - 1, npages);
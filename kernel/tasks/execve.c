@@ -88,18 +88,36 @@ long process_do_execveat(process_t *process, fd_t dirfd, const char *path, const
 
     spinlock_acquire(&thread->state_lock);
 
+    // no thread is reaped by a join while the list is walked
+    spinlock_acquire(&process->threads_lock);
+    process->threads_frozen = true;
+    spinlock_release(&process->threads_lock);
+
     list_foreach(thread_t, t, process->threads)
     {
         if (t != thread)
         {
             signal_send_to_thread(t, SIGKILL); // nice
             thread_wait_for_tid(t->tid);
+            hashmap_remove(&thread_table, t->tid);
+            list_remove(t);
             thread_destroy(t);
         }
     }
 
+    spinlock_acquire(&process->threads_lock);
+    process->threads_frozen = false;
+    spinlock_release(&process->threads_lock);
+
     proc->main_thread = thread; // make current thread the only thread
 
+    if (proc->vfork_parent)
+    {
+        // the old memory belongs to the parent, switch to our own (empty) mm
+        process_vfork_release(proc);
+        mm_switch_context(proc->mm);
+    }
+
     // free old memory
     spinlock_acquire(&proc->mm->mm_lock);
     list_foreach(vmap_t, vmap, proc->mm->mmaps)
@@ -14,15 +14,24 @@
 #include <mos/mos_global.h>
 #include <mos/platform/platform.h>
 #include <mos/printk.h>
+#include <mos/tasks/kstack.h>
 #include <mos/tasks/process.h>
+#include <mos/tasks/schedule.h>
 #include <mos/tasks/task_types.h>
 #include <mos/tasks/thread.h>
+#include <mos/tasks/wait.h>
 #include <mos_stdlib.h>
 #include <mos_string.h>
 
 extern const char *vmap_type_str[];
 
-process_t *process_do_fork(process_t *parent)
+static bool vfork_child_released(wait_condition_t *cond)
+{
+    const process_t *child = cond->arg;
+    return child->vfork_parent == NULL;
+}
+
+static process_t *do_fork(process_t *parent, bool vfork)
 {
     MOS_ASSERT(process_is_valid(parent));
 
@@ -39,15 +48,32 @@ process_t *process_do_fork(process_t *parent)
     pr_emph("process %d forked to %d", parent->pid, child_p->pid);
 #endif
 
+    if (vfork)
+    {
+        // the child runs on the parent's mm (and stack) until it execs or exits, its own mm stays empty until then
+        child_p->vfork_mm = child_p->mm;
+        child_p->mm = parent->mm;
+        child_p->vfork_parent = parent;
+        goto copy_files;
+    }
+
     mm_lock_ctx_pair(parent->mm, child_p->mm);
     list_foreach(vmap_t, vmap_p, parent->mm->mmaps)
     {
         vmap_t *child_vmap = NULL;
-        switch (vmap_p->type)
+        if (vmap_p->io_pages_only)
+        {
+            // every page can be refaulted from the page cache, don't bother copying the page tables
+            child_vmap = mm_clone_vmap_lazy_locked(vmap_p, child_p->mm);
+        }
+        else
         {
-            case VMAP_TYPE_SHARED: child_vmap = mm_clone_vmap_locked(vmap_p, child_p->mm); break;
-            case VMAP_TYPE_PRIVATE: child_vmap = cow_clone_vmap_locked(child_p->mm, vmap_p); break;
-            default: mos_panic("unknown vmap"); break;
+            switch (vmap_p->type)
+            {
+                case VMAP_TYPE_SHARED: child_vmap = mm_clone_vmap_locked(vmap_p, child_p->mm); break;
+                case VMAP_TYPE_PRIVATE: child_vmap = cow_clone_vmap_locked(child_p->mm, vmap_p); break;
+                default: mos_panic("unknown vmap"); break;
+            }
         }
 #if MOS_DEBUG_FEATURE(fork)
         pr_info2("fork %d->%d: %10s, parent vmap: %pvm, child vmap: %pvm", parent->pid, child_p->pid, vmap_type_str[vmap_p->type], (void *) vmap_p, (void *) child_vmap);
@@ -57,6 +83,8 @@ process_t *process_do_fork(process_t *parent)
 
     mm_unlock_ctx_pair(parent->mm, child_p->mm);
 
+copy_files:
+
     // copy the parent's files
     for (int i = 0; i < MOS_PROCESS_MAX_OPEN_FILES; i++)
     {
@@ -75,9 +103,10 @@ process_t *process_do_fork(process_t *parent)
     thread_t *const parent_thread = current_thread;
     thread_t *child_t = thread_allocate(child_p, parent_thread->mode);
     child_t->u_stack = parent_thread->u_stack;
+    child_t->u_stack_explicit = parent_thread->u_stack_explicit;
     child_t->name = strdup(parent_thread->name);
-    const ptr_t kstack_blk = phyframe_va(mm_get_free_pages(MOS_STACK_PAGES_KERNEL));
-    stack_init(&child_t->k_stack, (void *) kstack_blk, MOS_STACK_PAGES_KERNEL * MOS_PAGE_SIZE);
+    const ptr_t kstack_blk = kstack_allocate();
+    stack_init(&child_t->k_stack, (void *) kstack_blk, KSTACK_SIZE);
 #if MOS_DEBUG_FEATURE(fork)
     pr_info2("fork: thread %d->%d", parent_thread->tid, child_t->tid);
 #endif
@@ -96,5 +125,27 @@ process_t *process_do_fork(process_t *parent)
 
     hashmap_put(&process_table, child_p->pid, child_p);
     thread_complete_init(child_t);
+
+    if (vfork)
+    {
+        // the parent must not touch its mm until the child has exec'd or exited
+        reschedule_for_wait_condition(wc_wait_for(child_p, vfork_child_released, NULL));
+        if (current_thread->waiting)
+        {
+            wc_condition_cleanup(current_thread->waiting);
+            current_thread->waiting = NULL;
+        }
+    }
+
     return child_p;
 }
+
+process_t *process_do_fork(process_t *parent)
+{
+    return do_fork(parent, false);
+}
+
+process_t *process_do_vfork(process_t *parent)
+{
+    return do_fork(parent, true);
+}
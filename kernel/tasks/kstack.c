@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mos/tasks/kstack.h"
+
+#include "mos/mm/mm.h"
+#include "mos/platform/platform.h"
+#include "mos/printk.h"
+
+#include <mos/lib/sync/spinlock.h>
+#include <mos_string.h>
+
+#if MOS_CONFIG(MOS_KSTACK_GUARD)
+#define KSTACK_GUARD_PAGES  1
+#define KSTACK_GUARD_POISON 0xdb
+#else
+#define KSTACK_GUARD_PAGES 0
+#endif
+
+#define KSTACK_TOTAL_PAGES (MOS_STACK_PAGES_KERNEL + KSTACK_GUARD_PAGES)
+
+typedef struct
+{
+    spinlock_t lock;
+    size_t count;
+    ptr_t stacks[MOS_KSTACK_CACHE_SIZE + 1]; // +1 so that a cache size of 0 compiles
+} kstack_cache_t;
+
+static PER_CPU_DECLARE(kstack_cache_t, kstack_cache);
+
+#if MOS_CONFIG(MOS_KSTACK_GUARD)
+static void kstack_check_guard(ptr_t stack)
+{
+    // the kernel direct map uses huge pages, so the guard page can't simply be unmapped, check the poison instead
+    const u8 *guard = (const u8 *) (stack - MOS_PAGE_SIZE);
+    for (size_t i = 0; i < MOS_PAGE_SIZE; i++)
+        if (unlikely(guard[i] != KSTACK_GUARD_POISON))
+            mos_panic("kernel stack overflow detected, stack " PTR_FMT ", guard byte %zu overwritten", stack, i);
+}
+#endif
+
+ptr_t kstack_allocate(void)
+{
+    kstack_cache_t *cache = per_cpu(kstack_cache);
+    spinlock_acquire(&cache->lock);
+    if (cache->count)
+    {
+        const ptr_t stack = cache->stacks[--cache->count];
+        spinlock_release(&cache->lock);
+        return stack;
+    }
+    spinlock_release(&cache->lock);
+
+    phyframe_t *frames = mm_get_free_pages(KSTACK_TOTAL_PAGES);
+    if (!frames)
+        return 0;
+
+    const ptr_t block = phyframe_va(frames);
+#if MOS_CONFIG(MOS_KSTACK_GUARD)
+    memset((void *) block, KSTACK_GUARD_POISON, MOS_PAGE_SIZE);
+#endif
+    return block + KSTACK_GUARD_PAGES * MOS_PAGE_SIZE;
+}
+
+void kstack_free(ptr_t stack)
+{
+#if MOS_CONFIG(MOS_KSTACK_GUARD)
+    kstack_check_guard(stack);
+#endif
+
+    kstack_cache_t *cache = per_cpu(kstack_cache);
+    spinlock_acquire(&cache->lock);
+    if (cache->count < MOS_KSTACK_CACHE_SIZE)
+    {
+        cache->stacks[cache->count++] = stack;
+        spinlock_release(&cache->lock);
+        return;
+    }
+    spinlock_release(&cache->lock);
+
+    const ptr_t block = stack - KSTACK_GUARD_PAGES * MOS_PAGE_SIZE;
+    mm_free_pages(va_phyframe(block), KSTACK_TOTAL_PAGES);
+}
@@ -6,6 +6,7 @@
 #include "mos/filesystem/sysfs/sysfs_autoinit.h"
 #include "mos/io/io.h"
 #include "mos/mm/mm.h"
+#include "mos/mm/page_grant.h"
 #include "mos/tasks/signal.h"
 
 #include <abi-bits/wait.h>
@@ -61,6 +62,7 @@ process_t *process_allocate(process_t *parent, const char *name)
     proc->pid = new_process_id();
     linked_list_init(&proc->threads);
     linked_list_init(&proc->children);
+    linked_list_init(&proc->page_grants);
 
     waitlist_init(&proc->signal_info.sigchild_waitlist);
 
@@ -165,7 +167,7 @@ process_t *process_new(process_t *parent, const char *name, const stdio_t *ios)
 
 process_t *process_get(pid_t pid)
 {
-    process_t *p = hashmap_get(&process_table, pid);
+    process_t *p = hashmap_get_lockless(&process_table, pid);
     if (process_is_valid(p))
         return p;
 
@@ -216,6 +218,15 @@ bool process_detach_fd(process_t *process, fd_t fd)
     return true;
 }
 
+void process_vfork_release(process_t *process)
+{
+    MOS_ASSERT(process->vfork_parent && process->vfork_mm);
+    pr_dinfo2(process, "vfork child %pp releases the mm of %pp", (void *) process, (void *) process->vfork_parent);
+    process->mm = process->vfork_mm;
+    process->vfork_mm = NULL;
+    process->vfork_parent = NULL; // the parent is resumed by the scheduler
+}
+
 pid_t process_wait_for_pid(pid_t pid, u32 *exit_code, u32 flags)
 {
     if (pid == -1)
@@ -293,6 +304,14 @@ void process_handle_exit(process_t *process, u8 exit_code, signal_t signal)
 
     process->exit_status = W_EXITCODE(exit_code, signal);
 
+    if (process->vfork_parent)
+        process_vfork_release(process);
+
+    // no thread is reaped by a join from now on, so the list can be walked while waiting
+    spinlock_acquire(&process->threads_lock);
+    process->threads_frozen = true;
+    spinlock_release(&process->threads_lock);
+
     list_foreach(thread_t, thread, process->threads)
     {
         spinlock_acquire(&thread->state_lock);
@@ -352,6 +371,9 @@ void process_handle_exit(process_t *process, u8 exit_code, signal_t signal)
     }
 
     pr_dinfo2(process, "closed %zu/%zu files owned by %pp", files_closed, files_total, (void *) process);
+
+    // nobody can take the pages the process has granted any more
+    page_grant_release_all(process);
     process->exited = true;
 
     // wake up parent
@@ -368,24 +390,25 @@ ptr_t process_grow_heap(process_t *process, size_t npages)
 {
     MOS_ASSERT(process_is_valid(process));
 
-    vmap_t *heap = NULL;
-    list_foreach(vmap_t, mmap, process->mm->mmaps)
-    {
-        if (mmap->content == VMAP_HEAP)
-        {
-            heap = mmap;
-            spinlock_acquire(&heap->lock);
-            break;
-        }
-    }
-
+    spinlock_acquire(&process->mm->mm_lock);
+    vmap_t *heap = process->mm->heap;
     MOS_ASSERT(heap != NULL);
+    spinlock_acquire(&heap->lock);
 
     const ptr_t heap_top = heap->vaddr + heap->npages * MOS_PAGE_SIZE;
 
-    heap->npages += npages; // let the page fault handler do the rest of the allocation
-    pr_dinfo2(process, "grew heap of process %pp by %zu pages", (void *) process, npages);
+    // let the page fault handler do the rest of the allocation
+    const bool grown = vmap_grow(heap, npages);
     spinlock_release(&heap->lock);
+    spinlock_release(&process->mm->mm_lock);
+
+    if (!grown)
+    {
+        pr_warn("failed to grow heap of process %pp by %zu pages, it would overlap with another vmap", (void *) process, npages);
+        return 0;
+    }
+
+    pr_dinfo2(process, "grew heap of process %pp by %zu pages", (void *) process, npages);
     return heap_top + npages * MOS_PAGE_SIZE;
 }
 
@@ -398,7 +421,10 @@ void process_dump_mmaps(const process_t *process)
         i++;
         const char *typestr = vmap_content_str[map->content];
         const char *forkmode = vmap_type_str[map->type];
-        pr_info2("  %3zd: %pvm, %s, %s", i, (void *) map, typestr, forkmode);
+        if (map->stat.thp)
+            pr_info2("  %3zd: %pvm, %s, %s, %zu huge pages", i, (void *) map, typestr, forkmode, map->stat.thp);
+        else
+            pr_info2("  %3zd: %pvm, %s, %s", i, (void *) map, typestr, forkmode);
     }
 
     pr_info("total: %zd memory regions", i);
@@ -465,6 +491,9 @@ static bool process_sysfs_vmap_stat(sysfs_file_t *f)
         sysfs_printf(f, stat_line("%zu pages"), "Regular", vmap->stat.regular);
         sysfs_printf(f, stat_line("%zu pages"), "PageCache", vmap->stat.pagecache);
         sysfs_printf(f, stat_line("%zu pages"), "CoW", vmap->stat.cow);
+        sysfs_printf(f, stat_line("%zu pages"), "HugePages", vmap->stat.thp);
+        sysfs_printf(f, stat_line("%zu faults"), "CoWCopied", vmap->stat.cow_copied);
+        sysfs_printf(f, stat_line("%zu faults"), "CoWReused", vmap->stat.cow_reused);
 #undef stat_line
         sysfs_printf(f, "\n");
     }
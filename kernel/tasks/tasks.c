@@ -15,8 +15,8 @@
 #include <mos/tasks/thread.h>
 #include <mos_stdlib.h>
 
-#define PROCESS_HASHTABLE_SIZE 512
-#define THREAD_HASHTABLE_SIZE  512
+#define PROCESS_HASHTABLE_SIZE 64
+#define THREAD_HASHTABLE_SIZE  64
 
 slab_t *process_cache = NULL, *thread_cache = NULL;
 SLAB_AUTOINIT("process", process_cache, process_t);
@@ -11,6 +11,7 @@
 #include <mos/mm/paging/paging.h>
 #include <mos/platform/platform.h>
 #include <mos/printk.h>
+#include <mos/tasks/kstack.h>
 #include <mos/tasks/process.h>
 #include <mos/tasks/schedule.h>
 #include <mos/tasks/task_types.h>
@@ -59,11 +60,21 @@ void thread_destroy(thread_t *thread)
         process_t *const owner = thread->owner;
         spinlock_acquire(&owner->mm->mm_lock);
         vmap_t *const stack = vmap_obtain(owner->mm, (ptr_t) thread->u_stack.top - 1, NULL);
-        vmap_destroy(stack);
+        if (stack && thread->u_stack_explicit)
+        {
+            // the stack belongs to userspace, unclaim it so that it can be reused for another thread
+            stack->content = VMAP_MMAP;
+            spinlock_release(&stack->lock);
+        }
+        else if (stack) // a vfork child that has exited ran on the parent's stack
+        {
+            vmap_destroy(stack);
+        }
         spinlock_release(&owner->mm->mm_lock);
     }
 
-    mm_free_pages(va_phyframe((ptr_t) thread->k_stack.top) - MOS_STACK_PAGES_KERNEL, MOS_STACK_PAGES_KERNEL);
+    platform_context_cleanup(thread);
+    kstack_free((ptr_t) thread->k_stack.top - KSTACK_SIZE);
 
     kfree(thread);
 }
@@ -77,8 +88,8 @@ thread_t *thread_new(process_t *owner, thread_mode tmode, const char *name, size
     pr_dinfo2(thread, "creating new thread %pt, owner=%pp", (void *) t, (void *) owner);
 
     // Kernel stack
-    const ptr_t kstack_blk = phyframe_va(mm_get_free_pages(MOS_STACK_PAGES_KERNEL));
-    stack_init(&t->k_stack, (void *) kstack_blk, MOS_STACK_PAGES_KERNEL * MOS_PAGE_SIZE);
+    const ptr_t kstack_blk = kstack_allocate();
+    stack_init(&t->k_stack, (void *) kstack_blk, KSTACK_SIZE);
 
     if (tmode != THREAD_MODE_USER)
     {
@@ -137,6 +148,7 @@ thread_t *thread_new(process_t *owner, thread_mode tmode, const char *name, size
     mm_unlock_ctx_pair(owner->mm, NULL);
     stack_init(&t->u_stack, (void *) stack_bottom, user_stack_size);
     t->u_stack.head = (ptr_t) explicit_stack_top;
+    t->u_stack_explicit = true;
     return t;
 
 done_efault:
@@ -158,13 +170,59 @@ thread_t *thread_complete_init(thread_t *thread)
 
 thread_t *thread_get(tid_t tid)
 {
-    thread_t *t = hashmap_get(&thread_table, tid);
+    thread_t *t = hashmap_get_lockless(&thread_table, tid);
     if (thread_is_valid(t))
         return t;
 
     return NULL;
 }
 
+static bool thread_is_on_cpu(const thread_t *thread)
+{
+#if MOS_CONFIG(MOS_SMP)
+    for (u32 i = 0; i < platform_info->num_cpus; i++)
+        if (platform_info->cpu.percpu_value[i].thread == thread)
+            return true;
+    return false;
+#else
+    return platform_info->cpu.thread == thread;
+#endif
+}
+
+void thread_try_reap(tid_t tid)
+{
+    process_t *const process = current_process;
+    spinlock_acquire(&process->threads_lock);
+    if (process->threads_frozen)
+    {
+        // exit or exec is walking the thread list, it destroys the dead threads itself
+        spinlock_release(&process->threads_lock);
+        return;
+    }
+
+    thread_t *target = thread_get(tid);
+    if (!target || target->owner != process || target == process->main_thread)
+    {
+        spinlock_release(&process->threads_lock);
+        return;
+    }
+
+    spinlock_acquire(&target->state_lock);
+    const bool can_reap = target->state == THREAD_STATE_DEAD && !thread_is_on_cpu(target);
+    spinlock_release(&target->state_lock);
+
+    // whoever removes it from the thread table owns it
+    if (!can_reap || hashmap_remove(&thread_table, tid) != target)
+    {
+        spinlock_release(&process->threads_lock);
+        return;
+    }
+
+    list_remove(target);
+    spinlock_release(&process->threads_lock);
+    thread_destroy(target);
+}
+
 bool thread_wait_for_tid(tid_t tid)
 {
     thread_t *target = thread_get(tid);
@@ -182,7 +240,6 @@ bool thread_wait_for_tid(tid_t tid)
 
     bool ok = reschedule_for_waitlist(&target->waiters);
     MOS_UNUSED(ok); // true: thread is dead, false: thread is already dead at the time of calling
-
     return true;
 }
 
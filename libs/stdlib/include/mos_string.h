@@ -25,6 +25,12 @@ MOSAPI int memcmp(const void *s1, const void *s2, size_t n);
 MOSAPI void memzero(void *s, size_t n);
 MOSAPI void *memchr(const void *m, int c, size_t n);
 
+#define MOS_STRING_PAGE_SIZE 4096
+
+// Copy or clear a 4 KiB page, the pointers must be page-aligned.
+MOSAPI void memcpy_page(void *__restrict dest, const void *__restrict src);
+MOSAPI void memzero_page(void *dest);
+
 MOSAPI char *strcpy(char *__restrict dest, const char *__restrict src);
 MOSAPI char *strcat(char *__restrict dest, const char *__restrict src);
 
@@ -5,12 +5,75 @@
 #include <mos/moslib_global.h>
 #include <mos_stdlib.h>
 
+// The string functions below read a word (or, in userspace on x86_64, a 16-byte SSE2 vector) at
+// a time. A load never crosses into the next page unless the string does, so it can't fault: the
+// ones that start from an aligned address can't, and the others check before loading. Bytes read
+// past the end of the string are ignored.
+
+MOS_STATIC_ASSERT(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "the first matching byte is the lowest one");
+
+#define STRING_ONES  0x0101010101010101ull
+#define STRING_HIGHS 0x8080808080808080ull
+
+#if defined(__SSE2__) && !defined(__MOS_KERNEL__)
+#define STRING_USE_SSE2 1
+#else
+#define STRING_USE_SSE2 0
+#endif
+
+// the high bit of each zero byte is set, exact up to (and including) the first zero byte
+should_inline u64 string_zero_bytes(u64 word)
+{
+    return (word - STRING_ONES) & ~word & STRING_HIGHS;
+}
+
+should_inline size_t string_first_byte(u64 bits)
+{
+    return __builtin_ctzll(bits) / 8;
+}
+
+should_inline bool string_can_load(const void *p, size_t size)
+{
+    return ((ptr_t) p & (MOS_STRING_PAGE_SIZE - 1)) <= MOS_STRING_PAGE_SIZE - size;
+}
+
+should_inline u64 string_load_unaligned(const char *p)
+{
+    u64 word;
+    __builtin_memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+#if STRING_USE_SSE2
+typedef char string_v16 __attribute__((vector_size(16), may_alias));
+typedef char string_v16u __attribute__((vector_size(16), aligned(1), may_alias));
+
+// a bit for each byte of the vector that is equal to c
+should_inline u32 string_v16_match(string_v16 v, char c)
+{
+    return __builtin_ia32_pmovmskb128(v == (string_v16){ 0 } + c);
+}
+#endif
+
 size_t strlen(const char *str)
 {
-    size_t len = 0;
-    while (str[len])
-        len++;
-    return len;
+#if STRING_USE_SSE2
+    const string_v16 *v = (const string_v16 *) ((ptr_t) str & ~(ptr_t) 15);
+    u32 zeros = string_v16_match(*v, 0) >> ((ptr_t) str & 15); // ignore the bytes before the string
+    if (zeros)
+        return __builtin_ctz(zeros);
+
+    while (!(zeros = string_v16_match(*++v, 0)))
+        ;
+    return (const char *) v + __builtin_ctz(zeros) - str;
+#else
+    const u64 *w = (const u64 *) ((ptr_t) str & ~(ptr_t) 7);
+    const size_t skip = (ptr_t) str & 7;
+    u64 zeros = string_zero_bytes(*w | ((1ull << (skip * 8)) - 1)); // the bytes before the string are not zeros
+    while (!zeros)
+        zeros = string_zero_bytes(*++w);
+    return (const char *) w + string_first_byte(zeros) - str;
+#endif
 }
 
 size_t strnlen(const char *str, size_t n)
@@ -23,14 +86,47 @@ size_t strnlen(const char *str, size_t n)
 
 s32 strcmp(const char *s1, const char *s2)
 {
-    size_t i = 0;
-    while (s1[i] && s2[i] && s1[i] == s2[i])
-        i++;
-    return s1[i] - s2[i];
+    while (true)
+    {
+#if STRING_USE_SSE2
+        if (string_can_load(s1, 16) && string_can_load(s2, 16))
+        {
+            const string_v16 a = *(const string_v16u *) s1, b = *(const string_v16u *) s2;
+            const u32 stop = __builtin_ia32_pmovmskb128((a != b) | (a == (string_v16){ 0 }));
+            if (stop)
+                return (u8) s1[__builtin_ctz(stop)] - (u8) s2[__builtin_ctz(stop)];
+            s1 += 16, s2 += 16;
+            continue;
+        }
+#endif
+        if (string_can_load(s1, 8) && string_can_load(s2, 8))
+        {
+            const u64 a = string_load_unaligned(s1), b = string_load_unaligned(s2);
+            const u64 stop = (a ^ b) | string_zero_bytes(a); // the first byte that differs, or ends both strings
+            if (stop)
+                return (u8) s1[string_first_byte(stop)] - (u8) s2[string_first_byte(stop)];
+            s1 += 8, s2 += 8;
+            continue;
+        }
+
+        // one of them is about to cross a page
+        const u8 c1 = *s1++, c2 = *s2++;
+        if (c1 != c2 || c1 == '\0')
+            return c1 - c2;
+    }
 }
 
 s32 strncmp(const char *str1, const char *str2, size_t n)
 {
+    while (n >= 8 && string_can_load(str1, 8) && string_can_load(str2, 8))
+    {
+        const u64 a = string_load_unaligned(str1), b = string_load_unaligned(str2);
+        const u64 stop = (a ^ b) | string_zero_bytes(a);
+        if (stop)
+            return (u8) str1[string_first_byte(stop)] - (u8) str2[string_first_byte(stop)];
+        str1 += 8, str2 += 8, n -= 8;
+    }
+
     u8 c1, c2;
     while (n-- > 0)
     {
@@ -61,71 +157,232 @@ s32 strncasecmp(const char *a, const char *b, size_t n)
     return 0;
 }
 
-void *memcpy(void *__restrict _dst, const void *__restrict _src, size_t n)
+// The mem* functions below pick an implementation by what the CPU supports, on x86_64:
+// - 'rep movsb' and 'rep stosb' are the fastest way to copy or fill anything but the shortest
+//   buffers if ERMS (enhanced rep movsb/stosb) is present, and FSRM makes them fast for short ones too
+// - userspace can also use 32-byte AVX2 moves, the kernel is built without SIMD and never does
+// Otherwise (and on other architectures) they copy a word at a time.
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+
+#define MEMOPS_INITIALISED BIT(0)
+#define MEMOPS_ERMS        BIT(1) // enhanced rep movsb/stosb
+#define MEMOPS_FSRM        BIT(2) // fast short rep movsb
+#define MEMOPS_AVX2        BIT(3) // AVX2, and the OS saves the AVX state
+
+#define CPUID_7_B_ERMS BIT(9)
+#define CPUID_7_D_FSRM BIT(4)
+
+#define MEMOPS_REP_THRESHOLD      256 // below this, starting a 'rep movsb' costs more than it saves without FSRM
+#define MEMOPS_REP_THRESHOLD_FSRM 32
+
+static u32 memops_features = 0;
+
+static u32 memops_detect(void)
+{
+    u32 features = MEMOPS_INITIALISED;
+    unsigned int a, b, c, d;
+    if (!__get_cpuid_count(7, 0, &a, &b, &c, &d))
+        return features;
+
+    if (b & CPUID_7_B_ERMS)
+        features |= MEMOPS_ERMS;
+    if (d & CPUID_7_D_FSRM)
+        features |= MEMOPS_FSRM;
+
+#ifndef __MOS_KERNEL__
+    unsigned int a1, b1, c1, d1;
+    if ((b & bit_AVX2) && __get_cpuid(1, &a1, &b1, &c1, &d1) && (c1 & bit_OSXSAVE))
+    {
+        u32 xcr0_lo, xcr0_hi;
+        __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        if ((xcr0_lo & 0x6) == 0x6) // both the SSE and AVX states are enabled
+            features |= MEMOPS_AVX2;
+    }
+#endif
+
+    return features;
+}
+
+should_inline u32 memops_get_features(void)
+{
+    u32 features = __atomic_load_n(&memops_features, __ATOMIC_RELAXED);
+    if (unlikely(!features))
+        __atomic_store_n(&memops_features, features = memops_detect(), __ATOMIC_RELAXED); // racing here is harmless
+    return features;
+}
+
+should_inline void memops_rep_movsb(void *dst, const void *src, size_t n)
+{
+    __asm__ volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(n) : : "memory");
+}
+
+should_inline void memops_rep_stosb(void *dst, u8 c, size_t n)
+{
+    __asm__ volatile("rep stosb" : "+D"(dst), "+c"(n) : "a"(c) : "memory");
+}
+
+#ifndef __MOS_KERNEL__
+typedef char memops_v32 __attribute__((vector_size(32), aligned(1), may_alias));
+
+// overlapping head and tail moves take care of the lengths that are not a multiple of 32
+__attribute__((target("avx2"))) static void memops_avx2_copy(char *dst, const char *src, size_t n)
+{
+    const memops_v32 tail = *(const memops_v32 *) (src + n - 32);
+    for (size_t i = 0; i < n - 32; i += 32)
+        *(memops_v32 *) (dst + i) = *(const memops_v32 *) (src + i);
+    *(memops_v32 *) (dst + n - 32) = tail;
+}
+
+__attribute__((target("avx2"))) static void memops_avx2_fill(char *dst, u8 c, size_t n)
+{
+    const memops_v32 v = (memops_v32){ 0 } + (char) c;
+    for (size_t i = 0; i < n - 32; i += 32)
+        *(memops_v32 *) (dst + i) = v;
+    *(memops_v32 *) (dst + n - 32) = v;
+}
+#endif
+
+should_inline bool memops_use_rep(u32 features, size_t n)
 {
-    // https://github.com/eblot/newlib/blob/master/newlib/libc/string/memcpy.c
+    return (features & MEMOPS_ERMS) && n >= ((features & MEMOPS_FSRM) ? MEMOPS_REP_THRESHOLD_FSRM : MEMOPS_REP_THRESHOLD);
+}
+
+// AVX2 wins for medium sizes, 'rep movsb' is better once a copy is large enough to use its
+// cache-line-sized internal moves
+static bool memops_x86_copy(void *dst, const void *src, size_t n)
+{
+    const u32 features = memops_get_features();
+#ifndef __MOS_KERNEL__
+    if ((features & MEMOPS_AVX2) && n >= 32 && n <= 2048)
+    {
+        memops_avx2_copy(dst, src, n);
+        return true;
+    }
+#endif
+    if (memops_use_rep(features, n))
+    {
+        memops_rep_movsb(dst, src, n);
+        return true;
+    }
+    return false;
+}
 
-#define UNALIGNED(X, Y) (((long) X & (sizeof(long) - 1)) | ((long) Y & (sizeof(long) - 1))) // Nonzero if either X or Y is not aligned on a "long" boundary.
-#define BIGBLOCKSIZE    (sizeof(long) << 2)                                                 // How many bytes are copied each iteration of the 4X unrolled loop.
-#define LITTLEBLOCKSIZE (sizeof(long))                                                      // How many bytes are copied each iteration of the word copy loop.
-#define TOO_SMALL(LEN)  ((LEN) < BIGBLOCKSIZE)                                              // Threshold for punting to the byte copier.
+static bool memops_x86_fill(void *dst, u8 c, size_t n)
+{
+    const u32 features = memops_get_features();
+#ifndef __MOS_KERNEL__
+    if ((features & MEMOPS_AVX2) && n >= 32 && n <= 2048)
+    {
+        memops_avx2_fill(dst, c, n);
+        return true;
+    }
+#endif
+    if (memops_use_rep(features, n))
+    {
+        memops_rep_stosb(dst, c, n);
+        return true;
+    }
+    return false;
+}
+#endif
 
-    char *dst = _dst;
-    const char *src = _src;
+static void memops_copy_forward(char *dst, const char *src, size_t n)
+{
+    // Nonzero if either X or Y is not aligned on a "long" boundary.
+#define UNALIGNED(X, Y) (((long) X & (sizeof(long) - 1)) | ((long) Y & (sizeof(long) - 1)))
 
-    /* If the size is small, or either SRC or DST is unaligned,
-       then punt into the byte copy loop.  This should be rare.  */
-    if (!TOO_SMALL(n) && !UNALIGNED(src, dst))
+    if (n >= sizeof(long) * 4 && !UNALIGNED(src, dst))
     {
         long *aligned_dst = (long *) dst;
-        const long *aligned_src = (long *) src;
+        const long *aligned_src = (const long *) src;
 
-        /* Copy 4X long words at a time if possible.  */
-        while (n >= BIGBLOCKSIZE)
+        // Copy 4X long words at a time if possible, each one is read before it is written, so that
+        // this is also correct for memmove() when the destination is below the source.
+        while (n >= sizeof(long) * 4)
         {
-            *aligned_dst++ = *aligned_src++;
-            *aligned_dst++ = *aligned_src++;
-            *aligned_dst++ = *aligned_src++;
-            *aligned_dst++ = *aligned_src++;
-            n -= BIGBLOCKSIZE;
+            const long a = aligned_src[0], b = aligned_src[1], c = aligned_src[2], d = aligned_src[3];
+            aligned_dst[0] = a, aligned_dst[1] = b, aligned_dst[2] = c, aligned_dst[3] = d;
+            aligned_dst += 4, aligned_src += 4;
+            n -= sizeof(long) * 4;
         }
 
-        /* Copy one long word at a time if possible.  */
-        while (n >= LITTLEBLOCKSIZE)
+        while (n >= sizeof(long))
         {
             *aligned_dst++ = *aligned_src++;
-            n -= LITTLEBLOCKSIZE;
+            n -= sizeof(long);
         }
 
-        /* Pick up any residual with a byte copier.  */
         dst = (char *) aligned_dst;
-        src = (char *) aligned_src;
+        src = (const char *) aligned_src;
     }
 
     while (n--)
         *dst++ = *src++;
+}
+
+static void memops_copy_backward(char *dst, const char *src, size_t n)
+{
+    dst += n;
+    src += n;
+
+    if (n >= sizeof(long) && !UNALIGNED(src, dst))
+    {
+        long *aligned_dst = (long *) dst;
+        const long *aligned_src = (const long *) src;
+        while (n >= sizeof(long))
+        {
+            *--aligned_dst = *--aligned_src;
+            n -= sizeof(long);
+        }
+
+        dst = (char *) aligned_dst;
+        src = (const char *) aligned_src;
+    }
+
+    while (n--)
+        *--dst = *--src;
+#undef UNALIGNED
+}
 
+void *memcpy(void *__restrict _dst, const void *__restrict _src, size_t n)
+{
+#if defined(__x86_64__)
+    if (memops_x86_copy(_dst, _src, n))
+        return _dst;
+#endif
+
+    memops_copy_forward(_dst, _src, n);
     return _dst;
 }
 
 void *memmove(void *dest, const void *source, size_t length)
 {
-    // https://github.com/eblot/newlib/blob/master/newlib/libc/string/memmove.c
     char *dst = dest;
     const char *src = source;
 
-    if (src < dst && dst < src + length)
+    if (dst == src || length == 0)
+        return dest;
+
+    if (dst + length <= src || src + length <= dst)
+        return memcpy(dest, source, length); // they don't overlap
+
+    if (dst < src)
     {
-        /* Have to copy backwards */
-        src += length;
-        dst += length;
-        while (length--)
-            *--dst = *--src;
+#if defined(__x86_64__)
+        // a forward 'rep movsb' is still correct when the destination is below the source
+        if (memops_use_rep(memops_get_features(), length))
+        {
+            memops_rep_movsb(dst, src, length);
+            return dest;
+        }
+#endif
+        memops_copy_forward(dst, src, length);
     }
     else
     {
-        while (length--)
-            *dst++ = *src++;
+        memops_copy_backward(dst, src, length);
     }
 
     return dest;
@@ -133,9 +390,23 @@ void *memmove(void *dest, const void *source, size_t length)
 
 void *memset(void *s, int c, size_t n)
 {
+#if defined(__x86_64__)
+    if (memops_x86_fill(s, c, n))
+        return s;
+#endif
+
     u8 *d = s;
-    for (size_t i = 0; i < n; i++)
-        d[i] = c;
+    while (n && ((ptr_t) d & (sizeof(u64) - 1)))
+        *d++ = c, n--;
+
+    const u64 pattern = (u8) c * 0x0101010101010101ull;
+    u64 *lds = (u64 *) d;
+    for (; n >= sizeof(u64); n -= sizeof(u64))
+        *lds++ = pattern;
+
+    d = (u8 *) lds;
+    while (n--)
+        *d++ = c;
     return s;
 }
 
@@ -152,22 +423,28 @@ int memcmp(const void *s1, const void *s2, size_t n)
 
 void memzero(void *s, size_t n)
 {
-    typedef u64 largeint_t;
-    largeint_t *lsrc = (largeint_t *) s;
-
-    while (n >= sizeof(largeint_t))
-    {
-        *lsrc++ = 0;
-        n -= sizeof(largeint_t);
-    }
+    memset(s, 0, n);
+}
 
-    char *csrc = (char *) lsrc;
+// 'rep movsq' and 'rep stosq' are as fast as the byte variants on aligned pages, without needing ERMS
+void memcpy_page(void *__restrict dest, const void *__restrict src)
+{
+#if defined(__x86_64__)
+    size_t n = MOS_STRING_PAGE_SIZE / sizeof(u64);
+    __asm__ volatile("rep movsq" : "+D"(dest), "+S"(src), "+c"(n) : : "memory");
+#else
+    memops_copy_forward(dest, src, MOS_STRING_PAGE_SIZE);
+#endif
+}
 
-    while (n > 0)
-    {
-        *csrc++ = 0;
-        n--;
-    }
+void memzero_page(void *dest)
+{
+#if defined(__x86_64__)
+    size_t n = MOS_STRING_PAGE_SIZE / sizeof(u64);
+    __asm__ volatile("rep stosq" : "+D"(dest), "+c"(n) : "a"(0ul) : "memory");
+#else
+    memset(dest, 0, MOS_STRING_PAGE_SIZE);
+#endif
 }
 
 void *memchr(const void *m, int c, size_t n)
@@ -235,13 +512,34 @@ char *strndup(const char *src, size_t len)
 
 char *strchr(const char *s, int c)
 {
-    while (*s)
+    const char ch = c;
+#if STRING_USE_SSE2
+    const string_v16 *v = (const string_v16 *) ((ptr_t) s & ~(ptr_t) 15);
+    u32 stop = (string_v16_match(*v, 0) | string_v16_match(*v, ch)) >> ((ptr_t) s & 15) << ((ptr_t) s & 15);
+    while (!stop)
     {
-        if (*s == c)
+        v++;
+        stop = string_v16_match(*v, 0) | string_v16_match(*v, ch);
+    }
+    const char *found = (const char *) v + __builtin_ctz(stop);
+#else
+    while ((ptr_t) s & 7)
+    {
+        if (*s == ch)
             return (char *) s;
+        if (*s == '\0')
+            return NULL;
         s++;
     }
-    return NULL;
+
+    const u64 pattern = (u8) ch * STRING_ONES;
+    const u64 *w = (const u64 *) s;
+    u64 stop;
+    while (!(stop = string_zero_bytes(*w) | string_zero_bytes(*w ^ pattern)))
+        w++;
+    const char *found = (const char *) w + string_first_byte(stop);
+#endif
+    return *found == ch ? (char *) found : NULL;
 }
 
 char *strrchr(const char *s, int c)
@@ -35,6 +35,11 @@ def syscall_is_noreturn(e):
     return e["return"] is None
 
 
+def syscall_is_always_inline(e):
+    # e.g. vfork, whose child shares the caller's stack and must not return through a frame of its own
+    return e.get("always_inline", False)
+
+
 def syscall_has_return_value(e):
     return (not syscall_is_noreturn(e)) and (e["return"] != "void")
 
@@ -203,7 +208,8 @@ class UsermodeWrapperGenerator(BaseAbstractGenerator):
         vals = (syscall_format_return_type(e),
                 syscall_name_with_prefix(e),
                 syscall_args(e))
-        self.gen("should_inline %s%s(%s)" % vals)
+        inline = "must_inline" if syscall_is_always_inline(e) else "should_inline"
+        self.gen("%s %s%s(%s)" % ((inline,) + vals))
         self.gen("{")
         with self.scope:
             self.gen("%splatform_syscall%d(%s);" % (return_stmt,
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+
+# Create a cpio archive (the "crc" variant of the newc format, as written by `cpio --format=crc`)
+# from a directory.
+#
+# Unlike cpio, the data of regular files that span at least one page starts at a page-aligned
+# offset in the archive, so that the kernel can put the initrd's own pages into the page cache
+# instead of copying them. The gap is filled by padding the file name with extra NUL bytes, which
+# is still a valid archive for any cpio reader.
+
+import os
+import stat
+from sys import argv
+
+PAGE_SIZE = 4096
+HEADER_SIZE = 110
+MAGIC = b"070702"
+
+
+def align_up(value: int, alignment: int) -> int:
+    return (value + alignment - 1) // alignment * alignment
+
+
+class Archive:
+    def __init__(self, out):
+        self.out = out
+        self.offset = 0
+        self.next_ino = 1
+
+    def write(self, data: bytes):
+        self.out.write(data)
+        self.offset += len(data)
+
+    def pad_to(self, alignment: int):
+        self.write(b"\0" * (align_up(self.offset, alignment) - self.offset))
+
+    def add(self, name: str, st, data: bytes):
+        name_bytes = name.encode() + b"\0"
+        mode = st.st_mode if st else 0
+        page_align = stat.S_ISREG(mode) and len(data) >= PAGE_SIZE
+        if page_align:
+            name_end = self.offset + HEADER_SIZE + len(name_bytes)
+            name_bytes += b"\0" * (align_up(name_end, PAGE_SIZE) - name_end)
+
+        fields = [
+            self.next_ino if st else 0,  # ino
+            mode,
+            st.st_uid if st else 0,
+            st.st_gid if st else 0,
+            (2 if stat.S_ISDIR(mode) else 1) if st else 1,  # nlink
+            int(st.st_mtime) if st else 0,
+            len(data),  # filesize
+            0,  # devmajor
+            0,  # devminor
+            os.major(st.st_rdev) if st else 0,
+            os.minor(st.st_rdev) if st else 0,
+            len(name_bytes),  # namesize
+            sum(data) & 0xFFFFFFFF,  # check
+        ]
+        self.next_ino += 1
+
+        self.write(MAGIC + b"".join(b"%08X" % field for field in fields))
+        self.write(name_bytes)
+        self.pad_to(4)
+        assert not page_align or self.offset % PAGE_SIZE == 0
+        self.write(data)
+        self.pad_to(4)
+
+
+def collect(root: str) -> list:
+    paths = []
+    for dirpath, dirnames, filenames in os.walk(root):
+        for name in dirnames + filenames:
+            paths.append(os.path.relpath(os.path.join(dirpath, name), root))
+    return sorted(paths)
+
+
+def main():
+    if len(argv) != 3:
+        print("Usage: %s <directory> <output.cpio>" % argv[0])
+        exit(1)
+
+    root = argv[1]
+    with open(argv[2], "wb") as f:
+        archive = Archive(f)
+        archive.add(".", os.lstat(root), b"")
+
+        for path in collect(root):
+            full_path = os.path.join(root, path)
+            st = os.lstat(full_path)
+            if stat.S_ISLNK(st.st_mode):
+                data = os.readlink(full_path).encode()
+            elif stat.S_ISREG(st.st_mode):
+                with open(full_path, "rb") as src:
+                    data = src.read()
+            else:
+                data = b""
+            archive.add(path, st, data)
+
+        archive.add("TRAILER!!!", None, b"")
+        archive.pad_to(512)  # cpio pads the archive to its block size
+
+
+if __name__ == "__main__":
+    main()
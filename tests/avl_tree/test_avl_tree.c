@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "test_engine_impl.h"
+
+#include <mos/lib/structures/avl_tree.h>
+
+typedef struct
+{
+    int key;
+    size_t subtree_size; // augmented data
+    as_avl_node;
+} test_item_t;
+
+static int test_item_compare(const avl_node_t *a, const avl_node_t *b)
+{
+    return avl_entry(a, test_item_t)->key - avl_entry(b, test_item_t)->key;
+}
+
+static void test_item_augment(avl_node_t *node)
+{
+    test_item_t *item = avl_entry(node, test_item_t);
+    item->subtree_size = 1;
+    if (node->left)
+        item->subtree_size += avl_entry(node->left, test_item_t)->subtree_size;
+    if (node->right)
+        item->subtree_size += avl_entry(node->right, test_item_t)->subtree_size;
+}
+
+// returns the height of the subtree, or -1 if the subtree is broken
+static s32 test_avl_verify(const avl_node_t *node, const avl_node_t *parent)
+{
+    if (!node)
+        return 0;
+
+    if (node->parent != parent)
+        return -1;
+
+    const s32 lh = test_avl_verify(node->left, node);
+    const s32 rh = test_avl_verify(node->right, node);
+    if (lh < 0 || rh < 0 || lh - rh > 1 || rh - lh > 1)
+        return -1;
+
+    const s32 height = 1 + (lh > rh ? lh : rh);
+    if (node->height != height)
+        return -1;
+
+    size_t size = 1;
+    if (node->left)
+        size += avl_entry(node->left, test_item_t)->subtree_size;
+    if (node->right)
+        size += avl_entry(node->right, test_item_t)->subtree_size;
+    if (avl_entry(node, test_item_t)->subtree_size != size)
+        return -1;
+
+    return height;
+}
+
+MOS_TEST_CASE(avl_tree_insert_in_order)
+{
+    avl_tree_t tree = { 0 };
+    test_item_t items[64];
+
+    for (int i = 0; i < 64; i++)
+    {
+        items[i].key = i;
+        avl_insert(&tree, avl_node(&items[i]), test_item_compare, test_item_augment);
+    }
+
+    // a balanced tree with 64 nodes has a height of 7 at most
+    MOS_TEST_ASSERT(test_avl_verify(tree.root, NULL) > 0, "tree is not balanced");
+    MOS_TEST_ASSERT(tree.root->height <= 7, "tree is too high: %d", tree.root->height);
+    MOS_TEST_CHECK(avl_entry(tree.root, test_item_t)->subtree_size, 64);
+
+    int expected = 0;
+    for (avl_node_t *node = avl_first(&tree); node; node = avl_next(node))
+        MOS_TEST_CHECK(avl_entry(node, test_item_t)->key, expected++);
+    MOS_TEST_CHECK(expected, 64);
+
+    for (avl_node_t *node = avl_last(&tree); node; node = avl_prev(node))
+        MOS_TEST_CHECK(avl_entry(node, test_item_t)->key, --expected);
+    MOS_TEST_CHECK(expected, 0);
+}
+
+MOS_TEST_CASE(avl_tree_remove)
+{
+    avl_tree_t tree = { 0 };
+    test_item_t items[100];
+
+    // insert in a scrambled order
+    for (int i = 0; i < 100; i++)
+    {
+        items[i].key = (i * 37) % 100;
+        avl_insert(&tree, avl_node(&items[i]), test_item_compare, test_item_augment);
+    }
+    MOS_TEST_ASSERT(test_avl_verify(tree.root, NULL) > 0, "tree is broken after insertion");
+
+    // remove every odd key, including nodes with two children
+    for (int i = 0; i < 100; i++)
+    {
+        if (items[i].key % 2)
+            avl_remove(&tree, avl_node(&items[i]), test_item_augment);
+    }
+
+    MOS_TEST_ASSERT(test_avl_verify(tree.root, NULL) > 0, "tree is broken after removal");
+    MOS_TEST_CHECK(avl_entry(tree.root, test_item_t)->subtree_size, 50);
+
+    int expected = 0;
+    for (avl_node_t *node = avl_first(&tree); node; node = avl_next(node), expected += 2)
+        MOS_TEST_CHECK(avl_entry(node, test_item_t)->key, expected);
+    MOS_TEST_CHECK(expected, 100);
+
+    for (int i = 0; i < 100; i++)
+    {
+        if (items[i].key % 2 == 0)
+            avl_remove(&tree, avl_node(&items[i]), test_item_augment);
+    }
+
+    MOS_TEST_CHECK(tree.root, NULL);
+    MOS_TEST_CHECK(avl_first(&tree), NULL);
+}
+
+MOS_TEST_CASE(avl_tree_propagate)
+{
+    avl_tree_t tree = { 0 };
+    test_item_t items[16];
+
+    for (int i = 0; i < 16; i++)
+    {
+        items[i].key = i;
+        avl_insert(&tree, avl_node(&items[i]), test_item_compare, test_item_augment);
+    }
+
+    // corrupt the augmented data of a leaf, then let the tree fix it up
+    items[0].subtree_size = 100;
+    MOS_TEST_CHECK(test_avl_verify(tree.root, NULL), -1);
+    avl_propagate(avl_node(&items[0]), test_item_augment);
+    MOS_TEST_ASSERT(test_avl_verify(tree.root, NULL) > 0, "augmented data is not fixed up");
+}
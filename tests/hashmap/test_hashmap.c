@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include "mos/platform/platform.h"
 #include "test_engine_impl.h"
 
 #include <mos/lib/structures/hashmap.h>
@@ -27,11 +28,11 @@ MOS_TEST_CASE(hashmap_put_single)
     hashmap_common_type_init(&map, 135, string);
     MOS_TEST_CHECK(map.magic, HASHMAP_MAGIC);
 
-    MOS_TEST_CHECK(map.capacity, 135);
+    MOS_TEST_CHECK(map.capacity, 256);
     MOS_TEST_CHECK(map.size, 0);
     void *old = hashmap_put(&map, (ptr_t) "foo", "bar");
     MOS_TEST_CHECK(old, NULL);
-    MOS_TEST_CHECK(map.capacity, 135);
+    MOS_TEST_CHECK(map.capacity, 256);
     MOS_TEST_CHECK(map.size, 1);
 
     MOS_TEST_CHECK_STRING((const char *) hashmap_get(&map, (ptr_t) "foo"), "bar");
@@ -43,21 +44,21 @@ MOS_TEST_CASE(hashmap_get_function)
     hashmap_t map = { 0 };
     hashmap_common_type_init(&map, 1, string);
     MOS_TEST_CHECK(map.magic, HASHMAP_MAGIC);
-    MOS_TEST_CHECK(map.capacity, 1);
+    MOS_TEST_CHECK(map.capacity, 8);
     MOS_TEST_CHECK(map.size, 0);
 
     hashmap_put(&map, (ptr_t) "foo", "foo1");
-    MOS_TEST_CHECK(map.capacity, 1);
+    MOS_TEST_CHECK(map.capacity, 8);
     MOS_TEST_CHECK(map.size, 1);
     MOS_TEST_CHECK_STRING((const char *) hashmap_get(&map, (ptr_t) "foo"), "foo1");
 
     hashmap_put(&map, (ptr_t) "bar", "bar1");
-    MOS_TEST_CHECK(map.capacity, 1);
+    MOS_TEST_CHECK(map.capacity, 8);
     MOS_TEST_CHECK(map.size, 2);
     MOS_TEST_CHECK_STRING((const char *) hashmap_get(&map, (ptr_t) "bar"), "bar1");
 
     hashmap_put(&map, (ptr_t) "bar", "bar2");
-    MOS_TEST_CHECK(map.capacity, 1);
+    MOS_TEST_CHECK(map.capacity, 8);
     MOS_TEST_CHECK(map.size, 2);
     MOS_TEST_CHECK_STRING((const char *) hashmap_get(&map, (ptr_t) "bar"), "bar2");
 
@@ -70,30 +71,30 @@ MOS_TEST_CASE(hashmap_put_multiple)
     const char *old;
     hashmap_common_type_init(&map, 135, string);
     MOS_TEST_CHECK(map.magic, HASHMAP_MAGIC);
-    MOS_TEST_CHECK(map.capacity, 135);
+    MOS_TEST_CHECK(map.capacity, 256);
     MOS_TEST_CHECK(map.size, 0);
 
     old = hashmap_put(&map, (ptr_t) "foo", "foo1");
     MOS_TEST_CHECK(old, NULL);
-    MOS_TEST_CHECK(map.capacity, 135);
+    MOS_TEST_CHECK(map.capacity, 256);
     MOS_TEST_CHECK(map.size, 1);
     MOS_TEST_CHECK_STRING((const char *) hashmap_get(&map, (ptr_t) "foo"), "foo1");
 
     old = hashmap_put(&map, (ptr_t) "foo", "foo2");
-    MOS_TEST_CHECK(map.capacity, 135);
+    MOS_TEST_CHECK(map.capacity, 256);
     MOS_TEST_CHECK(map.size, 1);
     MOS_TEST_CHECK_STRING(old, "foo1");
     MOS_TEST_CHECK_STRING((const char *) hashmap_get(&map, (ptr_t) "foo"), "foo2");
 
     old = hashmap_put(&map, (ptr_t) "bar", "bar1");
     MOS_TEST_CHECK(old, NULL);
-    MOS_TEST_CHECK(map.capacity, 135);
+    MOS_TEST_CHECK(map.capacity, 256);
     MOS_TEST_CHECK(map.size, 2);
     MOS_TEST_CHECK_STRING((const char *) hashmap_get(&map, (ptr_t) "bar"), "bar1");
     MOS_TEST_CHECK_STRING((const char *) hashmap_get(&map, (ptr_t) "foo"), "foo2");
 
     old = hashmap_put(&map, (ptr_t) "bar", "bar2");
-    MOS_TEST_CHECK(map.capacity, 135);
+    MOS_TEST_CHECK(map.capacity, 256);
     MOS_TEST_CHECK(map.size, 2);
     MOS_TEST_CHECK_STRING(old, "bar1");
     MOS_TEST_CHECK_STRING((const char *) hashmap_get(&map, (ptr_t) "bar"), "bar2");
@@ -107,25 +108,25 @@ MOS_TEST_CASE(hashmap_put_overflow)
     const char *old;
     hashmap_common_type_init(&map, 1, string);
     MOS_TEST_CHECK(map.magic, HASHMAP_MAGIC);
-    MOS_TEST_CHECK(map.capacity, 1);
+    MOS_TEST_CHECK(map.capacity, 8);
     MOS_TEST_CHECK(map.size, 0);
 
     old = hashmap_put(&map, (ptr_t) "foo", "foo1");
     MOS_TEST_CHECK(old, NULL);
-    MOS_TEST_CHECK(map.capacity, 1);
+    MOS_TEST_CHECK(map.capacity, 8);
     MOS_TEST_CHECK(map.size, 1);
     MOS_TEST_CHECK_STRING((const char *) hashmap_get(&map, (ptr_t) "foo"), "foo1");
 
     old = hashmap_put(&map, (ptr_t) "bar", "bar1");
     MOS_TEST_CHECK(old, NULL);
-    MOS_TEST_CHECK(map.capacity, 1);
+    MOS_TEST_CHECK(map.capacity, 8);
     MOS_TEST_CHECK(map.size, 2);
     MOS_TEST_CHECK_STRING((const char *) hashmap_get(&map, (ptr_t) "bar"), "bar1");
     MOS_TEST_CHECK_STRING((const char *) hashmap_get(&map, (ptr_t) "foo"), "foo1");
 
     old = hashmap_put(&map, (ptr_t) "bar", "bar2");
     MOS_TEST_CHECK_STRING(old, "bar1");
-    MOS_TEST_CHECK(map.capacity, 1);
+    MOS_TEST_CHECK(map.capacity, 8);
     MOS_TEST_CHECK(map.size, 2);
     MOS_TEST_CHECK_STRING((const char *) hashmap_get(&map, (ptr_t) "bar"), "bar2");
     MOS_TEST_CHECK_STRING((const char *) hashmap_get(&map, (ptr_t) "foo"), "foo1");
@@ -139,17 +140,17 @@ MOS_TEST_CASE(hashmap_remove_function)
     hashmap_t map = { 0 };
     hashmap_common_type_init(&map, 10, string);
     MOS_TEST_CHECK(map.magic, HASHMAP_MAGIC);
-    MOS_TEST_CHECK(map.capacity, 10);
+    MOS_TEST_CHECK(map.capacity, 16);
     MOS_TEST_CHECK(map.size, 0);
 
     old = hashmap_put(&map, (ptr_t) "foo", "foo1");
-    MOS_TEST_CHECK(map.capacity, 10);
+    MOS_TEST_CHECK(map.capacity, 16);
     MOS_TEST_CHECK(map.size, 1);
     MOS_TEST_CHECK(old, NULL);
     MOS_TEST_CHECK_STRING((const char *) hashmap_get(&map, (ptr_t) "foo"), "foo1");
 
     old = hashmap_remove(&map, (ptr_t) "foo");
-    MOS_TEST_CHECK(map.capacity, 10);
+    MOS_TEST_CHECK(map.capacity, 16);
     MOS_TEST_CHECK(map.size, 0);
     MOS_TEST_CHECK_STRING(old, "foo1");
     const char *nothing = hashmap_get(&map, (ptr_t) "foo");
@@ -157,7 +158,7 @@ MOS_TEST_CASE(hashmap_remove_function)
 
     old = hashmap_remove(&map, (ptr_t) "foo");
     MOS_TEST_CHECK(old, NULL);
-    MOS_TEST_CHECK(map.capacity, 10);
+    MOS_TEST_CHECK(map.capacity, 16);
     MOS_TEST_CHECK(map.size, 0);
 
     MOS_TEST_CHECK(hashmap_get(&map, (ptr_t) "foo"), NULL);
@@ -165,6 +166,7 @@ MOS_TEST_CASE(hashmap_remove_function)
 }
 
 static size_t test_hashmap_foreach_count = 0;
+static const char *test_hashmap_foreach_last = NULL;
 
 bool test_foreach_function(uintn key, void *value, void *data)
 {
@@ -180,6 +182,7 @@ bool test_foreach_stop_at_quux(uintn key, void *value, void *data)
     MOS_UNUSED(data);
     MOS_UNUSED(value);
     test_hashmap_foreach_count++;
+    test_hashmap_foreach_last = (const char *) key;
     if (strcmp((void *) key, "quux") == 0)
         return false;
     return true;
@@ -190,7 +193,7 @@ MOS_TEST_CASE(hashmap_foreach_function)
     hashmap_t map = { 0 };
     hashmap_common_type_init(&map, 10, string);
     MOS_TEST_CHECK(map.magic, HASHMAP_MAGIC);
-    MOS_TEST_CHECK(map.capacity, 10);
+    MOS_TEST_CHECK(map.capacity, 16);
     MOS_TEST_CHECK(map.size, 0);
     hashmap_put(&map, (ptr_t) "foo", "foo1");
     hashmap_put(&map, (ptr_t) "bar", "bar1");
@@ -211,6 +214,92 @@ MOS_TEST_CASE(hashmap_foreach_function)
 
     test_hashmap_foreach_count = 0;
     hashmap_foreach(&map, test_foreach_stop_at_quux, NULL);
-    MOS_TEST_CHECK(test_hashmap_foreach_count, 4);
+    MOS_TEST_ASSERT(test_hashmap_foreach_count <= map.size, "foreach visited too many entries");
+    MOS_TEST_CHECK_STRING(test_hashmap_foreach_last, "quux");
     hashmap_deinit(&map);
 }
+
+MOS_TEST_CASE(hashmap_grow_and_remove)
+{
+    hashmap_t map = { 0 };
+    hashmap_init(&map, 8, hashmap_identity_hash, hashmap_simple_key_compare);
+    MOS_TEST_CHECK(map.capacity, 8);
+
+    for (uintn i = 1; i <= 1000; i++)
+        hashmap_put(&map, i, (void *) (i * 2));
+    MOS_TEST_CHECK(map.size, 1000);
+    MOS_TEST_CHECK(map.capacity, 2048);
+
+    for (uintn i = 1; i <= 1000; i++)
+        MOS_TEST_CHECK(hashmap_get(&map, i), (void *) (i * 2));
+    MOS_TEST_CHECK(hashmap_get(&map, 1001), NULL);
+
+    // removing shifts the entries after it back, they must still be found
+    for (uintn i = 1; i <= 1000; i += 2)
+        MOS_TEST_CHECK(hashmap_remove(&map, i), (void *) (i * 2));
+    MOS_TEST_CHECK(map.size, 500);
+    MOS_TEST_CHECK(map.capacity, 2048);
+
+    for (uintn i = 1; i <= 1000; i++)
+    {
+        MOS_TEST_CHECK(hashmap_get(&map, i), i % 2 ? NULL : (void *) (i * 2));
+        MOS_TEST_CHECK(hashmap_get_lockless(&map, i), i % 2 ? NULL : (void *) (i * 2));
+    }
+
+    test_hashmap_foreach_count = 0;
+    hashmap_foreach(&map, test_foreach_function, NULL);
+    MOS_TEST_CHECK(test_hashmap_foreach_count, 500);
+    hashmap_deinit(&map);
+}
+
+#define HASHMAP_BENCHMARK_N 4096
+
+static char hashmap_benchmark_names[HASHMAP_BENCHMARK_N][24];
+
+MOS_TEST_CASE(hashmap_benchmark)
+{
+    hashmap_t ints = { 0 }, strings = { 0 };
+    hashmap_init(&ints, 8, hashmap_identity_hash, hashmap_simple_key_compare);
+    hashmap_common_type_init(&strings, 8, string);
+    for (size_t i = 0; i < HASHMAP_BENCHMARK_N; i++)
+        snprintf(hashmap_benchmark_names[i], sizeof(hashmap_benchmark_names[i]), "/sys/benchmark/%zu", i);
+
+    u64 start = platform_get_timestamp();
+    for (uintn i = 0; i < HASHMAP_BENCHMARK_N; i++)
+        hashmap_put(&ints, i, (void *) (i + 1));
+    const u64 int_put = platform_get_timestamp() - start;
+
+    start = platform_get_timestamp();
+    for (uintn i = 0; i < HASHMAP_BENCHMARK_N; i++)
+        MOS_TEST_CHECK(hashmap_get(&ints, i), (void *) (i + 1));
+    const u64 int_get = platform_get_timestamp() - start;
+
+    start = platform_get_timestamp();
+    for (uintn i = 0; i < HASHMAP_BENCHMARK_N; i++)
+        MOS_TEST_CHECK(hashmap_get_lockless(&ints, i), (void *) (i + 1));
+    const u64 int_get_lockless = platform_get_timestamp() - start;
+
+    start = platform_get_timestamp();
+    for (size_t i = 0; i < HASHMAP_BENCHMARK_N; i++)
+        hashmap_put(&strings, (ptr_t) hashmap_benchmark_names[i], hashmap_benchmark_names[i]);
+    const u64 string_put = platform_get_timestamp() - start;
+
+    start = platform_get_timestamp();
+    for (size_t i = 0; i < HASHMAP_BENCHMARK_N; i++)
+        MOS_TEST_CHECK(hashmap_get(&strings, (ptr_t) hashmap_benchmark_names[i]), hashmap_benchmark_names[i]);
+    const u64 string_get = platform_get_timestamp() - start;
+
+    start = platform_get_timestamp();
+    for (uintn i = 0; i < HASHMAP_BENCHMARK_N; i++)
+        hashmap_remove(&ints, i);
+    const u64 int_remove = platform_get_timestamp() - start;
+    MOS_TEST_CHECK(ints.size, 0);
+
+    mos_test_log(MOS_LOG_INFO, '\0', "%d entries, cycles per operation:", HASHMAP_BENCHMARK_N);
+    mos_test_log(MOS_LOG_INFO, '\0', "  int put %llu, get %llu, lockless get %llu, remove %llu", int_put / HASHMAP_BENCHMARK_N,
+                 int_get / HASHMAP_BENCHMARK_N, int_get_lockless / HASHMAP_BENCHMARK_N, int_remove / HASHMAP_BENCHMARK_N);
+    mos_test_log(MOS_LOG_INFO, '\0', "  string put %llu, get %llu", string_put / HASHMAP_BENCHMARK_N, string_get / HASHMAP_BENCHMARK_N);
+
+    hashmap_deinit(&ints);
+    hashmap_deinit(&strings);
+}
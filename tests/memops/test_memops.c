@@ -1,5 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include "mos/mm/mm.h"
+#include "mos/platform/platform.h"
 #include "test_engine_impl.h"
 
 #include <mos_stdlib.h>
@@ -73,3 +75,149 @@ MOS_TEST_CASE(test_memmove_overlapped_backwards)
         MOS_TEST_CHECK(src[i], i);
     kfree(src);
 }
+
+#define MEMOPS_TEST_SIZE 1024
+
+static void memops_fill_pattern(u8 *buf, size_t n, u8 seed)
+{
+    for (size_t i = 0; i < n; i++)
+        buf[i] = (u8) (i * 7 + seed);
+}
+
+MOS_TEST_CASE(test_memops_sizes_and_alignments)
+{
+    u8 *src = kmalloc(MEMOPS_TEST_SIZE);
+    u8 *dst = kmalloc(MEMOPS_TEST_SIZE);
+
+    // cover the byte loop, the word loop and 'rep movsb' with every alignment
+    for (size_t align = 0; align < 16; align++)
+    {
+        for (size_t n = 0; n <= 600; n += (n < 80 ? 1 : 37))
+        {
+            memops_fill_pattern(src, MEMOPS_TEST_SIZE, 1);
+            memops_fill_pattern(dst, MEMOPS_TEST_SIZE, 2);
+            memcpy(dst + align, src + (15 - align), n);
+            for (size_t i = 0; i < MEMOPS_TEST_SIZE; i++)
+            {
+                const bool copied = i >= align && i < align + n;
+                const u8 expected = copied ? src[i - align + 15 - align] : (u8) (i * 7 + 2);
+                if (dst[i] != expected)
+                    MOS_TEST_ASSERT(false, "memcpy of %zu bytes at +%zu is wrong at %zu", n, align, i);
+            }
+
+            memops_fill_pattern(dst, MEMOPS_TEST_SIZE, 2);
+            memset(dst + align, 0x5a, n);
+            for (size_t i = 0; i < MEMOPS_TEST_SIZE; i++)
+            {
+                const bool set = i >= align && i < align + n;
+                if (dst[i] != (set ? 0x5a : (u8) (i * 7 + 2)))
+                    MOS_TEST_ASSERT(false, "memset of %zu bytes at +%zu is wrong at %zu", n, align, i);
+            }
+        }
+    }
+
+    kfree(src);
+    kfree(dst);
+}
+
+MOS_TEST_CASE(test_memmove_overlapped_unaligned)
+{
+    u8 *buf = kmalloc(MEMOPS_TEST_SIZE);
+    u8 *ref = kmalloc(MEMOPS_TEST_SIZE);
+
+    for (size_t n = 1; n <= 512; n = n * 3 + 1)
+    {
+        for (s32 shift = -9; shift <= 9; shift++)
+        {
+            const size_t from = 256, to = 256 + shift;
+            memops_fill_pattern(buf, MEMOPS_TEST_SIZE, 3);
+            memops_fill_pattern(ref, MEMOPS_TEST_SIZE, 3);
+
+            memmove(buf + to, buf + from, n);
+            for (size_t i = 0; i < MEMOPS_TEST_SIZE; i++)
+            {
+                const u8 expected = (i >= to && i < to + n) ? ref[from + i - to] : ref[i];
+                if (buf[i] != expected)
+                    MOS_TEST_ASSERT(false, "memmove of %zu bytes by %d is wrong at %zu", n, shift, i);
+            }
+        }
+    }
+
+    kfree(buf);
+    kfree(ref);
+}
+
+MOS_TEST_CASE(test_memops_page)
+{
+    phyframe_t *src_page = mm_get_free_page();
+    phyframe_t *dst_page = mm_get_free_page();
+    u8 *src = (u8 *) phyframe_va(src_page), *dst = (u8 *) phyframe_va(dst_page);
+
+    memops_fill_pattern(src, MOS_PAGE_SIZE, 4);
+    memcpy_page(dst, src);
+    MOS_TEST_CHECK(memcmp(dst, src, MOS_PAGE_SIZE), 0);
+
+    memzero_page(dst);
+    size_t nonzero = 0;
+    for (size_t i = 0; i < MOS_PAGE_SIZE; i++)
+        nonzero += dst[i] != 0;
+    MOS_TEST_CHECK(nonzero, 0);
+
+    mm_free_page(src_page);
+    mm_free_page(dst_page);
+}
+
+// a throughput benchmark, in bytes per 100 cycles so that the small sizes don't round down to zero
+#define MEMOPS_BENCH_BYTES (256 KB)
+
+MOS_TEST_CASE(test_memops_benchmark)
+{
+    static const size_t sizes[] = { 16, 64, 256, 1024, 4096, 65536 };
+    static const size_t alignments[] = { 0, 1, 8 };
+
+    phyframe_t *pages = mm_get_free_pages(2 * 65536 / MOS_PAGE_SIZE + 2);
+    u8 *src = (u8 *) phyframe_va(pages), *dst = src + 65536 + MOS_PAGE_SIZE;
+
+    for (size_t s = 0; s < MOS_ARRAY_SIZE(sizes); s++)
+    {
+        for (size_t a = 0; a < MOS_ARRAY_SIZE(alignments); a++)
+        {
+            const size_t n = sizes[s], align = alignments[a], rounds = MEMOPS_BENCH_BYTES / n;
+
+            u64 start = platform_get_timestamp();
+            for (size_t r = 0; r < rounds; r++)
+                memcpy(dst + align, src, n);
+            const u64 copy = platform_get_timestamp() - start;
+
+            start = platform_get_timestamp();
+            for (size_t r = 0; r < rounds; r++)
+                memmove(dst + align, src, n);
+            const u64 move = platform_get_timestamp() - start;
+
+            start = platform_get_timestamp();
+            for (size_t r = 0; r < rounds; r++)
+                memset(dst + align, (int) r, n);
+            const u64 set = platform_get_timestamp() - start;
+
+            mos_test_log(MOS_LOG_INFO, '\0', "%6zu bytes +%zu: memcpy %llu, memmove %llu, memset %llu bytes/100 cycles", n, align,
+                         MEMOPS_BENCH_BYTES * 100ull / (copy ? copy : 1), MEMOPS_BENCH_BYTES * 100ull / (move ? move : 1),
+                         MEMOPS_BENCH_BYTES * 100ull / (set ? set : 1));
+        }
+    }
+
+    const size_t rounds = MEMOPS_BENCH_BYTES / MOS_PAGE_SIZE;
+    u64 start = platform_get_timestamp();
+    for (size_t r = 0; r < rounds; r++)
+        memcpy_page(dst, src);
+    const u64 copy = platform_get_timestamp() - start;
+
+    start = platform_get_timestamp();
+    for (size_t r = 0; r < rounds; r++)
+        memzero_page(dst);
+    const u64 zero = platform_get_timestamp() - start;
+
+    mos_test_log(MOS_LOG_INFO, '\0', "  page: memcpy_page %llu, memzero_page %llu bytes/100 cycles", MEMOPS_BENCH_BYTES * 100ull / (copy ? copy : 1),
+                 MEMOPS_BENCH_BYTES * 100ull / (zero ? zero : 1));
+
+    mm_free_pages(pages, 2 * 65536 / MOS_PAGE_SIZE + 2);
+}
@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "test_engine_impl.h"
+
+#include <mos/lib/structures/radix_tree.h>
+
+#define TEST_TAG 0
+
+// entries are never dereferenced, so encode the index into the pointer (offset by one, NULL is not allowed)
+#define item_of(index) ((void *) (ptr_t) ((index) + 1))
+
+MOS_TEST_CASE(radix_tree_insert_lookup)
+{
+    radix_tree_t tree = RADIX_TREE_INIT;
+
+    for (u64 i = 0; i < 1000; i++)
+        MOS_TEST_CHECK(radix_tree_insert(&tree, i, item_of(i)), true);
+    MOS_TEST_CHECK(tree.count, 1000);
+
+    // an occupied index is not overwritten
+    MOS_TEST_CHECK(radix_tree_insert(&tree, 500, item_of(0)), false);
+
+    for (u64 i = 0; i < 1000; i++)
+        MOS_TEST_CHECK(radix_tree_lookup(&tree, i), item_of(i));
+    MOS_TEST_CHECK(radix_tree_lookup(&tree, 1000), NULL);
+    MOS_TEST_CHECK(radix_tree_lookup(&tree, (u64) -1), NULL);
+
+    radix_tree_destroy(&tree);
+    MOS_TEST_CHECK(tree.root, NULL);
+}
+
+MOS_TEST_CASE(radix_tree_sparse)
+{
+    radix_tree_t tree = RADIX_TREE_INIT;
+    static const u64 indices[] = { 0, 63, 64, 4095, 4096, 1ull << 32, (u64) -1 };
+
+    for (size_t i = 0; i < MOS_ARRAY_SIZE(indices); i++)
+        MOS_TEST_CHECK(radix_tree_insert(&tree, indices[i], item_of(i)), true);
+
+    for (size_t i = 0; i < MOS_ARRAY_SIZE(indices); i++)
+        MOS_TEST_CHECK(radix_tree_lookup(&tree, indices[i]), item_of(i));
+    MOS_TEST_CHECK(radix_tree_lookup(&tree, 65), NULL);
+
+    // removing everything but the first entry shrinks the tree back to a single node
+    for (size_t i = MOS_ARRAY_SIZE(indices) - 1; i > 0; i--)
+        MOS_TEST_CHECK(radix_tree_delete(&tree, indices[i]), item_of(i));
+    MOS_TEST_CHECK(tree.count, 1);
+    MOS_TEST_CHECK(tree.root->shift, 0);
+    MOS_TEST_CHECK(radix_tree_lookup(&tree, 0), item_of(0));
+
+    MOS_TEST_CHECK(radix_tree_delete(&tree, 0), item_of(0));
+    MOS_TEST_CHECK(radix_tree_delete(&tree, 0), NULL);
+    MOS_TEST_CHECK(tree.root, NULL);
+}
+
+MOS_TEST_CASE(radix_tree_gang_lookup_in_order)
+{
+    radix_tree_t tree = RADIX_TREE_INIT;
+
+    // insert in a scrambled order
+    for (u64 i = 0; i < 300; i++)
+        MOS_TEST_CHECK(radix_tree_insert(&tree, ((i * 37) % 300) * 3, item_of((i * 37) % 300 * 3)), true);
+
+    void *results[16];
+    u64 indices[16];
+    u64 next = 0, expected = 0;
+    size_t n;
+    while ((n = radix_tree_gang_lookup(&tree, results, indices, next, MOS_ARRAY_SIZE(results))) > 0)
+    {
+        for (size_t i = 0; i < n; i++, expected += 3)
+        {
+            MOS_TEST_CHECK(indices[i], expected);
+            MOS_TEST_CHECK(results[i], item_of(expected));
+        }
+        next = indices[n - 1] + 1;
+    }
+    MOS_TEST_CHECK(expected, 900);
+
+    // start in the middle of a gap
+    n = radix_tree_gang_lookup(&tree, results, NULL, 100, 1);
+    MOS_TEST_CHECK(n, 1);
+    MOS_TEST_CHECK(results[0], item_of(102));
+
+    radix_tree_destroy(&tree);
+}
+
+MOS_TEST_CASE(radix_tree_tags)
+{
+    radix_tree_t tree = RADIX_TREE_INIT;
+    for (u64 i = 0; i < 5000; i++)
+        radix_tree_insert(&tree, i, item_of(i));
+
+    MOS_TEST_CHECK(radix_tree_tagged(&tree, TEST_TAG), false);
+    radix_tree_tag_set(&tree, 10, TEST_TAG);
+    radix_tree_tag_set(&tree, 4000, TEST_TAG);
+    MOS_TEST_CHECK(radix_tree_tagged(&tree, TEST_TAG), true);
+    MOS_TEST_CHECK(radix_tree_tag_get(&tree, 10, TEST_TAG), true);
+    MOS_TEST_CHECK(radix_tree_tag_get(&tree, 11, TEST_TAG), false);
+
+    void *results[8];
+    u64 indices[8];
+    MOS_TEST_CHECK(radix_tree_gang_lookup_tag(&tree, results, indices, 0, 8, TEST_TAG), 2);
+    MOS_TEST_CHECK(indices[0], 10);
+    MOS_TEST_CHECK(indices[1], 4000);
+    MOS_TEST_CHECK(radix_tree_gang_lookup_tag(&tree, results, indices, 11, 8, TEST_TAG), 1);
+    MOS_TEST_CHECK(indices[0], 4000);
+
+    // clearing a tag (or deleting the entry) clears it all the way up to the root
+    radix_tree_tag_clear(&tree, 10, TEST_TAG);
+    MOS_TEST_CHECK(radix_tree_tagged(&tree, TEST_TAG), true);
+    radix_tree_delete(&tree, 4000);
+    MOS_TEST_CHECK(radix_tree_tagged(&tree, TEST_TAG), false);
+    MOS_TEST_CHECK(radix_tree_gang_lookup_tag(&tree, results, indices, 0, 8, TEST_TAG), 0);
+
+    radix_tree_destroy(&tree);
+}
@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include "mos/platform/platform.h"
 #include "test_engine_impl.h"
 
 #include <mos/lib/structures/ring_buffer.h>
@@ -510,3 +511,87 @@ MOS_TEST_CASE(ringbuffer_push_pop_multiple_bytes)
     MOS_TEST_CHECK(rb->pos.next_pos, 4); // 12 - 8 = 4
     MOS_TEST_CHECK(rb->pos.size, 12);    // 20 - 8 = 12
 }
+
+MOS_TEST_CASE(ringbuffer_spsc_wrap_around)
+{
+    u8 buffer[16];
+    ring_buffer_spsc_t ring;
+    ring_buffer_spsc_init(&ring, sizeof(buffer));
+    MOS_TEST_CHECK(ring_buffer_spsc_is_empty(&ring), true);
+
+    const char *data = "0123456789abcdefghij";
+    char buf[20] = { 0 };
+
+    MOS_TEST_CHECK(ring_buffer_spsc_push(buffer, &ring, (const u8 *) data, 12), 12);
+    MOS_TEST_CHECK(ring_buffer_spsc_pop(buffer, &ring, (u8 *) buf, 8), 8);
+    MOS_TEST_CHECK(strncmp(buf, data, 8), 0);
+
+    // 4 bytes left at the end of the buffer, the rest goes to its start
+    MOS_TEST_CHECK(ring_buffer_spsc_push(buffer, &ring, (const u8 *) data, 20), 12);
+    MOS_TEST_CHECK(ring_buffer_spsc_is_full(&ring), true);
+    MOS_TEST_CHECK(ring_buffer_spsc_push_byte(buffer, &ring, 'x'), 0);
+    MOS_TEST_CHECK(ring.head, 8);
+    MOS_TEST_CHECK(ring.tail, 24);
+
+    MOS_TEST_CHECK(ring_buffer_spsc_pop(buffer, &ring, (u8 *) buf, 20), 16);
+    MOS_TEST_CHECK(strncmp(buf, "89ab", 4), 0);
+    MOS_TEST_CHECK(strncmp(buf + 4, data, 12), 0);
+    MOS_TEST_CHECK(ring_buffer_spsc_is_empty(&ring), true);
+    MOS_TEST_CHECK(ring_buffer_spsc_pop(buffer, &ring, (u8 *) buf, 1), 0);
+}
+
+MOS_TEST_CASE(ringbuffer_spsc_counter_overflow)
+{
+    u8 buffer[8];
+    ring_buffer_spsc_t ring;
+    ring_buffer_spsc_init(&ring, sizeof(buffer));
+
+    // the counters are never wrapped, the size stays right when they overflow
+    ring.head = ring.tail = (size_t) -3;
+    MOS_TEST_CHECK(ring_buffer_spsc_push(buffer, &ring, (const u8 *) "abcdefgh", 8), 8);
+    MOS_TEST_CHECK(ring.tail, 5);
+    MOS_TEST_CHECK(ring_buffer_spsc_used(&ring), 8);
+
+    char buf[8];
+    MOS_TEST_CHECK(ring_buffer_spsc_pop(buffer, &ring, (u8 *) buf, 8), 8);
+    MOS_TEST_CHECK(strncmp(buf, "abcdefgh", 8), 0);
+    MOS_TEST_CHECK(ring_buffer_spsc_is_empty(&ring), true);
+}
+
+#define RINGBUFFER_BENCH_CAPACITY 4096
+#define RINGBUFFER_BENCH_BYTES    (1 MB)
+
+MOS_TEST_CASE(ringbuffer_benchmark)
+{
+    static const size_t chunks[] = { 1, 16, 256, 1000 };
+    static u8 storage[RINGBUFFER_BENCH_CAPACITY], chunk[1000];
+
+    for (size_t c = 0; c < MOS_ARRAY_SIZE(chunks); c++)
+    {
+        const size_t n = chunks[c], rounds = RINGBUFFER_BENCH_BYTES / n;
+
+        ring_buffer_pos_t pos;
+        ring_buffer_pos_init(&pos, RINGBUFFER_BENCH_CAPACITY);
+        u64 start = platform_get_timestamp();
+        for (size_t r = 0; r < rounds; r++)
+        {
+            ring_buffer_pos_push_back(storage, &pos, chunk, n);
+            ring_buffer_pos_pop_front(storage, &pos, chunk, n);
+        }
+        const u64 t_pos = platform_get_timestamp() - start;
+
+        ring_buffer_spsc_t ring;
+        ring_buffer_spsc_init(&ring, RINGBUFFER_BENCH_CAPACITY);
+        start = platform_get_timestamp();
+        for (size_t r = 0; r < rounds; r++)
+        {
+            ring_buffer_spsc_push(storage, &ring, chunk, n);
+            ring_buffer_spsc_pop(storage, &ring, chunk, n);
+        }
+        const u64 t_spsc = platform_get_timestamp() - start;
+
+        MOS_TEST_CHECK(ring_buffer_spsc_is_empty(&ring), true);
+        mos_test_log(MOS_LOG_INFO, '\0', "%4zu-byte chunks, bytes per 100 cycles: ring_buffer_pos %llu, ring_buffer_spsc %llu", n,
+                     rounds * n * 100ull / (t_pos ? t_pos : 1), rounds * n * 100ull / (t_spsc ? t_spsc : 1));
+    }
+}
@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mos/mm/mm.h"
+#include "mos/platform/platform.h"
+#include "test_engine_impl.h"
+
+#include <mos_string.h>
+
+// byte-at-a-time versions to check against
+static size_t ref_strlen(const char *s)
+{
+    size_t n = 0;
+    while (s[n])
+        n++;
+    return n;
+}
+
+static s32 ref_strncmp(const char *a, const char *b, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        if (a[i] != b[i] || a[i] == '\0')
+            return (u8) a[i] - (u8) b[i];
+    }
+    return 0;
+}
+
+static const char *ref_strchr(const char *s, char c)
+{
+    for (;; s++)
+    {
+        if (*s == c)
+            return s;
+        if (*s == '\0')
+            return NULL;
+    }
+}
+
+static s32 sign(s32 x)
+{
+    return (x > 0) - (x < 0);
+}
+
+#define STRING_TEST_MAX_LEN 72
+
+// put a string of the given length so that it ends `tail` bytes before the end of the page
+static char *string_test_place(char *page, size_t len, size_t tail, char first)
+{
+    char *s = page + MOS_PAGE_SIZE - 1 - tail - len;
+    for (size_t i = 0; i < len; i++)
+        s[i] = (char) (first + i % 23);
+    s[len] = '\0';
+    return s;
+}
+
+MOS_TEST_CASE(string_every_alignment)
+{
+    phyframe_t *frames = mm_get_free_pages(2);
+    char *page_a = (char *) phyframe_va(frames), *page_b = page_a + MOS_PAGE_SIZE;
+
+    // every length, at every alignment, ending right before a page boundary or up to 15 bytes earlier
+    for (size_t len = 0; len <= STRING_TEST_MAX_LEN; len++)
+    {
+        for (size_t tail_a = 0; tail_a < 16; tail_a++)
+        {
+            for (size_t tail_b = 0; tail_b < 16; tail_b += 3)
+            {
+                const char *a = string_test_place(page_a, len, tail_a, 'a');
+                char *b = string_test_place(page_b, len, tail_b, 'a');
+
+                MOS_TEST_CHECK(strlen(a), len);
+                MOS_TEST_CHECK(strlen(b), len);
+                MOS_TEST_CHECK(sign(strcmp(a, b)), 0);
+
+                for (size_t n = 0; n <= len + 1; n += 1 + n / 8)
+                    MOS_TEST_CHECK(strncmp(a, b, n), 0);
+
+                MOS_TEST_CHECK(strchr(a, '\0'), a + len);
+                MOS_TEST_CHECK(strchr(a, 'Z'), NULL);
+                if (len)
+                    MOS_TEST_CHECK(strchr(a, a[len - 1]), ref_strchr(a, a[len - 1]));
+
+                if (len == 0)
+                    continue;
+
+                // a difference at each position, in both directions, and with a high byte
+                for (size_t i = 0; i < len; i++)
+                {
+                    const char saved = b[i];
+                    b[i] = (char) (i % 2 ? saved + 1 : 0xf0);
+                    MOS_TEST_CHECK(sign(strcmp(a, b)), sign(ref_strncmp(a, b, len + 1)));
+                    MOS_TEST_CHECK(sign(strcmp(b, a)), sign(ref_strncmp(b, a, len + 1)));
+                    MOS_TEST_CHECK(sign(strncmp(a, b, len)), sign(ref_strncmp(a, b, len)));
+                    MOS_TEST_CHECK(sign(strncmp(a, b, i)), 0);
+                    MOS_TEST_CHECK(strchr(b, b[i]), ref_strchr(b, b[i]));
+
+                    b[i] = '\0'; // b is now a prefix of a
+                    MOS_TEST_CHECK(strlen(b), i);
+                    MOS_TEST_CHECK(sign(strcmp(a, b)), 1);
+                    MOS_TEST_CHECK(sign(strncmp(b, a, len)), -1);
+                    b[i] = saved;
+                }
+            }
+        }
+    }
+
+    mm_free_pages(frames, 2);
+}
+
+#define STRING_BENCH_ROUNDS 2000
+
+MOS_TEST_CASE(string_benchmark)
+{
+    static const size_t lengths[] = { 8, 32, 128, 1024 };
+
+    phyframe_t *frames = mm_get_free_pages(2);
+    char *page_a = (char *) phyframe_va(frames), *page_b = page_a + MOS_PAGE_SIZE;
+
+    for (size_t l = 0; l < MOS_ARRAY_SIZE(lengths); l++)
+    {
+        const size_t len = lengths[l];
+        const char *a = string_test_place(page_a, len, 5, 'a');
+        const char *b = string_test_place(page_b, len, 3, 'a');
+        size_t sink = 0;
+
+        u64 start = platform_get_timestamp();
+        for (size_t r = 0; r < STRING_BENCH_ROUNDS; r++)
+            sink += strlen(a);
+        const u64 t_strlen = platform_get_timestamp() - start;
+
+        start = platform_get_timestamp();
+        for (size_t r = 0; r < STRING_BENCH_ROUNDS; r++)
+            sink += ref_strlen(a);
+        const u64 t_ref_strlen = platform_get_timestamp() - start;
+
+        start = platform_get_timestamp();
+        for (size_t r = 0; r < STRING_BENCH_ROUNDS; r++)
+            sink += strcmp(a, b);
+        const u64 t_strcmp = platform_get_timestamp() - start;
+
+        start = platform_get_timestamp();
+        for (size_t r = 0; r < STRING_BENCH_ROUNDS; r++)
+            sink += ref_strncmp(a, b, (size_t) -1);
+        const u64 t_ref_strcmp = platform_get_timestamp() - start;
+
+        start = platform_get_timestamp();
+        for (size_t r = 0; r < STRING_BENCH_ROUNDS; r++)
+            sink += strchr(a, '\0') - a;
+        const u64 t_strchr = platform_get_timestamp() - start;
+
+        MOS_TEST_CHECK(sink, STRING_BENCH_ROUNDS * len * 3);
+        mos_test_log(MOS_LOG_INFO, '\0', "%4zu bytes, cycles per call: strlen %llu (bytewise %llu), strcmp %llu (bytewise %llu), strchr %llu", len,
+                     t_strlen / STRING_BENCH_ROUNDS, t_ref_strlen / STRING_BENCH_ROUNDS, t_strcmp / STRING_BENCH_ROUNDS, t_ref_strcmp / STRING_BENCH_ROUNDS,
+                     t_strchr / STRING_BENCH_ROUNDS);
+    }
+
+    mm_free_pages(frames, 2);
+}
@@ -4,6 +4,10 @@
 #include "mos/filesystem/vfs.h"
 #include "test_engine_impl.h"
 
+#include <dirent.h>
+#include <mos_stdio.h>
+#include <mos_stdlib.h>
+
 static void stat_receiver(int depth, const dentry_t *dentry, bool mountroot, void *data)
 {
     MOS_UNUSED(data);
@@ -45,3 +49,80 @@ MOS_TEST_DECL_PTEST(vfs_mount_test, "Mount %s in %s, with rootfs: %d", const cha
 
 MOS_TEST_PTEST_INSTANCE(vfs_mount_test, "tmpfs", "/tmp", false);
 MOS_TEST_PTEST_INSTANCE(vfs_mount_test, "tmpfs", "/tmp", true);
+
+MOS_TEST_CASE(vfs_dcache_lookup_test)
+{
+    long ok = vfs_mount("none", "/", "tmpfs", "");
+    MOS_TEST_ASSERT(ok == 0, "failed to mount tmpfs on /");
+
+    ok = vfs_mkdir("/dcache");
+    MOS_TEST_ASSERT(ok == 0, "failed to create /dcache");
+
+    // the dentry created by mkdir is found in the cache, without a filesystem lookup
+    const size_t hits = dcache_stat.hits, misses = dcache_stat.misses;
+    dentry_t *dir = dentry_get(root_dentry, root_dentry, "/dcache", RESOLVE_EXPECT_DIR | RESOLVE_EXPECT_EXIST);
+    MOS_TEST_ASSERT(!IS_ERR(dir), "failed to resolve /dcache");
+    MOS_TEST_CHECK(dcache_stat.hits > hits, true);
+    MOS_TEST_CHECK(dcache_stat.misses, misses);
+    MOS_TEST_CHECK(dcache_lookup(dentry_parent(dir), "dcache") == dir, true);
+    dentry_unref(dir);
+
+    // tmpfs doesn't cache failed lookups, the dentry is its only record of a file
+    dentry_t *missing = dentry_get(root_dentry, root_dentry, "/dcache/missing", RESOLVE_EXPECT_FILE | RESOLVE_EXPECT_EXIST);
+    MOS_TEST_CHECK(IS_ERR(missing), true);
+    MOS_TEST_CHECK(dcache_lookup(dir, "missing") == NULL, true);
+
+    ok = vfs_rmdir("/dcache");
+    MOS_TEST_ASSERT(ok == 0, "failed to remove /dcache");
+
+    ok = vfs_unmount("/");
+    MOS_TEST_ASSERT(ok == 0, "failed to unmount rootfs");
+}
+
+MOS_TEST_CASE(vfs_listdir_test)
+{
+    long ok = vfs_mount("none", "/", "tmpfs", "");
+    MOS_TEST_ASSERT(ok == 0, "failed to mount tmpfs on /");
+
+    ok = vfs_mkdir("/listdir");
+    MOS_TEST_ASSERT(ok == 0, "failed to create /listdir");
+
+    char path[32];
+    for (int i = 0; i < 50; i++)
+    {
+        snprintf(path, sizeof(path), "/listdir/d%d", i);
+        MOS_TEST_ASSERT(vfs_mkdir(path) == 0, "failed to create a subdirectory");
+    }
+
+    dentry_t *dir = dentry_get(root_dentry, root_dentry, "/listdir", RESOLVE_EXPECT_DIR | RESOLVE_EXPECT_EXIST);
+    MOS_TEST_ASSERT(!IS_ERR(dir), "failed to resolve /listdir");
+
+    // a buffer that only fits a few entries, so the listing takes many calls
+    vfs_listdir_state_t *state = kmalloc(sizeof(vfs_listdir_state_t));
+    *state = (vfs_listdir_state_t){ 0 };
+    char buf[64];
+    size_t n_entries = 0, n_calls = 0, size;
+    while ((size = vfs_listdir_read(dir, state, buf, sizeof(buf))) > 0)
+    {
+        n_calls++;
+        for (size_t offset = 0; offset < size; offset += ((struct dirent *) (buf + offset))->d_reclen)
+            n_entries++;
+    }
+
+    MOS_TEST_CHECK(n_entries, 52); // including "." and ".."
+    MOS_TEST_CHECK(n_calls > 1, true);
+    vfs_listdir_release(state);
+    dentry_unref(dir);
+
+    for (int i = 0; i < 50; i++)
+    {
+        snprintf(path, sizeof(path), "/listdir/d%d", i);
+        MOS_TEST_ASSERT(vfs_rmdir(path) == 0, "failed to remove a subdirectory");
+    }
+
+    ok = vfs_rmdir("/listdir");
+    MOS_TEST_ASSERT(ok == 0, "failed to remove /listdir");
+
+    ok = vfs_unmount("/");
+    MOS_TEST_ASSERT(ok == 0, "failed to unmount rootfs");
+}
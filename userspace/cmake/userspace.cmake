@@ -22,7 +22,7 @@ set(INITRD_DIR "${CMAKE_BINARY_DIR}/initrd" CACHE PATH "The directory to store t
 make_directory(${INITRD_DIR})
 
 add_custom_target(mos_initrd
-    find . -depth | sort | cpio --quiet -o --format=crc >../initrd.cpio
+    ${PYTHON} ${CMAKE_SOURCE_DIR}/scripts/mkinitrd.py . ../initrd.cpio # page-aligns file data, see the script
     WORKING_DIRECTORY ${CMAKE_BINARY_DIR}/initrd
     COMMENT "Creating initrd at ${CMAKE_BINARY_DIR}/initrd.cpio"
     BYPRODUCTS ${CMAKE_BINARY_DIR}/initrd.cpio
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "autodestroy.hpp"
+#include "blockdev.h"
 #include "blockdev_manager.hpp"
 #include "proto/filesystem.pb.h"
 
@@ -14,12 +15,14 @@
 #include <mos/filesystem/fs_types.h>
 #include <mos/proto/fs_server.h>
 #include <mos/syscall/usermode.h>
+#include <mutex>
 #include <ostream>
 #include <pb_decode.h>
 #include <pb_encode.h>
 #include <sys/stat.h>
 
 RPC_CLIENT_DEFINE_SIMPLECALL(userfs_manager, USERFS_MANAGER_X)
+RPC_CLIENT_DEFINE_SIMPLECALL(blockdev, BLOCKDEV_SERVER_RPC_X)
 RPC_DECL_SERVER_PROTOTYPES(blockdevfs, USERFS_IMPL_X)
 
 static rpc_server_t *blockdevfs = NULL;
@@ -35,6 +38,9 @@ struct blockdevfs_inode
 
 static blockdevfs_inode *root = NULL;
 
+static std::mutex blockdev_servers_lock;
+static std::map<std::string, rpc_server_stub_t *> blockdev_servers; // connections to the block device servers, kept open
+
 static rpc_result_code_t blockdevfs_mount(rpc_context_t *, mos_rpc_fs_mount_request *req, mos_rpc_fs_mount_response *resp)
 {
     if (req->options && strlen(req->options) > 0 && strcmp(req->options, "defaults") != 0)
@@ -100,6 +106,52 @@ static rpc_result_code_t blockdevfs_readdir(rpc_context_t *, mos_rpc_fs_readdir_
     return RPC_RESULT_OK;
 }
 
+static void blockdevfs_fill_info(int id, const blockdev_info &info, pb_inode_info *i)
+{
+    i->ino = id;
+    i->type = FILE_TYPE_BLOCK_DEVICE;
+    i->perm = 0660;
+    i->uid = 0;
+    i->gid = 0;
+    i->size = info.num_blocks * info.block_size;
+    i->accessed = i->modified = i->created = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    i->nlinks = 1;
+    i->sticky = false;
+    i->suid = false;
+    i->sgid = false;
+}
+
+static rpc_result_code_t blockdevfs_readdirplus(rpc_context_t *, mos_rpc_fs_readdirplus_request *req, mos_rpc_fs_readdirplus_response *resp)
+{
+    if (req->i_ref.data != (ptr_t) root)
+    {
+        resp->result.success = false;
+        resp->result.error = strdup("blockdevfs: invalid inode");
+        return RPC_RESULT_OK;
+    }
+
+    // the cursor is the lowest blockdev id that has not been returned yet
+    const size_t max_entries = req->max_entries ? req->max_entries : blockdev_list.size();
+    resp->entries = (pb_dirent_plus *) malloc(std::max<size_t>(max_entries, 1) * sizeof(pb_dirent_plus));
+
+    auto it = blockdev_list.lower_bound(req->cursor);
+    for (; it != blockdev_list.end() && resp->entries_count < max_entries; ++it)
+    {
+        const auto &[id, info] = *it;
+        pb_dirent_plus *e = &resp->entries[resp->entries_count++];
+        e->name = strdup(info.name.c_str());
+        e->i_ref.data = id;
+        e->next_cursor = id + 1;
+        blockdevfs_fill_info(id, info, &e->i_info);
+    }
+
+    resp->eof = it == blockdev_list.end();
+    resp->next_cursor = resp->eof ? 0 : it->first;
+    resp->result.success = true;
+    resp->result.error = NULL;
+    return RPC_RESULT_OK;
+}
+
 static rpc_result_code_t blockdevfs_lookup(rpc_context_t *, mos_rpc_fs_lookup_request *req, mos_rpc_fs_lookup_response *resp)
 {
     if (req->i_ref.data != (ptr_t) root)
@@ -119,18 +171,8 @@ static rpc_result_code_t blockdevfs_lookup(rpc_context_t *, mos_rpc_fs_lookup_re
 
     const auto &[id, info] = *it;
 
-    pb_inode_info *i = &resp->i_info;
-    i->ino = id;
-    i->type = FILE_TYPE_BLOCK_DEVICE;
-    i->perm = 0660;
-    i->uid = 0;
-    i->gid = 0;
-    i->size = info.num_blocks * info.block_size;
-    i->accessed = i->modified = i->created = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    i->nlinks = 1;
-    i->sticky = false;
-    i->suid = false;
-    i->sgid = false;
+    resp->i_ref.data = id; // the blockdev id, the root directory is referenced by a pointer instead
+    blockdevfs_fill_info(id, info, &resp->i_info);
 
     resp->result.success = true;
     resp->result.error = NULL;
@@ -146,12 +188,121 @@ static rpc_result_code_t blockdevfs_readlink(rpc_context_t *, mos_rpc_fs_readlin
     return RPC_RESULT_OK;
 }
 
+static rpc_server_stub_t *blockdevfs_get_server(const std::string &server_name)
+{
+    std::lock_guard<std::mutex> guard(blockdev_servers_lock);
+    auto &stub = blockdev_servers[server_name];
+    if (!stub)
+        stub = rpc_client_create(server_name.c_str());
+    return stub;
+}
+
+// read up to npages pages of a block device, in a single request to its server
+static pb_bytes_array_t *blockdevfs_read_pages(pb_inode_ref *ref, uint64_t pgoff, size_t npages, mos_rpc_result *result)
+{
+    const auto it = blockdev_list.find(ref->data);
+    if (it == blockdev_list.end())
+    {
+        result->success = false;
+        result->error = strdup("blockdevfs: invalid inode");
+        return NULL;
+    }
+
+    const blockdev_info &info = it->second;
+    const size_t offset = pgoff * MOS_PAGE_SIZE;
+    const size_t size = info.num_blocks * info.block_size;
+    result->success = true;
+    if (offset >= size || npages == 0)
+        return NULL; // nothing to read
+
+    const size_t nbytes = std::min(npages * MOS_PAGE_SIZE, size - offset);
+    const size_t skip = offset % info.block_size; // only if the blocks are larger than a page
+
+    rpc_server_stub_t *server = blockdevfs_get_server(info.server_name);
+    if (!server)
+    {
+        result->success = false;
+        result->error = strdup("blockdevfs: failed to connect to the block device");
+        return NULL;
+    }
+
+    mos_rpc_blockdev_read_request read_req = {
+        .n_boffset = offset / info.block_size,
+        .n_blocks = static_cast<uint32_t>((skip + nbytes + info.block_size - 1) / info.block_size),
+    };
+    mos_rpc_blockdev_read_response read_resp = mos_rpc_blockdev_read_response_init_zero;
+
+    pb_bytes_array_t *data = NULL;
+    if (blockdev_read_block(server, &read_req, &read_resp) != RPC_RESULT_OK || !read_resp.result.success || !read_resp.data || read_resp.data->size < skip + nbytes)
+    {
+        result->success = false;
+        result->error = strdup("blockdevfs: failed to read from the block device");
+    }
+    else
+    {
+        data = (pb_bytes_array_t *) malloc(PB_BYTES_ARRAY_T_ALLOCSIZE(nbytes));
+        data->size = nbytes;
+        memcpy(data->bytes, read_resp.data->bytes + skip, nbytes);
+    }
+
+    pb_release(mos_rpc_blockdev_read_response_fields, &read_resp);
+    return data;
+}
+
 static rpc_result_code_t blockdevfs_getpage(rpc_context_t *, mos_rpc_fs_getpage_request *req, mos_rpc_fs_getpage_response *resp)
+{
+    resp->data = blockdevfs_read_pages(&req->i_ref, req->pgoff, 1, &resp->result);
+    return RPC_RESULT_OK;
+}
+
+static rpc_result_code_t blockdevfs_getpages(rpc_context_t *, mos_rpc_fs_getpages_request *req, mos_rpc_fs_getpages_response *resp)
+{
+    resp->data = blockdevfs_read_pages(&req->i_ref, req->pgoff, req->npages, &resp->result);
+    return RPC_RESULT_OK;
+}
+
+static rpc_result_code_t blockdevfs_putpage(rpc_context_t *, mos_rpc_fs_putpage_request *req, mos_rpc_fs_putpage_response *resp)
+{
+    MOS_UNUSED(req);
+
+    resp->result.success = false;
+    resp->result.error = strdup("blockdevfs: the list of block devices cannot be modified");
+    return RPC_RESULT_OK;
+}
+
+static rpc_result_code_t blockdevfs_create(rpc_context_t *, mos_rpc_fs_create_request *req, mos_rpc_fs_create_response *resp)
+{
+    MOS_UNUSED(req);
+
+    resp->result.success = false;
+    resp->result.error = strdup("blockdevfs: the list of block devices cannot be modified");
+    return RPC_RESULT_OK;
+}
+
+static rpc_result_code_t blockdevfs_unlink(rpc_context_t *, mos_rpc_fs_unlink_request *req, mos_rpc_fs_unlink_response *resp)
+{
+    MOS_UNUSED(req);
+
+    resp->result.success = false;
+    resp->result.error = strdup("blockdevfs: the list of block devices cannot be modified");
+    return RPC_RESULT_OK;
+}
+
+static rpc_result_code_t blockdevfs_truncate(rpc_context_t *, mos_rpc_fs_truncate_request *req, mos_rpc_fs_truncate_response *resp)
+{
+    MOS_UNUSED(req);
+
+    resp->result.success = false;
+    resp->result.error = strdup("blockdevfs: the list of block devices cannot be modified");
+    return RPC_RESULT_OK;
+}
+
+static rpc_result_code_t blockdevfs_setattr(rpc_context_t *, mos_rpc_fs_setattr_request *req, mos_rpc_fs_setattr_response *resp)
 {
     MOS_UNUSED(req);
 
     resp->result.success = false;
-    resp->result.error = strdup("blockdevfs doen't support reading or writing pages");
+    resp->result.error = strdup("blockdevfs: the list of block devices cannot be modified");
     return RPC_RESULT_OK;
 }
 
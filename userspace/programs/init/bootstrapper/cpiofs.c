@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/param.h>
 
 size_t read_initrd(void *buf, size_t size, size_t offset)
 {
@@ -16,62 +17,151 @@ size_t read_initrd(void *buf, size_t size, size_t offset)
     return size;
 }
 
-bool cpio_read_metadata(const char *target, cpio_header_t *header, cpio_metadata_t *metadata)
+static cpio_entry_t *cpio_entries = NULL;
+static cpio_entry_t **cpio_buckets = NULL;
+static size_t cpio_n_buckets = 0; // a power of 2
+
+static u32 cpio_hash_path(const char *path)
 {
-    if (unlikely(strcmp(target, "TRAILER!!!") == 0))
-    {
-        fputs("what the heck are you doing?", stderr);
-        abort();
-    }
+    u32 hash = 2166136261u; // FNV-1a
+    for (; *path; path++)
+        hash = (hash ^ (u8) *path) * 16777619u;
+    return hash;
+}
 
+// walk the archive headers, returns the number of entries, filling them in if entries is not NULL
+static size_t cpio_index_scan(cpio_entry_t *entries)
+{
     size_t offset = 0;
+    size_t n = 0;
 
     while (true)
     {
-        read_initrd(header, sizeof(cpio_header_t), offset);
-
+        const cpio_header_t *header = (const cpio_header_t *) (MOS_INITRD_BASE + offset);
         if (strncmp(header->magic, "07070", 5) != 0 || (header->magic[5] != '1' && header->magic[5] != '2'))
         {
             fprintf(stderr, "WARN: invalid cpio header magic, possibly corrupt archive\n");
-            return false;
+            return n;
+        }
+
+        const size_t namesize = strntoll(header->namesize, NULL, 16, sizeof(header->namesize) / sizeof(char));
+        const size_t data_len = strntoll(header->filesize, NULL, 16, sizeof(header->filesize) / sizeof(char));
+        const cpio_metadata_t metadata = {
+            .header_offset = offset,
+            .name_offset = offset + sizeof(cpio_header_t),
+            .name_length = namesize,
+            .data_offset = ALIGN_UP(offset + sizeof(cpio_header_t) + namesize, 4),
+            .data_length = data_len,
+        };
+
+        const char *path = (const char *) (MOS_INITRD_BASE + metadata.name_offset);
+        if (strcmp(path, "TRAILER!!!") == 0)
+            return n;
+
+        if (entries)
+        {
+            cpio_entry_t *entry = &entries[n];
+            entry->header = header;
+            entry->metadata = metadata;
+            entry->path = path;
+
+            const char *slash = strrchr(path, '/');
+            entry->name = slash ? slash + 1 : path;
+            entry->name_len = strlen(entry->name);
         }
 
-        offset += sizeof(cpio_header_t);
+        n++;
+        offset = ALIGN_UP(metadata.data_offset + data_len, 4);
+    }
+}
 
-        const size_t filename_len = strntoll(header->namesize, NULL, 16, sizeof(header->namesize) / sizeof(char));
+static cpio_entry_t *cpio_index_find_parent(const cpio_entry_t *entry)
+{
+    if (entry->name == entry->path)
+        return cpio_index_lookup("."); // a top-level entry
+
+    const size_t parent_len = entry->name - entry->path - 1; // -1 for the slash
+    char parent_path[parent_len + 1];
+    memcpy(parent_path, entry->path, parent_len);
+    parent_path[parent_len] = '\0';
+    return cpio_index_lookup(parent_path);
+}
 
-        char filename[filename_len + 1]; // +1 for null terminator
-        read_initrd(filename, filename_len, offset);
-        filename[filename_len] = '\0';
+bool cpio_index_build(void)
+{
+    const size_t n = cpio_index_scan(NULL);
 
-        const bool found = strncmp(filename, target, filename_len) == 0;
+    cpio_n_buckets = 16;
+    while (cpio_n_buckets < n)
+        cpio_n_buckets *= 2;
 
-        if (found)
-        {
-            metadata->header_offset = offset - sizeof(cpio_header_t);
-            metadata->name_offset = offset;
-            metadata->name_length = filename_len;
-        }
+    cpio_entries = calloc(MAX(n, 1u), sizeof(cpio_entry_t));
+    cpio_buckets = calloc(cpio_n_buckets, sizeof(cpio_entry_t *));
+    if (!cpio_entries || !cpio_buckets)
+        return false;
+
+    cpio_index_scan(cpio_entries);
+    for (size_t i = 0; i < n; i++)
+    {
+        cpio_entry_t *entry = &cpio_entries[i];
+        cpio_entry_t **bucket = &cpio_buckets[cpio_hash_path(entry->path) & (cpio_n_buckets - 1)];
+        entry->hash_next = *bucket;
+        *bucket = entry;
+    }
 
-        if (unlikely(strcmp(filename, "TRAILER!!!") == 0))
-            return false;
+    // count the children of each directory, then collect them
+    for (size_t i = 0; i < n; i++)
+    {
+        cpio_entry_t *entry = &cpio_entries[i];
+        if (strcmp(entry->path, ".") == 0)
+            continue; // the root
+
+        entry->parent = cpio_index_find_parent(entry);
+        if (entry->parent)
+            entry->parent->n_children++;
+        else
+            fprintf(stderr, "WARN: cpio: '%s' has no parent directory in the archive\n", entry->path);
+    }
 
-        offset += filename_len;
-        offset = ALIGN_UP(offset, 4);
+    for (size_t i = 0; i < n; i++)
+    {
+        cpio_entry_t *entry = &cpio_entries[i];
+        if (entry->n_children)
+            entry->children = calloc(entry->n_children, sizeof(cpio_entry_t *)), entry->n_children = 0;
+    }
 
-        const size_t data_len = strntoll(header->filesize, NULL, 16, sizeof(header->filesize) / sizeof(char));
-        if (found)
-        {
-            metadata->data_offset = offset;
-            metadata->data_length = data_len;
-        }
+    for (size_t i = 0; i < n; i++)
+    {
+        cpio_entry_t *entry = &cpio_entries[i];
+        if (entry->parent && entry->parent->children)
+            entry->parent->children[entry->parent->n_children++] = entry;
+    }
 
-        offset += data_len;
-        offset = ALIGN_UP(offset, 4);
+    return true;
+}
+
+cpio_entry_t *cpio_index_lookup(const char *path)
+{
+    if (unlikely(!cpio_buckets))
+        return NULL;
 
-        if (found)
-            return true;
+    for (cpio_entry_t *entry = cpio_buckets[cpio_hash_path(path) & (cpio_n_buckets - 1)]; entry; entry = entry->hash_next)
+    {
+        if (strcmp(entry->path, path) == 0)
+            return entry;
     }
 
-    unreachable();
+    return NULL;
+}
+
+cpio_entry_t *cpio_index_lookup_child(const cpio_entry_t *dir, const char *name)
+{
+    char path[MOS_PATH_MAX_LENGTH];
+    const bool is_root = strcmp(dir->path, ".") == 0;
+    const int len = is_root ? snprintf(path, sizeof(path), "%s", name) : snprintf(path, sizeof(path), "%s/%s", dir->path, name);
+    if (len < 0 || (size_t) len >= sizeof(path))
+        return NULL;
+
+    cpio_entry_t *entry = cpio_index_lookup(path);
+    return entry && entry->parent == dir ? entry : NULL;
 }
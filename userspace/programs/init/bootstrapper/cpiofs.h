@@ -48,6 +48,28 @@ typedef struct
     size_t data_length;
 } cpio_metadata_t;
 
-bool cpio_read_metadata(const char *target, cpio_header_t *header, cpio_metadata_t *metadata);
+typedef struct _cpio_inode cpio_inode_t; // defined by the server
+
+// the archive is indexed once at startup, every file has an entry, which is found by its path
+typedef struct _cpio_entry cpio_entry_t;
+struct _cpio_entry
+{
+    const cpio_header_t *header; // in the archive
+    cpio_metadata_t metadata;
+    const char *path; // in the archive, e.g. "." for the root, "bin/init" for others
+    const char *name; // the last segment of the path
+    size_t name_len;
+
+    cpio_entry_t *hash_next;
+    cpio_entry_t *parent;
+    cpio_entry_t **children; // directories only, in archive order
+    size_t n_children;
+
+    cpio_inode_t *inode; // created on first use, so that every lookup returns the same inode
+};
+
+bool cpio_index_build(void);
+cpio_entry_t *cpio_index_lookup(const char *path);
+cpio_entry_t *cpio_index_lookup_child(const cpio_entry_t *dir, const char *name);
 
 size_t read_initrd(void *buf, size_t size, size_t offset);
@@ -11,10 +11,12 @@
 #include <mos/filesystem/fs_types.h>
 #include <mos/mos_global.h>
 #include <mos/proto/fs_server.h>
+#include <mos/syscall/usermode.h>
 #include <pb.h>
 #include <pb_decode.h>
 #include <pb_encode.h>
 #include <stdio.h>
+#include <sys/mman.h>
 #include <sys/param.h>
 #include <unistd.h>
 
@@ -24,6 +26,7 @@
 
 #define CPIOFS_NAME            "cpiofs"
 #define CPIOFS_RPC_SERVER_NAME "fs.cpiofs"
+#define CPIOFS_READONLY_ERROR  "cpiofs: the initrd is read-only"
 
 RPC_CLIENT_DEFINE_SIMPLECALL(fs_manager, USERFS_MANAGER_X)
 
@@ -32,14 +35,11 @@ RPC_DECL_SERVER_PROTOTYPES(cpiofs, USERFS_IMPL_X)
 static rpc_server_t *cpiofs = NULL;
 static rpc_server_stub_t *fs_manager = NULL;
 
-typedef struct
+struct _cpio_inode
 {
     pb_inode_info pb_i;
-    size_t header_offset;
-    size_t name_offset, name_length;
-    size_t data_offset;
-    cpio_header_t header;
-} cpio_inode_t;
+    const cpio_entry_t *entry;
+};
 
 static file_type_t cpio_modebits_to_filetype(u32 modebits)
 {
@@ -59,23 +59,18 @@ static file_type_t cpio_modebits_to_filetype(u32 modebits)
     return type;
 }
 
-static cpio_inode_t *cpio_trycreate_i(const char *path)
+// the inode of an entry, which is created only once, the kernel gets the same reference every time
+static cpio_inode_t *cpio_get_i(cpio_entry_t *entry)
 {
-    cpio_header_t header;
-    cpio_metadata_t metadata;
-    const bool found = cpio_read_metadata(path, &header, &metadata);
-    if (!found)
-        return NULL;
+    if (entry->inode)
+        return entry->inode;
 
     cpio_inode_t *cpio_inode = malloc(sizeof(cpio_inode_t));
-    cpio_inode->header = header;
-    cpio_inode->header_offset = metadata.header_offset;
-    cpio_inode->name_offset = metadata.name_offset;
-    cpio_inode->name_length = metadata.name_length;
-    cpio_inode->data_offset = metadata.data_offset;
-
-    const u32 modebits = strntoll(cpio_inode->header.mode, NULL, 16, sizeof(cpio_inode->header.mode) / sizeof(char));
-    const u64 ino = strntoll(cpio_inode->header.ino, NULL, 16, sizeof(cpio_inode->header.ino) / sizeof(char));
+    cpio_inode->entry = entry;
+
+    const cpio_header_t *header = entry->header;
+    const u32 modebits = strntoll(header->mode, NULL, 16, sizeof(header->mode) / sizeof(char));
+    const u64 ino = strntoll(header->ino, NULL, 16, sizeof(header->ino) / sizeof(char));
     const file_type_t file_type = cpio_modebits_to_filetype(modebits & CPIO_MODE_FILE_TYPE);
 
     pb_inode_info *const i = &cpio_inode->pb_i;
@@ -85,13 +80,15 @@ static cpio_inode_t *cpio_trycreate_i(const char *path)
 
     // 0000777 - The lower 9 bits specify read/write/execute permissions for world, group, and user following standard POSIX conventions.
     i->perm = modebits & 0777;
-    i->size = metadata.data_length;
-    i->uid = strntoll(cpio_inode->header.uid, NULL, 16, sizeof(cpio_inode->header.uid) / sizeof(char));
-    i->gid = strntoll(cpio_inode->header.gid, NULL, 16, sizeof(cpio_inode->header.gid) / sizeof(char));
+    i->size = entry->metadata.data_length;
+    i->uid = strntoll(header->uid, NULL, 16, sizeof(header->uid) / sizeof(char));
+    i->gid = strntoll(header->gid, NULL, 16, sizeof(header->gid) / sizeof(char));
     i->sticky = modebits & CPIO_MODE_STICKY;
     i->suid = modebits & CPIO_MODE_SUID;
     i->sgid = modebits & CPIO_MODE_SGID;
-    i->nlinks = strntoll(cpio_inode->header.nlink, NULL, 16, sizeof(cpio_inode->header.nlink) / sizeof(char));
+    i->nlinks = strntoll(header->nlink, NULL, 16, sizeof(header->nlink) / sizeof(char));
+
+    entry->inode = cpio_inode;
     return cpio_inode;
 }
 
@@ -103,8 +100,8 @@ static rpc_result_code_t cpiofs_mount(rpc_context_t *, mos_rpc_fs_mount_request
     if (req->device && strlen(req->device) > 0 && strcmp(req->device, "none") != 0)
         printf("cpio: mount: device name '%s' is not supported\n", req->device);
 
-    cpio_inode_t *cpio_i = cpio_trycreate_i(".");
-    if (!cpio_i)
+    cpio_entry_t *root = cpio_index_lookup(".");
+    if (!root)
     {
         puts("cpio: failed to mount");
         resp->result.error = strdup("unable to find root inode");
@@ -112,6 +109,7 @@ static rpc_result_code_t cpiofs_mount(rpc_context_t *, mos_rpc_fs_mount_request
         return RPC_RESULT_OK;
     }
 
+    cpio_inode_t *cpio_i = cpio_get_i(root);
     resp->result.success = true;
     resp->root_info = cpio_i->pb_i;
     resp->root_ref.data = (ptr_t) cpio_i;
@@ -120,119 +118,62 @@ static rpc_result_code_t cpiofs_mount(rpc_context_t *, mos_rpc_fs_mount_request
 
 static rpc_result_code_t cpiofs_readdir(rpc_context_t *, mos_rpc_fs_readdir_request *req, mos_rpc_fs_readdir_response *resp)
 {
-    cpio_inode_t *inode = (cpio_inode_t *) req->i_ref.data;
-
-    char path_prefix[inode->name_length + 1]; // +1 for null terminator
-    read_initrd(path_prefix, inode->name_length, inode->name_offset);
-    path_prefix[inode->name_length] = '\0';
-
-    const size_t prefix_len = statement_expr(size_t, {
-        retval = strlen(path_prefix);
-        if (strcmp(path_prefix, ".") == 0)
-            path_prefix[0] = '\0', retval = 0; // root directory
-    });
-
-    // find all children of this directory, that starts with 'path' and doesn't have any more slashes
+    const cpio_entry_t *dir = ((cpio_inode_t *) req->i_ref.data)->entry;
 
-    size_t n_written = 0;
-    resp->entries_count = 1;
-    resp->entries = malloc(sizeof(pb_dirent) * resp->entries_count);
-
-    size_t offset = 0;
-
-    while (true)
+    resp->entries = malloc(sizeof(pb_dirent) * MAX(dir->n_children, 1u));
+    for (size_t i = 0; i < dir->n_children; i++)
     {
-        cpio_header_t header;
-        read_initrd(&header, sizeof(cpio_header_t), offset);
-        offset += sizeof(cpio_header_t);
-
-        if (strncmp(header.magic, "07070", 5) != 0 || (header.magic[5] != '1' && header.magic[5] != '2'))
-            puts("invalid cpio header magic, possibly corrupt archive");
-
-        const size_t fpath_len = strntoll(header.namesize, NULL, 16, sizeof(header.namesize) / sizeof(char));
-
-        char fpath[fpath_len + 1]; // +1 for null terminator
-        read_initrd(fpath, fpath_len, offset);
-        fpath[fpath_len] = '\0';
+        const cpio_entry_t *child = dir->children[i];
+        const u32 modebits = strntoll(child->header->mode, NULL, 16, sizeof(child->header->mode) / sizeof(char));
 
-        const bool found = strncmp(path_prefix, fpath, prefix_len) == 0 &&  // make sure the path starts with the parent path
-                           (prefix_len == 0 || fpath[prefix_len] == '/') && // make sure it's a child, not a sibling (/path/to vs /path/toooo)
-                           strchr(fpath + prefix_len + 1, '/') == NULL;     // make sure it's a direct child, not a grandchild (/path/to vs /path/to/ooo)
-
-        const bool is_TRAILER = strcmp(fpath, "TRAILER!!!") == 0;
-        const bool is_root_dot = strcmp(fpath, ".") == 0;
-
-        if (found && !is_TRAILER && !is_root_dot)
-        {
-            const s64 ino = strntoll(header.ino, NULL, 16, sizeof(header.ino) / sizeof(char));
-            const u32 modebits = strntoll(header.mode, NULL, 16, sizeof(header.mode) / sizeof(char));
-            const file_type_t type = cpio_modebits_to_filetype(modebits & CPIO_MODE_FILE_TYPE);
-
-            const char *fname = fpath + prefix_len + (prefix_len != 0);          // +1 for the slash if it's not the root
-            const size_t fname_len = fpath_len - prefix_len - (prefix_len != 0); // -1 for the slash if it's not the root
-
-            // write ino, name, name_len, type
-            if (n_written >= resp->entries_count)
-            {
-                resp->entries_count *= 2;
-                resp->entries = realloc(resp->entries, sizeof(pb_dirent) * resp->entries_count);
-            }
-
-            pb_dirent *const de = &resp->entries[n_written++];
-            de->ino = ino;
-            de->name = strndup(fname, fname_len);
-            de->type = type;
-        }
-
-        if (unlikely(is_TRAILER))
-            break; // coming to the end of the archive
-
-        offset += fpath_len;
-        offset = ALIGN_UP(offset, 4);
-
-        const size_t data_len = strntoll(header.filesize, NULL, 16, sizeof(header.filesize) / sizeof(char));
-        offset += data_len;
-        offset = ALIGN_UP(offset, 4);
+        pb_dirent *const de = &resp->entries[resp->entries_count++];
+        de->ino = strntoll(child->header->ino, NULL, 16, sizeof(child->header->ino) / sizeof(char));
+        de->name = strndup(child->name, child->name_len);
+        de->type = cpio_modebits_to_filetype(modebits & CPIO_MODE_FILE_TYPE);
     }
 
-    resp->entries_count = n_written; // not the same as resp->entries_count, because we might have allocated more than we needed
     return RPC_RESULT_OK;
 }
 
-static rpc_result_code_t cpiofs_lookup(rpc_context_t *, mos_rpc_fs_lookup_request *req, mos_rpc_fs_lookup_response *resp)
+static rpc_result_code_t cpiofs_readdirplus(rpc_context_t *, mos_rpc_fs_readdirplus_request *req, mos_rpc_fs_readdirplus_response *resp)
 {
-    char pathbuf[PATH_MAX] = { 0 };
-    cpio_inode_t *parent_diri = (cpio_inode_t *) req->i_ref.data;
-    read_initrd(pathbuf, parent_diri->name_length, parent_diri->name_offset);
+    const cpio_entry_t *dir = ((cpio_inode_t *) req->i_ref.data)->entry;
 
-    // append the filename (req->name)
-    const size_t pathbuf_len = strlen(pathbuf);
-    const size_t name_len = strlen(req->name);
+    // the cursor is the index of the next child
+    const size_t start = MIN((size_t) req->cursor, dir->n_children);
+    const size_t max_entries = MIN(req->max_entries ? req->max_entries : 64, dir->n_children - start);
+    resp->entries = malloc(sizeof(pb_dirent_plus) * MAX(max_entries, 1u));
+    resp->result.success = true;
 
-    if (unlikely(pathbuf_len + name_len + 1 >= MOS_PATH_MAX_LENGTH))
+    size_t i = start;
+    for (; i < dir->n_children && resp->entries_count < max_entries; i++)
     {
-        puts("cpiofs_lookup: path too long");
-        return false;
+        // the inodes are cached in the index, every batch hands out the same references
+        cpio_inode_t *const cpio_i = cpio_get_i(dir->children[i]);
+        pb_dirent_plus *const de = &resp->entries[resp->entries_count++];
+        de->i_ref.data = (ptr_t) cpio_i;
+        de->i_info = cpio_i->pb_i;
+        de->name = strndup(dir->children[i]->name, dir->children[i]->name_len);
+        de->next_cursor = i + 1;
     }
 
-    pathbuf[pathbuf_len] = '/';
-    memcpy(pathbuf + pathbuf_len + 1, req->name, name_len);
-    pathbuf[pathbuf_len + 1 + name_len] = '\0';
-
-    const char *path = statement_expr(char *, {
-        retval = pathbuf;
-        if (pathbuf[0] == '.' && pathbuf[1] == '/')
-            retval += 2; // skip the leading ./ (relative path)
-    });
+    resp->eof = i >= dir->n_children;
+    resp->next_cursor = i;
+    return RPC_RESULT_OK;
+}
 
-    cpio_inode_t *const cpio_i = cpio_trycreate_i(path);
-    if (!cpio_i)
+static rpc_result_code_t cpiofs_lookup(rpc_context_t *, mos_rpc_fs_lookup_request *req, mos_rpc_fs_lookup_response *resp)
+{
+    const cpio_inode_t *parent_diri = (cpio_inode_t *) req->i_ref.data;
+    cpio_entry_t *const entry = cpio_index_lookup_child(parent_diri->entry, req->name);
+    if (!entry)
     {
         resp->result.success = false;
         resp->result.error = strdup("unable to find inode");
         return RPC_RESULT_OK;
     }
 
+    cpio_inode_t *const cpio_i = cpio_get_i(entry);
     resp->result.success = true;
     resp->i_info = cpio_i->pb_i;
     resp->i_ref.data = (ptr_t) cpio_i;
@@ -242,8 +183,8 @@ static rpc_result_code_t cpiofs_lookup(rpc_context_t *, mos_rpc_fs_lookup_reques
 static rpc_result_code_t cpiofs_readlink(rpc_context_t *, mos_rpc_fs_readlink_request *req, mos_rpc_fs_readlink_response *resp)
 {
     cpio_inode_t *cpio_i = (cpio_inode_t *) req->i_ref.data;
-    char path[cpio_i->data_offset + cpio_i->pb_i.size + 1];
-    read_initrd(path, cpio_i->pb_i.size, cpio_i->data_offset);
+    char path[cpio_i->pb_i.size + 1];
+    read_initrd(path, cpio_i->pb_i.size, cpio_i->entry->metadata.data_offset);
     path[cpio_i->pb_i.size] = '\0';
 
     resp->result.success = true;
@@ -251,6 +192,9 @@ static rpc_result_code_t cpiofs_readlink(rpc_context_t *, mos_rpc_fs_readlink_re
     return RPC_RESULT_OK;
 }
 
+// the page that getpage fills and grants to the kernel, it is replaced by a zero page every time it is granted
+static void *cpiofs_grant_page = NULL;
+
 static rpc_result_code_t cpiofs_getpage(rpc_context_t *, mos_rpc_fs_getpage_request *req, mos_rpc_fs_getpage_response *resp)
 {
     cpio_inode_t *cpio_i = (cpio_inode_t *) req->i_ref.data;
@@ -265,10 +209,30 @@ static rpc_result_code_t cpiofs_getpage(rpc_context_t *, mos_rpc_fs_getpage_requ
 
     const size_t bytes_to_read = MIN((size_t) MOS_PAGE_SIZE, cpio_i->pb_i.size - req->pgoff * MOS_PAGE_SIZE);
 
+    if (!cpiofs_grant_page)
+    {
+        cpiofs_grant_page = mmap(NULL, MOS_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (cpiofs_grant_page == MAP_FAILED)
+            cpiofs_grant_page = NULL;
+    }
+
+    if (cpiofs_grant_page)
+    {
+        // hand the page over to the kernel instead of sending its contents
+        read_initrd(cpiofs_grant_page, bytes_to_read, cpio_i->entry->metadata.data_offset + req->pgoff * MOS_PAGE_SIZE);
+        memset((char *) cpiofs_grant_page + bytes_to_read, 0, MOS_PAGE_SIZE - bytes_to_read);
+        resp->page_grant = syscall_vm_page_grant(cpiofs_grant_page);
+        if (resp->page_grant)
+        {
+            resp->result.success = true;
+            return RPC_RESULT_OK;
+        }
+    }
+
     resp->data = malloc(PB_BYTES_ARRAY_T_ALLOCSIZE(bytes_to_read));
     resp->data->size = bytes_to_read;
 
-    const size_t read = read_initrd(resp->data->bytes, bytes_to_read, cpio_i->data_offset + req->pgoff * MOS_PAGE_SIZE);
+    const size_t read = read_initrd(resp->data->bytes, bytes_to_read, cpio_i->entry->metadata.data_offset + req->pgoff * MOS_PAGE_SIZE);
     if (read != bytes_to_read)
     {
         puts("cpiofs_getpage: failed to read page");
@@ -283,8 +247,99 @@ static rpc_result_code_t cpiofs_getpage(rpc_context_t *, mos_rpc_fs_getpage_requ
     return RPC_RESULT_OK;
 }
 
+static rpc_result_code_t cpiofs_getpages(rpc_context_t *, mos_rpc_fs_getpages_request *req, mos_rpc_fs_getpages_response *resp)
+{
+    cpio_inode_t *cpio_i = (cpio_inode_t *) req->i_ref.data;
+    resp->result.success = true;
+
+    const size_t offset = req->pgoff * MOS_PAGE_SIZE;
+    if (offset >= cpio_i->pb_i.size || req->npages == 0)
+        return RPC_RESULT_OK; // nothing to read
+
+    const size_t nbytes = MIN((size_t) req->npages * MOS_PAGE_SIZE, cpio_i->pb_i.size - offset);
+    const size_t npages = ALIGN_UP(nbytes, MOS_PAGE_SIZE) / MOS_PAGE_SIZE;
+
+    if (!cpiofs_grant_page)
+    {
+        cpiofs_grant_page = mmap(NULL, MOS_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (cpiofs_grant_page == MAP_FAILED)
+            cpiofs_grant_page = NULL;
+    }
+
+    if (cpiofs_grant_page)
+    {
+        // every grant replaces the page with a zero page, so the same address is filled again for the next one
+        resp->page_grants = malloc(npages * sizeof(uint64_t));
+        for (size_t i = 0; i < npages; i++)
+        {
+            const size_t bytes = MIN((size_t) MOS_PAGE_SIZE, nbytes - i * MOS_PAGE_SIZE);
+            read_initrd(cpiofs_grant_page, bytes, cpio_i->entry->metadata.data_offset + offset + i * MOS_PAGE_SIZE);
+            memset((char *) cpiofs_grant_page + bytes, 0, MOS_PAGE_SIZE - bytes);
+
+            const uint64_t grant = syscall_vm_page_grant(cpiofs_grant_page);
+            if (!grant)
+                break;
+            resp->page_grants[resp->page_grants_count++] = grant;
+        }
+
+        if (resp->page_grants_count)
+            return RPC_RESULT_OK; // the kernel reads the rest with another request
+    }
+
+    resp->data = malloc(PB_BYTES_ARRAY_T_ALLOCSIZE(nbytes));
+    resp->data->size = nbytes;
+    read_initrd(resp->data->bytes, nbytes, cpio_i->entry->metadata.data_offset + offset);
+    return RPC_RESULT_OK;
+}
+
+static rpc_result_code_t cpiofs_putpage(rpc_context_t *, mos_rpc_fs_putpage_request *req, mos_rpc_fs_putpage_response *resp)
+{
+    MOS_UNUSED(req);
+    resp->result.success = false;
+    resp->result.error = strdup(CPIOFS_READONLY_ERROR);
+    return RPC_RESULT_OK;
+}
+
+static rpc_result_code_t cpiofs_create(rpc_context_t *, mos_rpc_fs_create_request *req, mos_rpc_fs_create_response *resp)
+{
+    MOS_UNUSED(req);
+    resp->result.success = false;
+    resp->result.error = strdup(CPIOFS_READONLY_ERROR);
+    return RPC_RESULT_OK;
+}
+
+static rpc_result_code_t cpiofs_unlink(rpc_context_t *, mos_rpc_fs_unlink_request *req, mos_rpc_fs_unlink_response *resp)
+{
+    MOS_UNUSED(req);
+    resp->result.success = false;
+    resp->result.error = strdup(CPIOFS_READONLY_ERROR);
+    return RPC_RESULT_OK;
+}
+
+static rpc_result_code_t cpiofs_truncate(rpc_context_t *, mos_rpc_fs_truncate_request *req, mos_rpc_fs_truncate_response *resp)
+{
+    MOS_UNUSED(req);
+    resp->result.success = false;
+    resp->result.error = strdup(CPIOFS_READONLY_ERROR);
+    return RPC_RESULT_OK;
+}
+
+static rpc_result_code_t cpiofs_setattr(rpc_context_t *, mos_rpc_fs_setattr_request *req, mos_rpc_fs_setattr_response *resp)
+{
+    MOS_UNUSED(req);
+    resp->result.success = false;
+    resp->result.error = strdup(CPIOFS_READONLY_ERROR);
+    return RPC_RESULT_OK;
+}
+
 void init_start_cpiofs_server(fd_t notifier)
 {
+    if (!cpio_index_build())
+    {
+        puts("cpiofs: failed to index the initrd");
+        goto bad;
+    }
+
     cpiofs = rpc_server_create(CPIOFS_RPC_SERVER_NAME, NULL);
     if (!cpiofs)
     {
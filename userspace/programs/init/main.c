@@ -49,12 +49,12 @@ bool start_services(void)
     for (size_t i = 0; i < num_drivers; i++)
     {
         const char *service = services[i];
-        pid_t driver_pid = fork();
+        pid_t driver_pid = syscall_vfork();
         if (driver_pid == 0)
         {
-            // child
+            // child, borrowing our memory until it execs
             execl(service, service, NULL);
-            exit(-1);
+            syscall_exit(-1);
         }
 
         if (driver_pid <= 0)
@@ -234,10 +234,10 @@ int main(int argc, const char *argv[])
     shell_argv[shell_argc] = NULL;
 
 start_shell:;
-    const pid_t shell_pid = fork();
+    const pid_t shell_pid = syscall_vfork();
     if (shell_pid == 0)
         if (execv(shell, (char **) shell_argv) <= 0)
-            return DYN_ERROR_CODE;
+            syscall_exit(DYN_ERROR_CODE); // the child must not return, it's still running on our stack
 
     while (true)
     {
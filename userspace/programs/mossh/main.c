@@ -4,6 +4,7 @@
 
 #include <argparse/libargparse.h>
 #include <fcntl.h>
+#include <mos/syscall/usermode.h>
 #include <readline/libreadline.h>
 #include <signal.h>
 #include <stdio.h>
@@ -77,11 +78,12 @@ static char *string_trim(char *in)
 
 static pid_t spawn(const char *path, const char *const argv[])
 {
-    pid_t pid = fork();
+    // the child borrows our memory until it execs, so it must not return from here
+    pid_t pid = syscall_vfork();
     if (pid == 0)
     {
         execve(path, (char *const *) argv, environ);
-        exit(-1);
+        syscall_exit(-1); // don't run atexit handlers or flush stdio, they belong to the parent
     }
 
     return pid;
@@ -3,13 +3,64 @@
 #include <abi-bits/errno.h>
 #include <mos/syscall/usermode.h>
 #include <stdio.h>
+#include <string.h>
 
 #define WAITMSG "pid %d waits for %d\n"
 
+#define BENCHMARK_ITERATIONS  32
+#define BENCHMARK_DIRTY_BYTES (16 * 1024 * 1024) // private memory the parent owns while spawning
+
+static u64 read_cycles(void)
+{
+#if defined(__x86_64__)
+    u32 lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((u64) hi << 32) | lo;
+#elif defined(__riscv)
+    u64 time;
+    __asm__ volatile("rdtime %0" : "=r"(time));
+    return time;
+#else
+    return 0;
+#endif
+}
+
+static u64 benchmark_spawn(const char *self, bool use_vfork, bool do_exec)
+{
+    const char *const argv[] = { self, "exit", NULL };
+    const u64 start = read_cycles();
+    for (int i = 0; i < BENCHMARK_ITERATIONS; i++)
+    {
+        const pid_t pid = use_vfork ? syscall_vfork() : syscall_fork();
+        if (pid == 0)
+        {
+            if (do_exec)
+                syscall_execveat(FD_CWD, self, argv, NULL, 0);
+            syscall_exit(do_exec ? -1 : 0);
+        }
+        syscall_wait_for_process(pid, NULL, 0);
+    }
+    return (read_cycles() - start) / BENCHMARK_ITERATIONS;
+}
+
+static void fork_exec_benchmark(const char *self)
+{
+    // make the parent's page tables non-trivial, fork has to write-protect and copy all of them
+    char *dirty = syscall_mmap_anonymous(0, BENCHMARK_DIRTY_BYTES, MEM_PERM_READ | MEM_PERM_WRITE, MMAP_PRIVATE);
+    for (size_t i = 0; i < BENCHMARK_DIRTY_BYTES; i += 4096)
+        dirty[i] = 1;
+
+    printf("fork+exit:  %llu cycles per spawn\n", (unsigned long long) benchmark_spawn(self, false, false)); // the cost of copying the mm alone
+    printf("fork+exec:  %llu cycles per spawn\n", (unsigned long long) benchmark_spawn(self, false, true));
+    printf("vfork+exec: %llu cycles per spawn\n", (unsigned long long) benchmark_spawn(self, true, true));
+    syscall_munmap(dirty, BENCHMARK_DIRTY_BYTES);
+}
+
 int main(int argc, char **argv)
 {
-    MOS_UNUSED(argc);
-    MOS_UNUSED(argv);
+    if (argc > 1 && strcmp(argv[1], "exit") == 0)
+        return 0; // spawned by the benchmark
+
     setbuf(stdout, NULL);
     int pid = syscall_fork();
     if (pid == 0)
@@ -72,6 +123,7 @@ int main(int argc, char **argv)
         printf("Parent process: pid = %d, child pid = %d\n", syscall_get_pid(), pid);
         syscall_wait_for_process(pid, NULL, 0);
         printf("fork test passed\n");
+        fork_exec_benchmark("/initrd/tests/fork-test");
     }
     return 0;
 }
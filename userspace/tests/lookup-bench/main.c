@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <mos/mos_global.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define BENCH_ROOT   "/lookup-bench"
+#define DEPTH        16
+#define ITERATIONS   10000
+#define DEFAULT_FILE "/initrd/tests/lookup-bench"
+
+static u64 read_cycles(void)
+{
+#if defined(__x86_64__)
+    u32 lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((u64) hi << 32) | lo;
+#elif defined(__riscv)
+    u64 time;
+    __asm__ volatile("rdtime %0" : "=r"(time));
+    return time;
+#else
+    return 0;
+#endif
+}
+
+// create BENCH_ROOT/d0/d1/.../d{DEPTH-1}, and return its path in buf
+static bool make_deep_tree(char *buf, size_t size)
+{
+    size_t len = snprintf(buf, size, "%s", BENCH_ROOT);
+    mkdir(buf, 0755);
+    for (int i = 0; i < DEPTH; i++)
+    {
+        len += snprintf(buf + len, size - len, "/d%d", i);
+        if (len >= size)
+            return false;
+        mkdir(buf, 0755); // it may already exist from a previous run
+    }
+
+    struct stat st;
+    return stat(buf, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// stat() the path repeatedly, returns false if the result isn't the expected one
+static bool bench_lookup(const char *name, const char *path, bool expect_exist)
+{
+    struct stat st;
+    if ((stat(path, &st) == 0) != expect_exist)
+    {
+        fprintf(stderr, "unexpected result for '%s'\n", path);
+        return false;
+    }
+
+    const u64 start = read_cycles();
+    for (int i = 0; i < ITERATIONS; i++)
+        stat(path, &st);
+    const u64 cycles = read_cycles() - start;
+
+    printf("%-12s: %llu cycles per lookup (%s)\n", name, (unsigned long long) (cycles / ITERATIONS), path);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const char *file = argc > 1 ? argv[1] : DEFAULT_FILE;
+
+    char deep[256], missing[256];
+    if (!make_deep_tree(deep, sizeof(deep)))
+    {
+        fprintf(stderr, "failed to create the directory tree under %s\n", BENCH_ROOT);
+        return 1;
+    }
+    snprintf(missing, sizeof(missing), "%s/missing", deep);
+
+    bool ok = true;
+    ok &= bench_lookup("deep", deep, true);
+    ok &= bench_lookup("deep-dots", BENCH_ROOT "/d0/./d1/../d1/d2/", true);
+    ok &= bench_lookup("missing", missing, false);
+    ok &= bench_lookup("file", file, true);
+    return ok ? 0 : 1;
+}
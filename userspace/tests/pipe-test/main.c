@@ -8,8 +8,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#define BENCHMARK_ROUND_TRIPS 4096
+#define BENCHMARK_BULK_BYTES  (8 * 1024 * 1024)
+#define BENCHMARK_CHUNK_BYTES 4096
+
 void badbadbad(void)
 {
     puts("badbadbad");
@@ -53,11 +58,94 @@ void writer(int fd)
     }
 }
 
+static u64 read_cycles(void)
+{
+#if defined(__x86_64__)
+    u32 lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((u64) hi << 32) | lo;
+#elif defined(__riscv)
+    u64 time;
+    __asm__ volatile("rdtime %0" : "=r"(time));
+    return time;
+#else
+    return 0;
+#endif
+}
+
+// the child echoes every byte back, so each round trip blocks and wakes both sides once
+static void pipe_pingpong_benchmark(void)
+{
+    fd_t ping[2], pong[2];
+    if (pipe(ping) || pipe(pong))
+        perror("pingpong: pipe(2) failed"), exit(1);
+
+    char byte = 'x';
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(ping[1]), close(pong[0]);
+        while (read(ping[0], &byte, 1) == 1)
+            write(pong[1], &byte, 1);
+        exit(0);
+    }
+
+    close(ping[0]), close(pong[1]);
+    const u64 start = read_cycles();
+    for (int i = 0; i < BENCHMARK_ROUND_TRIPS; i++)
+    {
+        if (write(ping[1], &byte, 1) != 1 || read(pong[0], &byte, 1) != 1)
+            badbadbad();
+    }
+    const u64 cycles = read_cycles() - start;
+
+    close(ping[1]), close(pong[0]);
+    waitpid(pid, NULL, 0);
+    printf("ping-pong: %llu cycles per round trip\n", (unsigned long long) (cycles / BENCHMARK_ROUND_TRIPS));
+}
+
+// the reader asks for less than the writer writes, so both sides keep filling and draining the buffer
+static void pipe_bulk_benchmark(void)
+{
+    fd_t fds[2];
+    if (pipe(fds))
+        perror("bulk: pipe(2) failed"), exit(1);
+
+    static char chunk[BENCHMARK_CHUNK_BYTES];
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        for (size_t written = 0; written < BENCHMARK_BULK_BYTES; written += sizeof(chunk))
+            write(fds[1], chunk, sizeof(chunk));
+        exit(0);
+    }
+
+    close(fds[1]);
+    size_t total = 0;
+    ssize_t n;
+    const u64 start = read_cycles();
+    while ((n = read(fds[0], chunk, sizeof(chunk) / 4)) > 0)
+        total += n;
+    const u64 cycles = read_cycles() - start;
+
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+    if (total != BENCHMARK_BULK_BYTES)
+        badbadbad();
+    printf("bulk: %llu cycles per KiB\n", (unsigned long long) (cycles / (BENCHMARK_BULK_BYTES / 1024)));
+}
+
 int main(void)
 {
     puts("MOS pipe(2) test.");
     signal(SIGPIPE, sigpipe_handler);
 
+    pipe_pingpong_benchmark();
+    pipe_bulk_benchmark();
+
     fd_t fds[2];
     if (pipe(fds))
     {
@@ -67,6 +155,7 @@ int main(void)
 
     const fd_t r = fds[0], w = fds[1];
 
+    fflush(stdout);
     if (fork() == 0)
     {
         // child = writer
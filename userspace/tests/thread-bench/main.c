@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <mos/syscall/usermode.h>
+#include <stdio.h>
+
+#define ROUNDS        16
+#define BATCH_THREADS 32 // threads alive at the same time in a round
+
+static u64 read_cycles(void)
+{
+#if defined(__x86_64__)
+    u32 lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((u64) hi << 32) | lo;
+#elif defined(__riscv)
+    u64 time;
+    __asm__ volatile("rdtime %0" : "=r"(time));
+    return time;
+#else
+    return 0;
+#endif
+}
+
+static void thread_main(void *arg)
+{
+    MOS_UNUSED(arg);
+    syscall_thread_exit();
+}
+
+int main(int argc, char **argv)
+{
+    MOS_UNUSED(argc);
+    MOS_UNUSED(argv);
+
+    u64 create_cycles = 0, exit_cycles = 0;
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        tid_t tids[BATCH_THREADS];
+
+        u64 start = read_cycles();
+        for (int i = 0; i < BATCH_THREADS; i++)
+            tids[i] = syscall_create_thread("bench", thread_main, NULL, 0, NULL);
+        create_cycles += read_cycles() - start;
+
+        start = read_cycles();
+        for (int i = 0; i < BATCH_THREADS; i++)
+            syscall_wait_for_thread(tids[i]);
+        exit_cycles += read_cycles() - start;
+    }
+
+    const u64 n = ROUNDS * BATCH_THREADS;
+    printf("thread create: %llu cycles per thread\n", (unsigned long long) (create_cycles / n));
+    printf("thread exit+join: %llu cycles per thread\n", (unsigned long long) (exit_cycles / n));
+    printf("create+exit throughput: %llu cycles per thread\n", (unsigned long long) ((create_cycles + exit_cycles) / n));
+    return 0;
+}
@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <fcntl.h>
+#include <mos/mos_global.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_FILE "/test-initrd/tests/userfs-bench" // cpiofs, mounted through userfs
+#define ROUNDS       8
+
+static const size_t batch_sizes[] = { 1, 8, 32 };
+static char buffer[64 KB];
+
+static u64 read_cycles(void)
+{
+#if defined(__x86_64__)
+    u32 lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((u64) hi << 32) | lo;
+#elif defined(__riscv)
+    u64 time;
+    __asm__ volatile("rdtime %0" : "=r"(time));
+    return time;
+#else
+    return 0;
+#endif
+}
+
+static bool write_sysfs(const char *path, const char *value)
+{
+    const int fd = open(path, O_WRONLY);
+    if (fd < 0)
+        return false;
+    const bool ok = write(fd, value, strlen(value)) == (ssize_t) strlen(value);
+    close(fd);
+    return ok;
+}
+
+// read the whole file with a cold page cache, returns the number of bytes read
+static size_t read_file_cold(const char *path, u64 *cycles)
+{
+    if (!write_sysfs("/sys/mmstat/drop_caches", "1"))
+        return 0;
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    size_t total = 0;
+    const u64 start = read_cycles();
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+        total += n;
+    *cycles += read_cycles() - start;
+
+    close(fd);
+    return total;
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : DEFAULT_FILE;
+
+    for (size_t i = 0; i < MOS_ARRAY_SIZE(batch_sizes); i++)
+    {
+        char value[16];
+        snprintf(value, sizeof(value), "%zu", batch_sizes[i]);
+        if (!write_sysfs("/sys/userfs/getpages_max", value))
+        {
+            fprintf(stderr, "failed to set the userfs getpages batch size\n");
+            return 1;
+        }
+
+        u64 cycles = 0;
+        size_t bytes = 0;
+        for (int round = 0; round < ROUNDS; round++)
+            bytes += read_file_cold(path, &cycles);
+
+        if (bytes == 0)
+        {
+            fprintf(stderr, "failed to read '%s'\n", path);
+            return 1;
+        }
+
+        const size_t pages = ALIGN_UP_TO_PAGE(bytes) / MOS_PAGE_SIZE;
+        printf("%2zu pages per request: %llu cycles per page, %zu KB read\n", batch_sizes[i], (unsigned long long) (cycles / pages), bytes / 1024);
+    }
+
+    return 0;
+}